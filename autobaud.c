@@ -0,0 +1,343 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include "autobaud.h"
+#include "serial.h"
+
+/* window per candidate fits this many characters, within limits in ms */
+#define AUTOBAUD_CHARS 48
+#define AUTOBAUD_MIN_WINDOW 15
+#define AUTOBAUD_MAX_WINDOW 120
+
+/* candidates with fewer bytes are not scored */
+#define AUTOBAUD_MIN_BYTES 4
+/* window always fits this many, even beyond AUTOBAUD_MAX_WINDOW at low rates */
+#define AUTOBAUD_MIN_CHARS (AUTOBAUD_MIN_BYTES + 6)
+/* best candidate below this is not trusted */
+#define AUTOBAUD_MIN_SCORE 0.5
+
+/* rates with best 8N1 score that get other formats tried */
+#define AUTOBAUD_FORMAT_RATES 2
+
+typedef struct {
+    DataBits databits;
+    Parity parity;
+} AutoBaudFormat;
+
+/* tried after 8N1, at the best rates only */
+static const AutoBaudFormat formats[] = {
+    { GUART_BITS8, GUART_PARITY_EVEN },
+    { GUART_BITS8, GUART_PARITY_ODD },
+    { GUART_BITS7, GUART_PARITY_EVEN },
+    { GUART_BITS7, GUART_PARITY_ODD },
+};
+
+struct _AutoBaud {
+    int fd;
+    struct termios saved;
+    Configuration *cfg; /* port settings of candidate being sampled */
+
+    GThread *thread;
+    gint cancelled;
+    gint done;
+    gint notify_pending;
+    guint notify_source;
+    AutoBaudDoneFunc func;
+    gpointer data;
+
+    /* written by detection thread, read after done */
+    AutoBaudCandidate best;
+    gboolean found;
+};
+
+/* patterns wrong baudrate tends to produce: a lone edge or no edge at all */
+static gboolean auto_baud_is_junk(guint8 c)
+{
+    switch (c)
+    {
+        case 0x00: case 0x80: case 0xC0: case 0xE0:
+        case 0xF0: case 0xF8: case 0xFC: case 0xFE: case 0xFF:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/**
+ *  Errors cost twice what intact bytes earn, junk bytes cancel themselves
+ *  out and text earns a bonus, which separates 7 bit formats from 8 bit
+ *  ones where framing can't.
+ **/
+static void auto_baud_score(AutoBaudCandidate *c, gsize junk, gsize text)
+{
+    gsize total = c->bytes + c->errors;
+
+    if (c->bytes < AUTOBAUD_MIN_BYTES)
+    {
+        c->score = -1.0;
+        return;
+    }
+
+    c->score = ((gdouble)c->bytes - 2.0 * c->errors - junk + 0.25 * text) / total;
+}
+
+/**
+ *  Samples line with settings of candidate, see serial_set_probe_mode()
+ *  for how errors are marked in data.
+ **/
+static void auto_baud_sample(AutoBaud *ab, AutoBaudCandidate *c)
+{
+    gint64 window = (gint64)AUTOBAUD_CHARS * 10 * 1000 / c->rate;
+    gint64 deadline;
+    gsize junk = 0, text = 0;
+    guint marked = 0; /* bytes of \377 \0 X sequence seen */
+    guint8 buf[4096];
+
+    c->bytes = 0;
+    c->errors = 0;
+    c->score = -1.0;
+
+    ab->cfg->rate = c->rate;
+    ab->cfg->databits = c->databits;
+    ab->cfg->parity = c->parity;
+    ab->cfg->stopbits = c->stopbits;
+    if (!serial_set_probe_mode(ab->fd, ab->cfg))
+        return;
+    tcflush(ab->fd, TCIFLUSH);
+
+    window = CLAMP(window, AUTOBAUD_MIN_WINDOW, AUTOBAUD_MAX_WINDOW);
+    window = MAX(window, (gint64)AUTOBAUD_MIN_CHARS * 10 * 1000 / c->rate);
+    deadline = g_get_monotonic_time() + window * 1000;
+    while (!g_atomic_int_get(&ab->cancelled))
+    {
+        struct pollfd pfd = { ab->fd, POLLIN, 0 };
+        gint64 left = deadline - g_get_monotonic_time();
+        ssize_t n, i;
+
+        if (left <= 0)
+            break;
+        if (poll(&pfd, 1, (left + 999) / 1000) <= 0)
+            continue;
+
+        n = read(ab->fd, buf, sizeof(buf));
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (n <= 0)
+            break;
+
+        for (i = 0; i < n; i++)
+        {
+            guint8 b = buf[i];
+
+            if (marked == 1)
+            {
+                if (b == 0xFF)
+                {
+                    marked = 0;
+                    c->bytes++;
+                    junk++;
+                    continue;
+                }
+                marked = 2;
+                continue;
+            }
+            if (marked == 2)
+            {
+                marked = 0;
+                c->errors++;
+                continue;
+            }
+            if (b == 0xFF)
+            {
+                marked = 1;
+                continue;
+            }
+
+            c->bytes++;
+            if (auto_baud_is_junk(b))
+                junk++;
+            else if (g_ascii_isprint(b) || b == '\r' || b == '\n' || b == '\t')
+                text++;
+        }
+    }
+
+    auto_baud_score(c, junk, text);
+}
+
+static void auto_baud_keep_best(AutoBaud *ab, const AutoBaudCandidate *c)
+{
+    /* ties go to the candidate tried first, lower rate or plainer format */
+    if (c->score >= 0 && (!ab->found || c->score > ab->best.score))
+    {
+        ab->best = *c;
+        ab->found = TRUE;
+    }
+}
+
+static gboolean auto_baud_done_cb(gpointer data)
+{
+    AutoBaud *ab = (AutoBaud*)data;
+
+    g_atomic_int_set(&ab->notify_pending, 0);
+    ab->func(ab, ab->data);
+
+    return FALSE;
+}
+
+static gpointer auto_baud_thread(gpointer data)
+{
+    AutoBaud *ab = (AutoBaud*)data;
+    AutoBaudCandidate *rates = g_new0(AutoBaudCandidate, n_baud_labels);
+    guint top[AUTOBAUD_FORMAT_RATES];
+    guint n_top = 0;
+    guint i, j;
+
+    /* back to back, lowest rate first */
+    for (i = 0; i < n_baud_labels && !g_atomic_int_get(&ab->cancelled); i++)
+    {
+        rates[i].rate = g_ascii_strtoull(baud_labels[i], NULL, 10);
+        rates[i].databits = GUART_BITS8;
+        rates[i].parity = GUART_PARITY_NONE;
+        rates[i].stopbits = GUART_STOPBITS1;
+        auto_baud_sample(ab, &rates[i]);
+        auto_baud_keep_best(ab, &rates[i]);
+    }
+
+    for (i = 0; i < n_baud_labels; i++)
+    {
+        guint k;
+
+        if (rates[i].score < 0)
+            continue;
+
+        /* insertion into top rates, ordered by score */
+        for (k = n_top; k > 0 && rates[top[k - 1]].score < rates[i].score; k--)
+        {
+            if (k < AUTOBAUD_FORMAT_RATES)
+                top[k] = top[k - 1];
+        }
+        if (k < AUTOBAUD_FORMAT_RATES)
+        {
+            top[k] = i;
+            n_top = MIN(n_top + 1, AUTOBAUD_FORMAT_RATES);
+        }
+    }
+
+    for (i = 0; i < n_top; i++)
+    {
+        for (j = 0; j < G_N_ELEMENTS(formats) && !g_atomic_int_get(&ab->cancelled); j++)
+        {
+            AutoBaudCandidate c = rates[top[i]];
+
+            c.databits = formats[j].databits;
+            c.parity = formats[j].parity;
+            auto_baud_sample(ab, &c);
+            auto_baud_keep_best(ab, &c);
+        }
+    }
+    g_free(rates);
+
+    if (ab->found && ab->best.score < AUTOBAUD_MIN_SCORE)
+        ab->found = FALSE;
+
+    g_atomic_int_set(&ab->done, 1);
+    if (!g_atomic_int_get(&ab->cancelled))
+    {
+        g_atomic_int_set(&ab->notify_pending, 1);
+        ab->notify_source = g_idle_add(auto_baud_done_cb, ab);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Starts detection on port, which must not be connected. Port settings
+ *  are restored once detection is freed.
+ *
+ *  \return NULL if port can't be opened
+ **/
+AutoBaud *auto_baud_new(const gchar *port, AutoBaudDoneFunc func, gpointer data)
+{
+    AutoBaud *ab;
+    int fd;
+
+    fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+        g_message("Failed to open %s: %s", port, g_strerror(errno));
+        return NULL;
+    }
+
+    ab = g_slice_new0(AutoBaud);
+    ab->fd = fd;
+    if (tcgetattr(fd, &ab->saved) < 0)
+    {
+        g_message("%s is not a serial port", port);
+        close(fd);
+        g_slice_free(AutoBaud, ab);
+        return NULL;
+    }
+
+    ab->cfg = configuration_new();
+    ab->cfg->flow = GUART_FLOW_NONE;
+    ab->func = func;
+    ab->data = data;
+    ab->thread = g_thread_new("autobaud", auto_baud_thread, ab);
+
+    return ab;
+}
+
+/**
+ *  Cancels detection if it is still running.
+ **/
+void auto_baud_free(AutoBaud *ab)
+{
+    g_atomic_int_set(&ab->cancelled, 1);
+    g_thread_join(ab->thread);
+    if (g_atomic_int_get(&ab->notify_pending))
+        g_source_remove(ab->notify_source);
+
+    tcsetattr(ab->fd, TCSANOW, &ab->saved);
+    close(ab->fd);
+    configuration_free(ab->cfg);
+    g_slice_free(AutoBaud, ab);
+}
+
+gboolean auto_baud_is_done(AutoBaud *ab)
+{
+    return g_atomic_int_get(&ab->done);
+}
+
+/**
+ *  \return FALSE if no candidate received plausible data, valid once
+ *  detection is done
+ **/
+gboolean auto_baud_get_result(AutoBaud *ab, AutoBaudCandidate *best)
+{
+    if (!ab->found)
+        return FALSE;
+
+    *best = ab->best;
+
+    return TRUE;
+}
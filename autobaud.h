@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef AUTOBAUD_H
+#define AUTOBAUD_H
+
+#include <glib.h>
+#include "conf.h"
+
+/**
+ *  Detection of baudrate and frame format of traffic already on the line.
+ *  Every common baudrate is sampled as 8N1 for a short window, then data
+ *  bits and parity are tried at the best rates. Candidates are scored by
+ *  the share of bytes received without framing or parity errors and by
+ *  how plausible received bytes are (see autobaud.c). Runs on its own
+ *  thread, the whole sweep takes a few seconds at most; callback is
+ *  called from main loop when done and freeing detection cancels it.
+ *  Stop bits are not detected, receivers accept longer stop bits anyway.
+ **/
+typedef struct _AutoBaud AutoBaud;
+
+typedef struct {
+    guint rate;
+    DataBits databits;
+    Parity parity;
+    StopBits stopbits;
+    gsize bytes;   /* received intact */
+    gsize errors;  /* framing, parity and break */
+    gdouble score; /* higher is better, < 0 if too little was received */
+} AutoBaudCandidate;
+
+typedef void (*AutoBaudDoneFunc)(AutoBaud *ab, gpointer data);
+
+AutoBaud *auto_baud_new(const gchar *port, AutoBaudDoneFunc func, gpointer data);
+void auto_baud_free(AutoBaud *ab);
+
+gboolean auto_baud_is_done(AutoBaud *ab);
+gboolean auto_baud_get_result(AutoBaud *ab, AutoBaudCandidate *best);
+
+#endif /* AUTOBAUD_H */
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#endif
+#include "baudrate.h"
+
+/**
+ *  Sets arbitrary baudrate with BOTHER, on top of settings already applied
+ *  with tcsetattr(). Driver picks the closest rate it can generate.
+ *
+ *  \return FALSE if not supported by system or driver
+ **/
+gboolean baudrate_set_custom(int fd, guint rate)
+{
+#if defined(__linux__) && defined(BOTHER)
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) < 0)
+        return FALSE;
+
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = rate;
+    tio.c_ospeed = rate;
+
+    return ioctl(fd, TCSETS2, &tio) == 0;
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ *  Reads back output baudrate as reported by the driver, which may differ
+ *  from requested one if the port can't generate it exactly.
+ *
+ *  \return baudrate, 0 if it can't be determined
+ **/
+guint baudrate_get(int fd)
+{
+#if defined(__linux__) && defined(BOTHER)
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) < 0)
+        return 0;
+
+    return tio.c_ospeed;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,30 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef BAUDRATE_H
+#define BAUDRATE_H
+
+#include <glib.h>
+
+/*
+   Linux termios2 interface, kept apart from serial.c as <asm/termbits.h>
+   cannot be included together with <termios.h>.
+*/
+
+gboolean baudrate_set_custom(int fd, guint rate);
+guint baudrate_get(int fd);
+
+#endif /* BAUDRATE_H */
@@ -0,0 +1,352 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+/*
+   Receive path benchmark. A pseudo terminal stands in for the serial port:
+   the slave side is opened with serial_connect() and read by the same
+   Receiver/Display/HexView pipeline guart uses, while a writer thread
+   feeds synthetic text into the master side at given rate and chunk size.
+
+   Latency is measured from the moment a chunk was written to the master
+   until the frame in which its last byte was painted.
+*/
+
+#define _XOPEN_SOURCE 600
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "conf.h"
+#include "serial.h"
+#include "receiver.h"
+
+#define LINE_LENGTH 64
+#define SETTLE_TIMEOUT (2 * G_USEC_PER_SEC) /* max wait for data in flight */
+#define SETTLE_POLL_MS 50
+
+typedef struct {
+    /* options */
+    gint rate;     /* bytes per second, 0 = as fast as possible */
+    gint chunk;    /* bytes per write() */
+    gint duration; /* seconds */
+    gint latency;  /* display latency in ms */
+    gint scrollback;
+    gboolean low_latency;
+
+    int master_fd;
+    int serial_fd;
+    GIOChannel *channel;
+    GThread *writer;
+    gint stop;
+
+    /* write time of each chunk, appended by writer thread */
+    GMutex lock;
+    GArray *sent_time;
+
+    guint next_chunk;  /* first chunk not yet seen painted */
+    GArray *latencies; /* in microseconds */
+
+    gint64 start;
+    gint64 stopped;
+
+    Display *display;
+    ByteStore *store;
+    HexView *hexview;
+    Receiver *rx;
+} Bench;
+
+static gpointer bench_writer_thread(gpointer data)
+{
+    Bench *bench = (Bench*)data;
+    guint8 *pattern = g_malloc(bench->chunk + LINE_LENGTH);
+    guint64 sent = 0;
+    gint i;
+
+    for (i = 0; i < bench->chunk + LINE_LENGTH; i++)
+    {
+        pattern[i] = (i % LINE_LENGTH == LINE_LENGTH - 1) ?
+                     '\n' : 'A' + (i % LINE_LENGTH) % 26;
+    }
+
+    while (!g_atomic_int_get(&bench->stop))
+    {
+        const guint8 *data = pattern + sent % LINE_LENGTH;
+        gsize left = bench->chunk;
+        gint64 now;
+
+        if (bench->rate > 0)
+        {
+            gint64 due = bench->start + (gint64)(sent * G_USEC_PER_SEC / bench->rate);
+
+            now = g_get_monotonic_time();
+            if (due > now)
+                g_usleep(due - now);
+        }
+
+        while (left > 0)
+        {
+            ssize_t ret = write(bench->master_fd, data, left);
+
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                g_message("Write to pty failed: %s", strerror(errno));
+                g_free(pattern);
+                return NULL;
+            }
+            data += ret;
+            left -= ret;
+        }
+
+        now = g_get_monotonic_time();
+        g_mutex_lock(&bench->lock);
+        g_array_append_val(bench->sent_time, now);
+        g_mutex_unlock(&bench->lock);
+
+        sent += bench->chunk;
+    }
+
+    g_free(pattern);
+    return NULL;
+}
+
+/**
+ *  Records latency of every chunk that was completely inserted into
+ *  text buffer before the frame that was just painted.
+ **/
+static void bench_after_paint_cb(GdkFrameClock *clock, gpointer data)
+{
+    Bench *bench = (Bench*)data;
+    guint64 rendered = display_get_flushed(bench->display);
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&bench->lock);
+    while (bench->next_chunk < bench->sent_time->len &&
+           (guint64)(bench->next_chunk + 1) * bench->chunk <= rendered)
+    {
+        gint64 latency = now - g_array_index(bench->sent_time, gint64, bench->next_chunk);
+
+        g_array_append_val(bench->latencies, latency);
+        bench->next_chunk++;
+    }
+    g_mutex_unlock(&bench->lock);
+}
+
+static gint compare_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64*)a;
+    gint64 y = *(const gint64*)b;
+
+    return (x > y) - (x < y);
+}
+
+static gint64 percentile(GArray *sorted, guint p)
+{
+    if (sorted->len == 0)
+        return 0;
+
+    return g_array_index(sorted, gint64, (sorted->len - 1) * p / 100);
+}
+
+static void bench_report(Bench *bench)
+{
+    guint64 sent = (guint64)bench->sent_time->len * bench->chunk;
+    guint64 received = receiver_get_received(bench->rx);
+    gdouble seconds = (gdouble)(bench->stopped - bench->start) / G_USEC_PER_SEC;
+    SerialReaderStats stats;
+
+    serial_reader_get_stats(receiver_get_reader(bench->rx), &stats);
+
+    g_array_sort(bench->latencies, compare_gint64);
+
+    printf("rate:        %d bytes/s%s, chunk %d bytes, %d s%s\n",
+           bench->rate, bench->rate == 0 ? " (unlimited)" : "",
+           bench->chunk, bench->duration, bench->low_latency ? ", low latency" : "");
+    printf("sent:        %" G_GUINT64_FORMAT " bytes\n", sent);
+    printf("received:    %" G_GUINT64_FORMAT " bytes\n", received);
+    printf("dropped:     %" G_GSIZE_FORMAT " bytes\n",
+           serial_reader_get_overruns(receiver_get_reader(bench->rx)));
+    printf("throughput:  %.0f bytes/s\n", seconds > 0 ? received / seconds : 0);
+    printf("syscalls:    %" G_GSIZE_FORMAT " read, %" G_GSIZE_FORMAT " poll, %"
+           G_GSIZE_FORMAT " ioctl, %.4f per byte\n",
+           stats.reads, stats.polls, stats.ioctls,
+           stats.bytes > 0 ? (gdouble)(stats.reads + stats.polls + stats.ioctls) / stats.bytes : 0);
+    printf("latency:     p50 %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT
+           " us, max %" G_GINT64_FORMAT " us (%u chunks)\n",
+           percentile(bench->latencies, 50), percentile(bench->latencies, 99),
+           percentile(bench->latencies, 100), bench->latencies->len);
+}
+
+static gboolean bench_settle_cb(gpointer data)
+{
+    Bench *bench = (Bench*)data;
+    guint64 sent = (guint64)bench->sent_time->len * bench->chunk;
+    guint64 lost = serial_reader_get_overruns(receiver_get_reader(bench->rx));
+
+    if (display_get_flushed(bench->display) + lost < sent &&
+        g_get_monotonic_time() - bench->stopped < SETTLE_TIMEOUT)
+    {
+        return TRUE;
+    }
+
+    bench_report(bench);
+    gtk_main_quit();
+
+    return FALSE;
+}
+
+static gboolean bench_stop_cb(gpointer data)
+{
+    Bench *bench = (Bench*)data;
+
+    g_atomic_int_set(&bench->stop, 1);
+    g_thread_join(bench->writer);
+    bench->writer = NULL;
+    bench->stopped = g_get_monotonic_time();
+
+    g_timeout_add(SETTLE_POLL_MS, bench_settle_cb, bench);
+
+    return FALSE;
+}
+
+/**
+ *  Opens pseudo terminal master and connects to its slave like to
+ *  a serial port.
+ *
+ *  \return FALSE on failure
+ **/
+static gboolean bench_open_pty(Bench *bench)
+{
+    Configuration *cfg;
+    const gchar *slave;
+
+    bench->master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (bench->master_fd < 0 || grantpt(bench->master_fd) < 0 ||
+        unlockpt(bench->master_fd) < 0 || (slave = ptsname(bench->master_fd)) == NULL)
+    {
+        g_message("Unable to create pseudo terminal: %s", strerror(errno));
+        return FALSE;
+    }
+
+    cfg = configuration_new();
+    cfg->port = g_strdup(slave);
+    cfg->low_latency = bench->low_latency;
+    bench->channel = serial_connect(cfg, &bench->serial_fd);
+    configuration_free(cfg);
+
+    return bench->channel != NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    Bench bench;
+    GOptionEntry entries[] = {
+        {"rate", 'r', 0, G_OPTION_ARG_INT, &bench.rate, "Bytes per second, 0 for unlimited (default 0)", "N"},
+        {"chunk", 'c', 0, G_OPTION_ARG_INT, &bench.chunk, "Bytes per write (default 64)", "N"},
+        {"duration", 'd', 0, G_OPTION_ARG_INT, &bench.duration, "Seconds to run (default 10)", "N"},
+        {"latency", 'l', 0, G_OPTION_ARG_INT, &bench.latency, "Display latency in ms (default 0)", "MS"},
+        {"low-latency", 'L', 0, G_OPTION_ARG_NONE, &bench.low_latency, "Use low latency connection mode", NULL},
+        {"scrollback", 's', 0, G_OPTION_ARG_INT, &bench.scrollback, "Scrollback lines, 0 for unlimited (default 100000)", "N"},
+        {NULL}
+    };
+    GError *error = NULL;
+    GtkWidget *window, *notebook, *scrolled_window, *view;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.chunk = 64;
+    bench.duration = 10;
+    bench.scrollback = 100000;
+
+    if (!gtk_init_with_args(&argc, &argv, "- benchmark guart receive path",
+                            entries, NULL, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    if (bench.chunk <= 0 || bench.duration <= 0 || bench.rate < 0 ||
+        bench.latency < 0 || bench.scrollback < 0)
+    {
+        g_printerr("Invalid arguments\n");
+        return 1;
+    }
+
+    if (!bench_open_pty(&bench))
+        return 1;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_default_size(GTK_WINDOW(window), 650, 500);
+    gtk_window_set_title(GTK_WINDOW(window), "guart benchmark");
+
+    view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(view), FALSE);
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), view);
+
+    bench.display = display_new(GTK_TEXT_VIEW(view));
+    display_set_latency(bench.display, bench.latency);
+    display_set_scrollback(bench.display, bench.scrollback, GUART_SCROLLBACK_LINES);
+    bench.store = byte_store_new();
+    bench.hexview = hex_view_new_for_store(bench.store);
+    bench.rx = receiver_new(bench.display, bench.store, bench.hexview, NULL, NULL, 0);
+
+    notebook = gtk_notebook_new();
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), scrolled_window,
+                             gtk_label_new("Text View"));
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), hex_view_get_widget(bench.hexview),
+                             gtk_label_new("Hex View"));
+    gtk_container_add(GTK_CONTAINER(window), notebook);
+    gtk_widget_show_all(window);
+
+    g_signal_connect(G_OBJECT(gtk_widget_get_frame_clock(window)), "after-paint",
+                     G_CALLBACK(bench_after_paint_cb), &bench);
+
+    g_mutex_init(&bench.lock);
+    bench.sent_time = g_array_new(FALSE, FALSE, sizeof(gint64));
+    bench.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    if (!receiver_start(bench.rx, bench.serial_fd))
+    {
+        g_message("Unable to start serial reader");
+        return 1;
+    }
+    serial_reader_set_low_latency(receiver_get_reader(bench.rx), bench.low_latency);
+
+    bench.start = g_get_monotonic_time();
+    bench.writer = g_thread_new("bench-writer", bench_writer_thread, &bench);
+    g_timeout_add_seconds(bench.duration, bench_stop_cb, &bench);
+
+    gtk_main();
+
+    receiver_free(bench.rx);
+    display_free(bench.display);
+    serial_restore(bench.serial_fd);
+    g_io_channel_unref(bench.channel);
+    close(bench.master_fd);
+    byte_store_free(bench.store);
+    g_array_free(bench.sent_time, TRUE);
+    g_array_free(bench.latencies, TRUE);
+    g_mutex_clear(&bench.lock);
+
+    return 0;
+}
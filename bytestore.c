@@ -0,0 +1,397 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+#include <lz4hc.h>
+#include "bytestore.h"
+
+/* chunks decompressed at once by each reader */
+#define UNPACK_CACHE_SLOTS 4
+
+typedef struct {
+    guint8 *data;   /* raw bytes, NULL once packed */
+    guint8 *packed; /* set once, before data is dropped */
+    gint packed_len;
+} StoreChunk;
+
+typedef struct {
+    StoreChunk *chunks[UNPACK_CACHE_SLOTS];
+    guint8 *data[UNPACK_CACHE_SLOTS];
+    guint next; /* slot replaced next */
+} UnpackCache;
+
+struct _ByteStore {
+    GPtrArray *chunks;  /* of StoreChunk */
+    guint64 start;      /* offset of first byte of first chunk */
+    guint64 end;        /* offset one past last stored byte */
+
+    /* guards data of chunks and the counters below against the packer */
+    GMutex lock;
+    guint64 packed_chunks;
+    guint64 packed_bytes;
+
+    GThread *packer;
+    GAsyncQueue *cold; /* chunks to pack, store itself to stop the packer */
+
+    UnpackCache cache; /* main thread only */
+};
+
+struct _ByteStoreSnapshot {
+    ByteStore *store;
+    StoreChunk **chunks; /* copy of store's chunk pointers */
+    guint n_chunks;
+    guint64 start;
+    guint64 end;
+
+    UnpackCache cache; /* for thread reading snapshot */
+};
+
+static void store_chunk_free(gpointer data)
+{
+    StoreChunk *chunk = (StoreChunk*)data;
+
+    g_free(chunk->data);
+    g_free(chunk->packed);
+    g_slice_free(StoreChunk, chunk);
+}
+
+static void unpack_cache_clear(UnpackCache *cache)
+{
+    guint i;
+
+    for (i = 0; i < UNPACK_CACHE_SLOTS; i++)
+        g_free(cache->data[i]);
+}
+
+/**
+ *  Compresses chunks that left the hot window. Chunk data never changes
+ *  once cold, so it is compressed without holding the lock, which is only
+ *  taken to swap the raw data for the compressed copy.
+ **/
+static gpointer byte_store_packer(gpointer data)
+{
+    ByteStore *store = (ByteStore*)data;
+    gint bound = LZ4_compressBound(BYTE_STORE_CHUNK_SIZE);
+    guint8 *buf = g_malloc(bound);
+    gpointer item;
+
+    while ((item = g_async_queue_pop(store->cold)) != store)
+    {
+        StoreChunk *chunk = (StoreChunk*)item;
+        guint8 *raw = chunk->data;
+        gint len = LZ4_compress_HC((const char*)raw, (char*)buf, BYTE_STORE_CHUNK_SIZE,
+                                   bound, LZ4HC_CLEVEL_DEFAULT);
+
+        /* data that does not compress stays as it is */
+        if (len <= 0 || len >= BYTE_STORE_CHUNK_SIZE)
+            continue;
+
+        g_mutex_lock(&store->lock);
+        chunk->packed = g_malloc(len);
+        memcpy(chunk->packed, buf, len);
+        chunk->packed_len = len;
+        chunk->data = NULL;
+        store->packed_chunks++;
+        store->packed_bytes += len;
+        g_mutex_unlock(&store->lock);
+
+        g_free(raw);
+    }
+
+    g_free(buf);
+
+    return NULL;
+}
+
+ByteStore *byte_store_new(void)
+{
+    ByteStore *store = g_slice_new0(ByteStore);
+
+    store->chunks = g_ptr_array_new_with_free_func(store_chunk_free);
+    g_mutex_init(&store->lock);
+    store->cold = g_async_queue_new();
+
+    return store;
+}
+
+void byte_store_free(ByteStore *store)
+{
+    if (store->packer != NULL)
+    {
+        /* chunks still queued are freed below, unpacked */
+        g_async_queue_push_front(store->cold, store);
+        g_thread_join(store->packer);
+    }
+    g_async_queue_unref(store->cold);
+    unpack_cache_clear(&store->cache);
+    g_ptr_array_free(store->chunks, TRUE);
+    g_mutex_clear(&store->lock);
+    g_slice_free(ByteStore, store);
+}
+
+void byte_store_append(ByteStore *store, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        gsize used = (store->end - store->start) % BYTE_STORE_CHUNK_SIZE;
+        gsize chunk_len;
+        StoreChunk *chunk;
+
+        if (used == 0 && store->end - store->start ==
+            (guint64)store->chunks->len * BYTE_STORE_CHUNK_SIZE)
+        {
+            /* last chunk is full (or there is none) */
+            chunk = g_slice_new0(StoreChunk);
+            chunk->data = g_malloc(BYTE_STORE_CHUNK_SIZE);
+            g_ptr_array_add(store->chunks, chunk);
+
+            if (store->chunks->len > BYTE_STORE_HOT_CHUNKS)
+            {
+                if (store->packer == NULL)
+                    store->packer = g_thread_new("byte-store-packer", byte_store_packer, store);
+                g_async_queue_push(store->cold, g_ptr_array_index(store->chunks,
+                                   store->chunks->len - 1 - BYTE_STORE_HOT_CHUNKS));
+            }
+        }
+
+        chunk = g_ptr_array_index(store->chunks, store->chunks->len - 1);
+        chunk_len = MIN(len, BYTE_STORE_CHUNK_SIZE - used);
+        memcpy(chunk->data + used, data, chunk_len);
+
+        store->end += chunk_len;
+        data += chunk_len;
+        len -= chunk_len;
+    }
+}
+
+/**
+ *  \return offset of oldest byte available in store
+ **/
+guint64 byte_store_get_start(ByteStore *store)
+{
+    return store->start;
+}
+
+/**
+ *  \return offset one past newest byte in store (total bytes appended)
+ **/
+guint64 byte_store_get_end(ByteStore *store)
+{
+    return store->end;
+}
+
+/**
+ *  Copies whole cold chunk into a cache slot, decompressing it if packer
+ *  already got to it.
+ *
+ *  \return chunk data, valid until cache is used again
+ **/
+static const guint8 *unpack_cache_get(UnpackCache *cache, ByteStore *store,
+                                      StoreChunk *chunk)
+{
+    guint slot;
+
+    for (slot = 0; slot < UNPACK_CACHE_SLOTS; slot++)
+    {
+        if (cache->chunks[slot] == chunk)
+            return cache->data[slot];
+    }
+
+    slot = cache->next;
+    cache->next = (cache->next + 1) % UNPACK_CACHE_SLOTS;
+    if (cache->data[slot] == NULL)
+        cache->data[slot] = g_malloc(BYTE_STORE_CHUNK_SIZE);
+    cache->chunks[slot] = chunk;
+
+    g_mutex_lock(&store->lock);
+    if (chunk->data != NULL)
+    {
+        /* not packed yet */
+        memcpy(cache->data[slot], chunk->data, BYTE_STORE_CHUNK_SIZE);
+        g_mutex_unlock(&store->lock);
+        return cache->data[slot];
+    }
+    g_mutex_unlock(&store->lock);
+
+    /* packed data never changes once set */
+    if (LZ4_decompress_safe((const char*)chunk->packed, (char*)cache->data[slot],
+                            chunk->packed_len, BYTE_STORE_CHUNK_SIZE) != BYTE_STORE_CHUNK_SIZE)
+    {
+        g_message("Corrupted scrollback chunk");
+        memset(cache->data[slot], 0, BYTE_STORE_CHUNK_SIZE);
+    }
+
+    return cache->data[slot];
+}
+
+/**
+ *  Returns pointer to data at offset, without copying for recent data.
+ *  len is set to number of contiguous bytes available there (never
+ *  crosses chunk boundary). Older data is decompressed first; pointer
+ *  is valid until the store is used again.
+ *
+ *  \return NULL if offset is not in store
+ **/
+const guint8 *byte_store_peek(ByteStore *store, guint64 offset, gsize *len)
+{
+    guint64 rel;
+    gsize in_chunk;
+    guint index;
+    StoreChunk *chunk;
+
+    if (offset < store->start || offset >= store->end)
+    {
+        *len = 0;
+        return NULL;
+    }
+
+    rel = offset - store->start;
+    in_chunk = rel % BYTE_STORE_CHUNK_SIZE;
+    *len = MIN(BYTE_STORE_CHUNK_SIZE - in_chunk, store->end - offset);
+
+    index = rel / BYTE_STORE_CHUNK_SIZE;
+    chunk = g_ptr_array_index(store->chunks, index);
+    /* hot chunks are only touched by the thread appending */
+    if (index + BYTE_STORE_HOT_CHUNKS >= store->chunks->len)
+        return chunk->data + in_chunk;
+
+    return unpack_cache_get(&store->cache, store, chunk) + in_chunk;
+}
+
+/**
+ *  Copies up to len bytes starting at offset into buf.
+ *
+ *  \return number of bytes copied
+ **/
+gsize byte_store_read(ByteStore *store, guint64 offset, guint8 *buf, gsize len)
+{
+    gsize copied = 0;
+
+    while (copied < len)
+    {
+        gsize avail;
+        const guint8 *ptr = byte_store_peek(store, offset + copied, &avail);
+
+        if (ptr == NULL)
+            break;
+
+        avail = MIN(avail, len - copied);
+        memcpy(buf + copied, ptr, avail);
+        copied += avail;
+    }
+
+    return copied;
+}
+
+/**
+ *  Sets stored to number of bytes in store and used to memory taken by
+ *  their chunks, packed or not.
+ **/
+void byte_store_get_memory(ByteStore *store, guint64 *stored, guint64 *used)
+{
+    *stored = store->end - store->start;
+
+    g_mutex_lock(&store->lock);
+    *used = (store->chunks->len - store->packed_chunks) * (guint64)BYTE_STORE_CHUNK_SIZE +
+            store->packed_bytes;
+    g_mutex_unlock(&store->lock);
+}
+
+/**
+ *  Takes snapshot of data stored so far. Must be called from the thread
+ *  appending to store.
+ **/
+ByteStoreSnapshot *byte_store_snapshot_new(ByteStore *store)
+{
+    ByteStoreSnapshot *snap = g_slice_new0(ByteStoreSnapshot);
+
+    snap->store = store;
+    snap->n_chunks = store->chunks->len;
+    snap->chunks = g_new(StoreChunk*, snap->n_chunks);
+    memcpy(snap->chunks, store->chunks->pdata, snap->n_chunks * sizeof(StoreChunk*));
+    snap->start = store->start;
+    snap->end = store->end;
+
+    return snap;
+}
+
+void byte_store_snapshot_free(ByteStoreSnapshot *snap)
+{
+    unpack_cache_clear(&snap->cache);
+    g_free(snap->chunks);
+    g_slice_free(ByteStoreSnapshot, snap);
+}
+
+/**
+ *  \return offset of first byte in snapshot
+ **/
+guint64 byte_store_snapshot_get_start(ByteStoreSnapshot *snap)
+{
+    return snap->start;
+}
+
+/**
+ *  \return offset one past last byte in snapshot
+ **/
+guint64 byte_store_snapshot_get_end(ByteStoreSnapshot *snap)
+{
+    return snap->end;
+}
+
+/**
+ *  Copies up to len bytes starting at offset into buf, like
+ *  byte_store_read(), but only what was stored when snapshot was taken.
+ *  Any chunk may go cold meanwhile, so raw data is copied under the store
+ *  lock and packed data is decompressed into snapshot's own cache.
+ *
+ *  \return number of bytes copied
+ **/
+gsize byte_store_snapshot_read(ByteStoreSnapshot *snap, guint64 offset,
+                               guint8 *buf, gsize len)
+{
+    gsize copied = 0;
+
+    while (copied < len && offset + copied >= snap->start &&
+           offset + copied < snap->end)
+    {
+        guint64 rel = offset + copied - snap->start;
+        gsize in_chunk = rel % BYTE_STORE_CHUNK_SIZE;
+        gsize avail = MIN(BYTE_STORE_CHUNK_SIZE - in_chunk, snap->end - offset - copied);
+        StoreChunk *chunk = snap->chunks[rel / BYTE_STORE_CHUNK_SIZE];
+        gboolean done = FALSE;
+
+        avail = MIN(avail, len - copied);
+
+        g_mutex_lock(&snap->store->lock);
+        if (chunk->data != NULL)
+        {
+            memcpy(buf + copied, chunk->data + in_chunk, avail);
+            done = TRUE;
+        }
+        g_mutex_unlock(&snap->store->lock);
+
+        if (!done)
+        {
+            memcpy(buf + copied,
+                   unpack_cache_get(&snap->cache, snap->store, chunk) + in_chunk, avail);
+        }
+        copied += avail;
+    }
+
+    return copied;
+}
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef BYTESTORE_H
+#define BYTESTORE_H
+
+#include <glib.h>
+
+/**
+ *  Append-only byte storage made of fixed size chunks. Appending never
+ *  moves already stored data, so its cost does not depend on store size.
+ *  Data is addressed by absolute offset since the store was created.
+ *
+ *  Only the newest BYTE_STORE_HOT_CHUNKS chunks are kept as they are.
+ *  Older chunks are compressed with LZ4 by a background thread and
+ *  decompressed on demand when read, into a few cached chunks per reader,
+ *  so days of history fit in memory without slowing down appending.
+ **/
+typedef struct _ByteStore ByteStore;
+
+#define BYTE_STORE_CHUNK_SIZE (64 * 1024)
+#define BYTE_STORE_HOT_CHUNKS 64
+
+ByteStore *byte_store_new(void);
+void byte_store_free(ByteStore *store);
+
+void byte_store_append(ByteStore *store, const guint8 *data, gsize len);
+
+guint64 byte_store_get_start(ByteStore *store);
+guint64 byte_store_get_end(ByteStore *store);
+
+const guint8 *byte_store_peek(ByteStore *store, guint64 offset, gsize *len);
+gsize byte_store_read(ByteStore *store, guint64 offset, guint8 *buf, gsize len);
+void byte_store_get_memory(ByteStore *store, guint64 *stored, guint64 *used);
+
+/**
+ *  Read-only view of data stored so far. Stored bytes never change or
+ *  move, so a snapshot can be read from another thread while the store
+ *  keeps growing. Store must outlive its snapshots.
+ **/
+typedef struct _ByteStoreSnapshot ByteStoreSnapshot;
+
+ByteStoreSnapshot *byte_store_snapshot_new(ByteStore *store);
+void byte_store_snapshot_free(ByteStoreSnapshot *snap);
+guint64 byte_store_snapshot_get_start(ByteStoreSnapshot *snap);
+guint64 byte_store_snapshot_get_end(ByteStoreSnapshot *snap);
+gsize byte_store_snapshot_read(ByteStoreSnapshot *snap, guint64 offset,
+                               guint8 *buf, gsize len);
+
+#endif /* BYTESTORE_H */
@@ -0,0 +1,353 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "capture.h"
+
+/*
+   Records are copied into large buffers which are written out by a separate
+   thread, so neither serial reader nor GUI ever waits for the disk. If the
+   disk can't keep up with CAPTURE_MAX_BUFFERS in flight, records are dropped.
+*/
+#define CAPTURE_BUFFER_SIZE (1024 * 1024)
+#define CAPTURE_MAX_BUFFERS 16
+#define CAPTURE_FLUSH_INTERVAL (250 * 1000) /* microseconds */
+
+typedef struct {
+    guint8 *data;
+    gsize len;
+} CaptureBuffer;
+
+typedef struct {
+    guint64 timestamp;
+    guint64 offset;
+} CaptureIndexEntry;
+
+struct _CaptureWriter {
+    int fd;
+    GThread *thread;
+
+    GMutex lock; /* protects everything below */
+    CaptureBuffer *current;
+    GAsyncQueue *full;  /* buffers waiting to be written */
+    GAsyncQueue *empty; /* written buffers ready for reuse */
+    guint n_buffers;
+
+    gint64 start_time;
+    guint64 offset;     /* file offset of next record */
+    GArray *index;
+    guint64 last_index_offset;
+    gint64 last_index_time;
+
+    gsize dropped;
+    gboolean stopping;  /* stop marker is queued, nothing may follow it */
+    gboolean failed;    /* owned by writer thread until it is joined */
+};
+
+/* pushed to full queue to stop writer thread */
+static CaptureBuffer capture_stop;
+
+static gboolean write_all(int fd, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write(fd, data, len);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            g_message("Capture write failed: %s(%d)", strerror(errno), errno);
+            return FALSE;
+        }
+
+        data += written;
+        len -= written;
+    }
+
+    return TRUE;
+}
+
+static CaptureBuffer *capture_buffer_new(void)
+{
+    CaptureBuffer *buf = g_slice_new0(CaptureBuffer);
+
+    buf->data = g_malloc(CAPTURE_BUFFER_SIZE);
+
+    return buf;
+}
+
+static void capture_buffer_free(CaptureBuffer *buf)
+{
+    g_free(buf->data);
+    g_slice_free(CaptureBuffer, buf);
+}
+
+/**
+ *  Hands current buffer to writer thread and makes an empty one current.
+ *  Must be called with lock held.
+ *
+ *  \return FALSE if there is no buffer to switch to
+ **/
+static gboolean capture_switch_buffer(CaptureWriter *writer)
+{
+    CaptureBuffer *next = g_async_queue_try_pop(writer->empty);
+
+    if (next == NULL)
+    {
+        if (writer->n_buffers >= CAPTURE_MAX_BUFFERS)
+            return FALSE;
+
+        next = capture_buffer_new();
+        writer->n_buffers++;
+    }
+
+    g_async_queue_push(writer->full, writer->current);
+    writer->current = next;
+
+    return TRUE;
+}
+
+static gpointer capture_writer_thread(gpointer data)
+{
+    CaptureWriter *writer = (CaptureWriter*)data;
+
+    for (;;)
+    {
+        CaptureBuffer *buf = g_async_queue_timeout_pop(writer->full,
+                                                       CAPTURE_FLUSH_INTERVAL);
+
+        if (buf == NULL)
+        {
+            /* nothing filled a buffer for a while, write what we have */
+            g_mutex_lock(&writer->lock);
+            if (writer->current->len > 0 && !writer->stopping)
+                capture_switch_buffer(writer);
+            g_mutex_unlock(&writer->lock);
+            continue;
+        }
+
+        if (buf == &capture_stop)
+        {
+            /* last records, written here as nothing is queued after stop */
+            g_mutex_lock(&writer->lock);
+            if (!writer->failed && writer->current->len > 0)
+                writer->failed = !write_all(writer->fd, writer->current->data,
+                                            writer->current->len);
+            writer->current->len = 0;
+            g_mutex_unlock(&writer->lock);
+            break;
+        }
+
+        if (!writer->failed)
+            writer->failed = !write_all(writer->fd, buf->data, buf->len);
+
+        buf->len = 0;
+        g_async_queue_push(writer->empty, buf);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Copies len bytes into buffers, switching them as they fill.
+ *  Must be called with lock held, caller checks there is enough space.
+ **/
+static void capture_copy(CaptureWriter *writer, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        gsize chunk = MIN(len, CAPTURE_BUFFER_SIZE - writer->current->len);
+
+        memcpy(writer->current->data + writer->current->len, data, chunk);
+        writer->current->len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (writer->current->len == CAPTURE_BUFFER_SIZE)
+            capture_switch_buffer(writer);
+    }
+}
+
+/**
+ *  Creates capture file and starts writer thread.
+ *
+ *  \return NULL on error
+ **/
+CaptureWriter *capture_writer_new(const gchar *filename)
+{
+    return capture_writer_new_at(filename, g_get_monotonic_time());
+}
+
+/**
+ *  Like capture_writer_new(), but capture starts at start_time, a
+ *  g_get_monotonic_time() that may have passed already, e.g. when data
+ *  received since then is appended first.
+ *
+ *  \return NULL on error
+ **/
+CaptureWriter *capture_writer_new_at(const gchar *filename, gint64 start_time)
+{
+    CaptureWriter *writer;
+    guint8 header[CAPTURE_HEADER_SIZE];
+    guint32 version = GUINT32_TO_LE(CAPTURE_VERSION);
+    gint64 now = GINT64_TO_LE(g_get_real_time() - (g_get_monotonic_time() - start_time));
+    int fd;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        g_message("Unable to create %s: %s(%d)", filename, strerror(errno), errno);
+        return NULL;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, CAPTURE_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 16, &now, 8);
+    if (!write_all(fd, header, sizeof(header)))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    writer = g_slice_new0(CaptureWriter);
+    writer->fd = fd;
+    g_mutex_init(&writer->lock);
+    writer->current = capture_buffer_new();
+    writer->n_buffers = 1;
+    writer->full = g_async_queue_new();
+    writer->empty = g_async_queue_new();
+    writer->start_time = start_time;
+    writer->offset = CAPTURE_HEADER_SIZE;
+    writer->index = g_array_new(FALSE, FALSE, sizeof(CaptureIndexEntry));
+
+    writer->thread = g_thread_new("capture-writer", capture_writer_thread, writer);
+
+    return writer;
+}
+
+/**
+ *  Appends a record. Safe to call from any thread, never blocks on disk.
+ *  timestamp is g_get_monotonic_time() of the moment data was sent or received.
+ **/
+void capture_writer_append(CaptureWriter *writer, CaptureRecordType type,
+                           gint64 timestamp, const guint8 *data, gsize len)
+{
+    guint8 header[CAPTURE_RECORD_HEADER_SIZE];
+    guint64 ts = (guint64)MAX(timestamp - writer->start_time, 0) * 1000;
+    guint64 ts_le = GUINT64_TO_LE(ts);
+    guint32 len_le = GUINT32_TO_LE((guint32)len);
+    gsize total = sizeof(header) + len;
+    gsize space;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, &ts_le, 8);
+    memcpy(header + 8, &len_le, 4);
+    header[12] = (guint8)type;
+
+    g_mutex_lock(&writer->lock);
+
+    space = CAPTURE_BUFFER_SIZE - writer->current->len +
+            ((gsize)g_async_queue_length(writer->empty) +
+             CAPTURE_MAX_BUFFERS - writer->n_buffers) * CAPTURE_BUFFER_SIZE;
+    if (total > space)
+    {
+        /* never write partial records */
+        writer->dropped += len;
+        g_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    if (writer->index->len == 0 ||
+        writer->offset - writer->last_index_offset >= CAPTURE_INDEX_BYTES ||
+        timestamp - writer->last_index_time >= CAPTURE_INDEX_INTERVAL)
+    {
+        CaptureIndexEntry entry;
+
+        entry.timestamp = GUINT64_TO_LE(ts);
+        entry.offset = GUINT64_TO_LE(writer->offset);
+        g_array_append_val(writer->index, entry);
+        writer->last_index_offset = writer->offset;
+        writer->last_index_time = timestamp;
+    }
+
+    capture_copy(writer, header, sizeof(header));
+    capture_copy(writer, data, len);
+    writer->offset += total;
+
+    g_mutex_unlock(&writer->lock);
+}
+
+/**
+ *  \return number of bytes dropped because disk could not keep up
+ **/
+gsize capture_writer_get_dropped(CaptureWriter *writer)
+{
+    gsize dropped;
+
+    g_mutex_lock(&writer->lock);
+    dropped = writer->dropped;
+    g_mutex_unlock(&writer->lock);
+
+    return dropped;
+}
+
+/**
+ *  Writes out all pending records, appends index and closes the file.
+ *  No other thread may use writer during or after this call.
+ **/
+void capture_writer_close(CaptureWriter *writer)
+{
+    CaptureBuffer *buf;
+    guint8 trailer[CAPTURE_TRAILER_SIZE];
+    guint64 index_offset = GUINT64_TO_LE(writer->offset);
+    guint64 n = GUINT64_TO_LE((guint64)writer->index->len);
+
+    /* writer thread flushes current buffer itself once it gets here */
+    g_mutex_lock(&writer->lock);
+    writer->stopping = TRUE;
+    g_async_queue_push(writer->full, &capture_stop);
+    g_mutex_unlock(&writer->lock);
+    g_thread_join(writer->thread);
+
+    memcpy(trailer, &index_offset, 8);
+    memcpy(trailer + 8, &n, 8);
+    memcpy(trailer + 16, CAPTURE_INDEX_MAGIC, 8);
+
+    /* index offsets are only valid if all records made it to disk */
+    if (!writer->failed &&
+        write_all(writer->fd, (const guint8*)writer->index->data,
+                  writer->index->len * sizeof(CaptureIndexEntry)))
+    {
+        write_all(writer->fd, trailer, sizeof(trailer));
+    }
+    close(writer->fd);
+
+    capture_buffer_free(writer->current);
+    while ((buf = g_async_queue_try_pop(writer->empty)) != NULL)
+        capture_buffer_free(buf);
+
+    g_async_queue_unref(writer->full);
+    g_async_queue_unref(writer->empty);
+    g_array_free(writer->index, TRUE);
+    g_mutex_clear(&writer->lock);
+    g_slice_free(CaptureWriter, writer);
+}
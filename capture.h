@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glib.h>
+
+/*
+   Capture file format, all integers little endian:
+
+   header:  "GUARTCAP", guint32 version, guint32 reserved,
+            gint64 wall clock time of capture start (microseconds since epoch)
+   records: guint64 timestamp (nanoseconds since capture start, monotonic),
+            guint32 length, guint8 type (CaptureRecordType), 3 reserved bytes,
+            length bytes of data
+   index:   (only present if capture was closed properly)
+            n * { guint64 timestamp, guint64 file offset of record }
+   trailer: guint64 index offset, guint64 n, "GUARTIDX"
+
+   Control line records (CAPTURE_LINES) hold two bytes, lines that changed
+   and lines that are high after the change, as ModemLine bits (see
+   linemonitor.h).
+
+   Gap records (CAPTURE_GAP) are written when port is reopened after
+   the device went away, timestamp is when it went away and data is
+   guint64 time until it was reopened, in nanoseconds.
+
+   Index is sparse, there is an entry at least every CAPTURE_INDEX_BYTES of
+   file or CAPTURE_INDEX_INTERVAL of time, so any time offset can be found
+   by reading the trailer, bisecting the index and scanning a short stretch.
+*/
+
+#define CAPTURE_MAGIC "GUARTCAP"
+#define CAPTURE_INDEX_MAGIC "GUARTIDX"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_HEADER_SIZE 24
+#define CAPTURE_RECORD_HEADER_SIZE 16
+#define CAPTURE_TRAILER_SIZE 24
+
+#define CAPTURE_INDEX_BYTES (1024 * 1024)
+#define CAPTURE_INDEX_INTERVAL G_USEC_PER_SEC
+
+typedef enum {
+    CAPTURE_RX = 0,
+    CAPTURE_TX = 1,
+    CAPTURE_LINES = 2,
+    CAPTURE_GAP = 3,
+} CaptureRecordType;
+
+typedef struct _CaptureWriter CaptureWriter;
+
+CaptureWriter *capture_writer_new(const gchar *filename);
+CaptureWriter *capture_writer_new_at(const gchar *filename, gint64 start_time);
+void capture_writer_close(CaptureWriter *writer);
+
+void capture_writer_append(CaptureWriter *writer, CaptureRecordType type,
+                           gint64 timestamp, const guint8 *data, gsize len);
+gsize capture_writer_get_dropped(CaptureWriter *writer);
+
+#endif /* CAPTURE_H */
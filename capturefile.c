@@ -0,0 +1,455 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "capture.h"
+#include "capturefile.h"
+
+/* every LINE_STRIDE-th line start is kept in the line index */
+#define LINE_STRIDE 256
+
+/*
+   For capture files a record index entry is made at least every
+   RECORD_STRIDE records or RECORD_STRIDE_BYTES of data, which bounds
+   how many record headers have to be walked to find an offset.
+*/
+#define RECORD_STRIDE 256
+#define RECORD_STRIDE_BYTES (64 * 1024)
+
+/* how often indexing thread makes its progress visible */
+#define PUBLISH_INTERVAL (1024 * 1024)
+
+typedef struct {
+    guint64 offset; /* data offset of first byte of record */
+    guint64 pos;    /* file position of record header */
+} RecordEntry;
+
+typedef struct {
+    guint64 offset;   /* data offset of next byte */
+    guint64 lines;    /* lines started so far */
+    gsize line_len;   /* bytes in current line */
+} IndexState;
+
+struct _CaptureFile {
+    GMappedFile *mapped;
+    const guint8 *data;
+    gsize length;
+    gboolean is_capture;
+    gsize records_end;  /* file position where records stop */
+
+    GThread *thread;
+    gint cancel;
+
+    GMutex lock; /* protects everything below */
+    GArray *records;    /* of RecordEntry, capture files only */
+    GArray *lines;      /* of guint64, start of every LINE_STRIDE-th line */
+    guint64 size;
+    guint64 n_lines;
+    gsize scanned;
+    gboolean indexing;
+};
+
+static guint32 read_le32(const guint8 *p)
+{
+    guint32 v;
+    memcpy(&v, p, 4);
+    return GUINT32_FROM_LE(v);
+}
+
+static guint64 read_le64(const guint8 *p)
+{
+    guint64 v;
+    memcpy(&v, p, 8);
+    return GUINT64_FROM_LE(v);
+}
+
+static void index_data(CaptureFile *cf, IndexState *st, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        gsize n, consumed;
+        const guint8 *nl;
+
+        if (st->line_len == 0)
+        {
+            if (st->lines % LINE_STRIDE == 0)
+            {
+                g_mutex_lock(&cf->lock);
+                g_array_append_val(cf->lines, st->offset);
+                g_mutex_unlock(&cf->lock);
+            }
+            st->lines++;
+        }
+
+        n = MIN(len, CAPTURE_FILE_MAX_LINE - st->line_len);
+        nl = memchr(data, '\n', n);
+        consumed = nl ? (gsize)(nl - data) + 1 : n;
+
+        st->line_len += consumed;
+        if (nl != NULL || st->line_len == CAPTURE_FILE_MAX_LINE)
+            st->line_len = 0;
+
+        st->offset += consumed;
+        data += consumed;
+        len -= consumed;
+    }
+}
+
+static void publish(CaptureFile *cf, IndexState *st, gsize scanned)
+{
+    g_mutex_lock(&cf->lock);
+    cf->size = st->offset;
+    cf->n_lines = st->lines;
+    cf->scanned = scanned;
+    g_mutex_unlock(&cf->lock);
+}
+
+static gpointer capture_file_index_thread(gpointer data)
+{
+    CaptureFile *cf = (CaptureFile*)data;
+    IndexState st = { 0, 0, 0 };
+    gsize last_publish = 0;
+
+    if (cf->is_capture)
+    {
+        gsize pos = CAPTURE_HEADER_SIZE;
+        guint64 last_entry = 0;
+        guint since_entry = RECORD_STRIDE;
+
+        while (pos + CAPTURE_RECORD_HEADER_SIZE <= cf->records_end &&
+               !g_atomic_int_get(&cf->cancel))
+        {
+            const guint8 *hdr = cf->data + pos;
+            guint32 len = read_le32(hdr + 8);
+
+            if (pos + CAPTURE_RECORD_HEADER_SIZE + len > cf->records_end)
+            {
+                /* truncated record, capture was not closed properly */
+                break;
+            }
+
+            if (hdr[12] == CAPTURE_RX)
+            {
+                if (since_entry >= RECORD_STRIDE ||
+                    st.offset - last_entry >= RECORD_STRIDE_BYTES)
+                {
+                    RecordEntry entry = { st.offset, pos };
+
+                    g_mutex_lock(&cf->lock);
+                    g_array_append_val(cf->records, entry);
+                    g_mutex_unlock(&cf->lock);
+                    last_entry = st.offset;
+                    since_entry = 0;
+                }
+                since_entry++;
+
+                index_data(cf, &st, hdr + CAPTURE_RECORD_HEADER_SIZE, len);
+            }
+
+            pos += CAPTURE_RECORD_HEADER_SIZE + len;
+            if (pos - last_publish >= PUBLISH_INTERVAL)
+            {
+                publish(cf, &st, pos);
+                last_publish = pos;
+            }
+        }
+    }
+    else
+    {
+        gsize pos = 0;
+
+        while (pos < cf->length && !g_atomic_int_get(&cf->cancel))
+        {
+            gsize len = MIN(cf->length - pos, PUBLISH_INTERVAL);
+
+            index_data(cf, &st, cf->data + pos, len);
+            pos += len;
+            publish(cf, &st, pos);
+        }
+    }
+
+    publish(cf, &st, cf->records_end);
+    g_mutex_lock(&cf->lock);
+    cf->indexing = FALSE;
+    g_mutex_unlock(&cf->lock);
+
+    return NULL;
+}
+
+/**
+ *  Maps file into memory and starts indexing it in background.
+ *
+ *  \return NULL on error
+ **/
+CaptureFile *capture_file_open(const gchar *filename)
+{
+    CaptureFile *cf;
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(filename, FALSE, &error);
+
+    if (mapped == NULL)
+    {
+        g_message("Unable to open %s: %s", filename, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    cf = g_slice_new0(CaptureFile);
+    cf->mapped = mapped;
+    cf->data = (const guint8*)g_mapped_file_get_contents(mapped);
+    cf->length = g_mapped_file_get_length(mapped);
+    cf->records_end = cf->length;
+
+    if (cf->length >= CAPTURE_HEADER_SIZE &&
+        memcmp(cf->data, CAPTURE_MAGIC, 8) == 0)
+    {
+        cf->is_capture = TRUE;
+
+        if (cf->length >= CAPTURE_HEADER_SIZE + CAPTURE_TRAILER_SIZE &&
+            memcmp(cf->data + cf->length - 8, CAPTURE_INDEX_MAGIC, 8) == 0)
+        {
+            /* properly closed capture, records end where index starts */
+            guint64 index_offset = read_le64(cf->data + cf->length - CAPTURE_TRAILER_SIZE);
+
+            if (index_offset <= cf->length - CAPTURE_TRAILER_SIZE)
+                cf->records_end = index_offset;
+        }
+    }
+
+    g_mutex_init(&cf->lock);
+    cf->records = g_array_new(FALSE, FALSE, sizeof(RecordEntry));
+    cf->lines = g_array_new(FALSE, FALSE, sizeof(guint64));
+    cf->indexing = TRUE;
+
+    cf->thread = g_thread_new("capture-index", capture_file_index_thread, cf);
+
+    return cf;
+}
+
+void capture_file_close(CaptureFile *cf)
+{
+    g_atomic_int_set(&cf->cancel, 1);
+    g_thread_join(cf->thread);
+
+    g_array_free(cf->records, TRUE);
+    g_array_free(cf->lines, TRUE);
+    g_mutex_clear(&cf->lock);
+    g_mapped_file_unref(cf->mapped);
+    g_slice_free(CaptureFile, cf);
+}
+
+gboolean capture_file_is_indexing(CaptureFile *cf)
+{
+    gboolean indexing;
+
+    g_mutex_lock(&cf->lock);
+    indexing = cf->indexing;
+    g_mutex_unlock(&cf->lock);
+
+    return indexing;
+}
+
+/**
+ *  \return indexing progress, from 0 to 1
+ **/
+gdouble capture_file_get_progress(CaptureFile *cf)
+{
+    gdouble progress;
+
+    g_mutex_lock(&cf->lock);
+    progress = cf->records_end ? (gdouble)cf->scanned / cf->records_end : 1.0;
+    g_mutex_unlock(&cf->lock);
+
+    return progress;
+}
+
+/**
+ *  \return number of data bytes indexed so far
+ **/
+guint64 capture_file_get_size(CaptureFile *cf)
+{
+    guint64 size;
+
+    g_mutex_lock(&cf->lock);
+    size = cf->size;
+    g_mutex_unlock(&cf->lock);
+
+    return size;
+}
+
+/**
+ *  \return number of lines indexed so far
+ **/
+guint64 capture_file_get_lines(CaptureFile *cf)
+{
+    guint64 lines;
+
+    g_mutex_lock(&cf->lock);
+    lines = cf->n_lines;
+    g_mutex_unlock(&cf->lock);
+
+    return lines;
+}
+
+/**
+ *  Returns pointer to data at offset, straight from the mapping. len is set
+ *  to number of contiguous bytes available there.
+ *
+ *  \return NULL if offset is not (yet) indexed
+ **/
+const guint8 *capture_file_peek(CaptureFile *cf, guint64 offset, gsize *len)
+{
+    RecordEntry entry;
+    guint64 size;
+    guint lo, hi;
+
+    g_mutex_lock(&cf->lock);
+    size = cf->size;
+    if (offset >= size)
+    {
+        g_mutex_unlock(&cf->lock);
+        *len = 0;
+        return NULL;
+    }
+
+    if (!cf->is_capture)
+    {
+        g_mutex_unlock(&cf->lock);
+        *len = size - offset;
+        return cf->data + offset;
+    }
+
+    /* last record entry with entry.offset <= offset */
+    lo = 0;
+    hi = cf->records->len;
+    while (hi - lo > 1)
+    {
+        guint mid = (lo + hi) / 2;
+
+        if (g_array_index(cf->records, RecordEntry, mid).offset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    entry = g_array_index(cf->records, RecordEntry, lo);
+    g_mutex_unlock(&cf->lock);
+
+    for (;;)
+    {
+        const guint8 *hdr = cf->data + entry.pos;
+        guint32 rec_len = read_le32(hdr + 8);
+
+        if (hdr[12] == CAPTURE_RX)
+        {
+            if (offset < entry.offset + rec_len)
+            {
+                *len = entry.offset + rec_len - offset;
+                return hdr + CAPTURE_RECORD_HEADER_SIZE + (offset - entry.offset);
+            }
+            entry.offset += rec_len;
+        }
+        entry.pos += CAPTURE_RECORD_HEADER_SIZE + rec_len;
+    }
+}
+
+gsize capture_file_read(CaptureFile *cf, guint64 offset, guint8 *buf, gsize len)
+{
+    gsize copied = 0;
+
+    while (copied < len)
+    {
+        gsize avail;
+        const guint8 *ptr = capture_file_peek(cf, offset + copied, &avail);
+
+        if (ptr == NULL)
+            break;
+
+        avail = MIN(avail, len - copied);
+        memcpy(buf + copied, ptr, avail);
+        copied += avail;
+    }
+
+    return copied;
+}
+
+/**
+ *  Copies line starting at offset into buf, which must hold
+ *  CAPTURE_FILE_MAX_LINE bytes. Line terminator is not copied.
+ *  Offset of the following line is stored in next.
+ *
+ *  \return number of bytes copied
+ **/
+gsize capture_file_read_line(CaptureFile *cf, guint64 offset, guint8 *buf,
+                             guint64 *next)
+{
+    gsize copied = 0;
+
+    *next = offset;
+    while (copied < CAPTURE_FILE_MAX_LINE)
+    {
+        gsize avail;
+        const guint8 *ptr = capture_file_peek(cf, *next, &avail);
+        const guint8 *nl;
+
+        if (ptr == NULL)
+            break;
+
+        avail = MIN(avail, CAPTURE_FILE_MAX_LINE - copied);
+        nl = memchr(ptr, '\n', avail);
+        if (nl != NULL)
+        {
+            memcpy(buf + copied, ptr, nl - ptr);
+            copied += nl - ptr;
+            *next += nl - ptr + 1;
+            break;
+        }
+
+        memcpy(buf + copied, ptr, avail);
+        copied += avail;
+        *next += avail;
+    }
+
+    return copied;
+}
+
+/**
+ *  \return data offset at which given line starts
+ **/
+guint64 capture_file_get_line_offset(CaptureFile *cf, guint64 line)
+{
+    guint8 buf[CAPTURE_FILE_MAX_LINE];
+    guint64 offset;
+    guint64 skip = line % LINE_STRIDE;
+    guint64 entry = line / LINE_STRIDE;
+
+    g_mutex_lock(&cf->lock);
+    if (entry >= cf->lines->len)
+    {
+        offset = cf->size;
+        skip = 0;
+    }
+    else
+    {
+        offset = g_array_index(cf->lines, guint64, entry);
+    }
+    g_mutex_unlock(&cf->lock);
+
+    while (skip-- > 0)
+        capture_file_read_line(cf, offset, buf, &offset);
+
+    return offset;
+}
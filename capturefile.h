@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <glib.h>
+
+/**
+ *  Read-only, memory mapped access to received data stored in a capture
+ *  file (see capture.h) or in any other file, which is then shown as is.
+ *  For capture files the data is the concatenation of all RX records.
+ *
+ *  Record and line indexes are built by a background thread; sizes and
+ *  line counts grow while it runs. Lines end after '\n' or after
+ *  CAPTURE_FILE_MAX_LINE bytes, whichever comes first.
+ **/
+typedef struct _CaptureFile CaptureFile;
+
+#define CAPTURE_FILE_MAX_LINE 4096
+
+CaptureFile *capture_file_open(const gchar *filename);
+void capture_file_close(CaptureFile *cf);
+
+gboolean capture_file_is_indexing(CaptureFile *cf);
+gdouble capture_file_get_progress(CaptureFile *cf);
+
+guint64 capture_file_get_size(CaptureFile *cf);
+guint64 capture_file_get_lines(CaptureFile *cf);
+guint64 capture_file_get_line_offset(CaptureFile *cf, guint64 line);
+
+const guint8 *capture_file_peek(CaptureFile *cf, guint64 offset, gsize *len);
+gsize capture_file_read(CaptureFile *cf, guint64 offset, guint8 *buf, gsize len);
+gsize capture_file_read_line(CaptureFile *cf, guint64 offset, guint8 *buf,
+                             guint64 *next);
+
+#endif /* CAPTUREFILE_H */
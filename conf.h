@@ -18,23 +18,6 @@
 #define CONF_H
 
 #include <glib.h>
-#include <glib-object.h>
-#include <gtk/gtk.h>
-
-typedef enum {
-    GUART_B150 = 0,
-    GUART_B300,
-    GUART_B600,
-    GUART_B1200,
-    GUART_B1800,
-    GUART_B2400,
-    GUART_B4800,
-    GUART_B9600,
-    GUART_B19200,
-    GUART_B38400,
-    GUART_B57600,
-    GUART_B115200,
-} BaudRate;
 
 typedef enum {
     GUART_BITS5 = 0,
@@ -61,20 +44,44 @@ typedef enum {
     GUART_FLOW_XONXOFF,
 } FlowControl;
 
+typedef enum {
+    GUART_SCROLLBACK_LINES = 0,
+    GUART_SCROLLBACK_BYTES,
+} ScrollbackUnit;
+
 typedef struct {
     gchar *port;
-    BaudRate rate;
+    guint rate; /* in bits per second, any value the port supports */
     DataBits databits;
     Parity parity;
     StopBits stopbits;
     FlowControl flow;
     gchar *terminator;
     gint n_terminator_chars;
+    guint display_latency; /* max time in ms received data is held before display */
+    guint scrollback_limit; /* 0 means unlimited */
+    ScrollbackUnit scrollback_unit;
+    gboolean low_latency; /* tune driver and wakeups for request/response traffic */
+    gboolean auto_reconnect; /* reopen port when its device comes back */
 } Configuration;
 
+/* common baudrates offered in configuration dialog */
+extern gchar *baud_labels[];
+extern const guint n_baud_labels;
+
+/* labels, in order of respective enums */
+extern gchar *databits_labels[];
+extern const guint n_databits_labels;
+extern gchar *parity_labels[];
+extern const guint n_parity_labels;
+extern gchar *stopbits_labels[];
+extern const guint n_stopbits_labels;
+extern gchar *flow_labels[];
+extern const guint n_flow_labels;
+
 Configuration *configuration_new();
 void configuration_free(Configuration *conf);
-gboolean configure(GtkWidget *parent, Configuration *cfg);
+void configuration_copy(Configuration *dest, Configuration *src);
 gchar *get_configuration_string(Configuration *cfg);
 
 #endif /* CONF_H */
@@ -0,0 +1,394 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+#include "conf.h"
+#include "confdialog.h"
+#include "autobaud.h"
+
+static gchar *port_labels[] = {
+    "/dev/ttyS0",
+    "/dev/ttyS1",
+    "/dev/ttyS2",
+    "/dev/ttyS3",
+};
+
+static gchar *terminator_labels[] = {
+    "None",
+    "LF",
+    "CR",
+    "CR LF",
+    "Custom",
+};
+
+/**
+ * Scrollback unit labels, order must match ScrollbackUnit enum
+ **/
+static gchar *scrollback_labels[] = {
+    "Lines",
+    "Bytes",
+};
+
+static void fill_combo_box(GtkWidget *cbox, gchar** strings, gint n)
+{
+    int i;
+    for (i=0; i<n; i++)
+    {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cbox), strings[i]);
+    }
+}
+
+static void add_to_table(GtkWidget *table, gint i, gchar *label, GtkWidget *widget)
+{
+    GtkWidget *lbl = gtk_label_new(label);
+    gtk_table_attach_defaults(GTK_TABLE(table), lbl, 0, 1, i, i+1);
+    gtk_table_attach_defaults(GTK_TABLE(table), widget, 1, 2, i, i+1);
+}
+
+static void add_to_box(GtkWidget *box, gchar *label, GtkWidget *widget)
+{
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    GtkWidget *lbl = gtk_label_new(label);
+
+    gtk_box_set_homogeneous(GTK_BOX(hbox), FALSE);
+
+    gtk_box_pack_start(GTK_BOX(hbox), lbl, TRUE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), widget, TRUE, TRUE, 0);
+
+    gtk_box_pack_start(GTK_BOX(box), hbox, FALSE, FALSE, 0);
+}
+
+void combo_box_changed_cb(GtkComboBox *widget, gint *data)
+{
+    *data = gtk_combo_box_get_active(widget);
+}
+
+void spin_button_changed_cb(GtkSpinButton *widget, guint *data)
+{
+    *data = gtk_spin_button_get_value_as_int(widget);
+}
+
+void toggle_button_changed_cb(GtkToggleButton *widget, gboolean *data)
+{
+    *data = gtk_toggle_button_get_active(widget);
+}
+
+void terminator_changed_cb(GtkComboBox *widget, Configuration *cfg)
+{
+    gint n = gtk_combo_box_get_active(widget);
+
+    if (cfg->terminator)
+    {
+        g_free(cfg->terminator);
+        cfg->terminator = NULL;
+        cfg->n_terminator_chars = 0;
+    }
+
+    switch (n)
+    {
+        /* see terminator_labels */
+        case 0: /* None */
+            /* already cleared terminator and n_terminator_chars */
+            break;
+        case 1: /* LF */
+            cfg->terminator = g_strdup_printf("%c", 0x0A);
+            cfg->n_terminator_chars = 1;
+            break;
+        case 2: /* CR */
+            cfg->terminator = g_strdup_printf("%c", 0x0D);
+            cfg->n_terminator_chars = 1;
+            break;
+        case 3: /* CR LF */
+            cfg->terminator = g_strdup_printf("%c%c", 0x0D, 0x0A);
+            cfg->n_terminator_chars = 2;
+            break;
+        case 4: /* Custom */
+            /* TODO */
+            break;
+        default:
+            break;
+    }
+}
+
+static void set_terminator_combo_box(GtkWidget *cbox_terminator, Configuration *cfg)
+{
+    switch (cfg->n_terminator_chars)
+    {
+        case 0:
+            /* None */
+            gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 0);
+            break;
+        case 1:
+            if (cfg->terminator[0] == 0x0A) /* LF */
+            {
+                gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 1);
+            }
+            else if (cfg->terminator[0] == 0x0D) /* CR */
+            {
+                gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 2);
+            }
+            else
+            {
+                /* custom terminator */
+                gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 4);
+            }
+            break;
+        case 2:
+            if (cfg->terminator[0] == 0x0D && cfg->terminator[1] == 0x0A)
+            {
+                /* CR LF */
+                gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 3);
+            }
+            else
+            {
+                /* custom terminator */
+                gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 4);
+            }
+            break;
+        default:
+            /* custom terminator */
+            gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_terminator), 4);
+            break;
+    }
+}
+
+static void auto_baud_done_cb(AutoBaud *ab, gpointer data)
+{
+    GObject *cfg_table = G_OBJECT(data);
+    GtkWidget *button = g_object_get_data(cfg_table, "autodetect");
+    AutoBaudCandidate best;
+
+    if (auto_baud_get_result(ab, &best))
+    {
+        GtkWidget *cbox_baudrate = g_object_get_data(cfg_table, "baudrate");
+        gchar *rate = g_strdup_printf("%u", best.rate);
+
+        gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_baudrate))), rate);
+        g_free(rate);
+        gtk_combo_box_set_active(g_object_get_data(cfg_table, "databits"), best.databits);
+        gtk_combo_box_set_active(g_object_get_data(cfg_table, "parity"), best.parity);
+        gtk_combo_box_set_active(g_object_get_data(cfg_table, "stopbits"), best.stopbits);
+    }
+    else
+    {
+        g_message("No baudrate and format gave plausible data, is anything sending?");
+    }
+
+    /* frees detection, which restores and closes port */
+    g_object_set_data(cfg_table, "autobaud", NULL);
+    gtk_button_set_label(GTK_BUTTON(button), "Auto-detect");
+    gtk_widget_set_sensitive(button, TRUE);
+}
+
+static void auto_baud_button_cb(GtkButton *button, gpointer data)
+{
+    GObject *cfg_table = G_OBJECT(data);
+    GtkWidget *cbox_port = g_object_get_data(cfg_table, "port");
+    const gchar *port = gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_port))));
+    AutoBaud *ab;
+
+    ab = auto_baud_new(port, auto_baud_done_cb, cfg_table);
+    if (ab == NULL)
+        return;
+
+    /* detection is cancelled if dialog is closed first */
+    g_object_set_data_full(cfg_table, "autobaud", ab, (GDestroyNotify)auto_baud_free);
+    gtk_button_set_label(button, "Detecting...");
+    gtk_widget_set_sensitive(GTK_WIDGET(button), FALSE);
+}
+
+static GtkWidget *create_configuration_table(Configuration *cfg)
+{
+    GtkWidget *cfg_table;
+    GtkWidget *cbox_port, *cbox_baudrate, *vbox_format, *cbox_terminator, *cbox_flow;
+    GtkWidget *hbox_baudrate, *btn_autodetect;
+    GtkWidget *cbox_databits, *cbox_parity, *cbox_stopbits;
+    GtkWidget *spin_latency;
+    GtkWidget *hbox_scrollback, *spin_scrollback, *cbox_scrollback;
+    GtkWidget *hbox_connection, *check_low_latency, *check_reconnect;
+    gchar *rate;
+
+    cfg_table = gtk_table_new(8, 2, FALSE);
+
+    cbox_port = gtk_combo_box_text_new_with_entry();
+    fill_combo_box(cbox_port, port_labels, G_N_ELEMENTS(port_labels));
+    gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_port))),
+                       cfg->port);
+    g_object_set_data(G_OBJECT(cfg_table), "port", cbox_port);
+
+    cbox_baudrate = gtk_combo_box_text_new_with_entry();
+    fill_combo_box(cbox_baudrate, baud_labels, n_baud_labels);
+    rate = g_strdup_printf("%u", cfg->rate);
+    gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_baudrate))), rate);
+    g_free(rate);
+    g_object_set_data(G_OBJECT(cfg_table), "baudrate", cbox_baudrate);
+
+    hbox_baudrate = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_baudrate), FALSE);
+    btn_autodetect = gtk_button_new_with_label("Auto-detect");
+    gtk_widget_set_tooltip_text(btn_autodetect,
+                                "Sample traffic on port at each baudrate and format, pick the most plausible");
+    gtk_box_pack_start(GTK_BOX(hbox_baudrate), cbox_baudrate, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_baudrate), btn_autodetect, FALSE, FALSE, 0);
+    g_object_set_data(G_OBJECT(cfg_table), "autodetect", btn_autodetect);
+
+    vbox_format = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(vbox_format), FALSE);
+
+    cbox_databits = gtk_combo_box_text_new();
+    fill_combo_box(cbox_databits, databits_labels, n_databits_labels);
+    cbox_parity = gtk_combo_box_text_new();
+    fill_combo_box(cbox_parity, parity_labels, n_parity_labels);
+    cbox_stopbits = gtk_combo_box_text_new();
+    fill_combo_box(cbox_stopbits, stopbits_labels, n_stopbits_labels);
+    add_to_box(vbox_format, "Data bits:", cbox_databits);
+    add_to_box(vbox_format, "Parity:", cbox_parity);
+    add_to_box(vbox_format, "Stop bits:", cbox_stopbits);
+    g_object_set_data(G_OBJECT(cfg_table), "databits", cbox_databits);
+    g_object_set_data(G_OBJECT(cfg_table), "parity", cbox_parity);
+    g_object_set_data(G_OBJECT(cfg_table), "stopbits", cbox_stopbits);
+
+    cbox_terminator = gtk_combo_box_text_new();
+    fill_combo_box(cbox_terminator, terminator_labels, G_N_ELEMENTS(terminator_labels));
+    set_terminator_combo_box(cbox_terminator, cfg);
+
+    cbox_flow = gtk_combo_box_text_new();
+    fill_combo_box(cbox_flow, flow_labels, n_flow_labels);
+
+    spin_latency = gtk_spin_button_new_with_range(0, 1000, 10);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_latency), cfg->display_latency);
+
+    hbox_scrollback = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_scrollback), FALSE);
+    spin_scrollback = gtk_spin_button_new_with_range(0, G_MAXINT, 1000);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_scrollback), cfg->scrollback_limit);
+    cbox_scrollback = gtk_combo_box_text_new();
+    fill_combo_box(cbox_scrollback, scrollback_labels, G_N_ELEMENTS(scrollback_labels));
+    gtk_box_pack_start(GTK_BOX(hbox_scrollback), spin_scrollback, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_scrollback), cbox_scrollback, FALSE, FALSE, 0);
+
+    check_low_latency = gtk_check_button_new_with_label("Low latency");
+    gtk_widget_set_tooltip_text(check_low_latency,
+                                "Lower driver latency timer and deliver received data right away");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_low_latency), cfg->low_latency);
+
+    check_reconnect = gtk_check_button_new_with_label("Reconnect");
+    gtk_widget_set_tooltip_text(check_reconnect,
+                                "Reopen port when its device is plugged in again, keeping received data and capture");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_reconnect), cfg->auto_reconnect);
+
+    hbox_connection = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_connection), FALSE);
+    gtk_box_pack_start(GTK_BOX(hbox_connection), check_low_latency, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_connection), check_reconnect, FALSE, FALSE, 0);
+
+    add_to_table(cfg_table, 0, "Port:", cbox_port);
+    add_to_table(cfg_table, 1, "Baudrate:", hbox_baudrate);
+    add_to_table(cfg_table, 2, "Format:", vbox_format);
+    add_to_table(cfg_table, 3, "Terminator:", cbox_terminator);
+    add_to_table(cfg_table, 4, "Flow control:", cbox_flow);
+    add_to_table(cfg_table, 5, "Display latency (ms):", spin_latency);
+    add_to_table(cfg_table, 6, "Scrollback (0 = unlimited):", hbox_scrollback);
+    add_to_table(cfg_table, 7, "Connection:", hbox_connection);
+
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_databits), cfg->databits);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_parity), cfg->parity);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_stopbits), cfg->stopbits);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_flow), cfg->flow);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_scrollback), cfg->scrollback_unit);
+
+    g_signal_connect(G_OBJECT(cbox_databits), "changed", G_CALLBACK(combo_box_changed_cb), &cfg->databits);
+    g_signal_connect(G_OBJECT(cbox_parity), "changed", G_CALLBACK(combo_box_changed_cb), &cfg->parity);
+    g_signal_connect(G_OBJECT(cbox_stopbits), "changed", G_CALLBACK(combo_box_changed_cb), &cfg->stopbits);
+    g_signal_connect(G_OBJECT(cbox_flow), "changed", G_CALLBACK(combo_box_changed_cb), &cfg->flow);
+    g_signal_connect(G_OBJECT(cbox_scrollback), "changed", G_CALLBACK(combo_box_changed_cb), &cfg->scrollback_unit);
+
+    g_signal_connect(G_OBJECT(cbox_terminator), "changed", G_CALLBACK(terminator_changed_cb), cfg);
+    g_signal_connect(G_OBJECT(spin_latency), "value-changed", G_CALLBACK(spin_button_changed_cb), &cfg->display_latency);
+    g_signal_connect(G_OBJECT(spin_scrollback), "value-changed", G_CALLBACK(spin_button_changed_cb), &cfg->scrollback_limit);
+    g_signal_connect(G_OBJECT(check_low_latency), "toggled", G_CALLBACK(toggle_button_changed_cb), &cfg->low_latency);
+    g_signal_connect(G_OBJECT(check_reconnect), "toggled", G_CALLBACK(toggle_button_changed_cb), &cfg->auto_reconnect);
+    g_signal_connect(G_OBJECT(btn_autodetect), "clicked", G_CALLBACK(auto_baud_button_cb), cfg_table);
+
+    gtk_widget_show_all(cfg_table);
+
+    return cfg_table;
+}
+
+/**
+ *  Shows configuration dialog for cfg, which is updated if user accepts.
+ *
+ *  \return TRUE if cfg was changed
+ **/
+gboolean configure(GtkWidget *parent, Configuration *cfg)
+{
+    GtkWidget *dialog;
+    GtkWidget *cfg_table;
+    GtkWidget *cbox_port, *cbox_baudrate;
+    Configuration *cfg_new;
+    const gchar *rate;
+    gchar *end;
+    guint64 value;
+
+    cfg_new = configuration_new();
+    configuration_copy(cfg_new, cfg);
+
+    dialog = gtk_dialog_new_with_buttons("GUART configuration",
+                                         GTK_WINDOW(parent),
+                                         GTK_DIALOG_MODAL,
+                                         GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+                                         GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT,
+                                         NULL);
+
+    cfg_table = create_configuration_table(cfg_new);
+
+    gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))),
+                       cfg_table, TRUE, TRUE, 0);
+
+    gint result = gtk_dialog_run(GTK_DIALOG(dialog));
+
+    cbox_port = GTK_WIDGET(g_object_get_data(G_OBJECT(cfg_table), "port"));
+    if (cfg_new->port != NULL)
+        g_free(cfg_new->port);
+    cfg_new->port = g_strdup(gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_port)))));
+
+    cbox_baudrate = GTK_WIDGET(g_object_get_data(G_OBJECT(cfg_table), "baudrate"));
+    rate = gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(cbox_baudrate))));
+    value = g_ascii_strtoull(rate, &end, 10);
+    if (*rate == '\0' || *end != '\0' || value == 0 || value > G_MAXUINT)
+        g_message("Invalid baudrate %s, keeping %u", rate, cfg_new->rate);
+    else
+        cfg_new->rate = value;
+
+    gtk_widget_destroy(dialog);
+
+    switch (result)
+    {
+        case GTK_RESPONSE_ACCEPT:
+            g_free(cfg->port);
+            g_free(cfg->terminator);
+            configuration_copy(cfg, cfg_new);
+            configuration_free(cfg_new);
+            return TRUE;
+        case GTK_RESPONSE_REJECT:
+        default:
+            configuration_free(cfg_new);
+            return FALSE;
+    }
+}
+
@@ -0,0 +1,36 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <glib.h>
+
+/**
+ *  Table driven CRC-16 variants used by framed protocols, both reflected
+ *  with initial value 0xFFFF. Start with CRC16_INIT and pass the previous
+ *  result to continue over data split into pieces.
+ **/
+#define CRC16_INIT 0xFFFF
+
+/* X.25 / HDLC FCS over data followed by its FCS, low byte first */
+#define CRC16_X25_GOOD 0xF0B8
+
+guint16 crc16_x25(guint16 crc, const guint8 *data, gsize len);
+guint16 crc16_modbus(guint16 crc, const guint8 *data, gsize len);
+
+#endif /* CRC_H */
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include "decoder.h"
+#include "protocols.h"
+
+/* see FrameStatus */
+gchar *frame_status_labels[] = {"OK", "-", "Bad check", "Malformed"};
+
+struct _FrameDecoder {
+    const FrameProtocol *protocol;
+    gpointer state;
+    guint baudrate;
+
+    GArray *frames; /* of Frame */
+    guint64 errors;
+};
+
+static GPtrArray *protocols;
+
+static void frame_protocols_init(void)
+{
+    if (protocols != NULL)
+        return;
+
+    protocols = g_ptr_array_new();
+    g_ptr_array_add(protocols, (gpointer)&slip_protocol);
+    g_ptr_array_add(protocols, (gpointer)&cobs_protocol);
+    g_ptr_array_add(protocols, (gpointer)&hdlc_protocol);
+    g_ptr_array_add(protocols, (gpointer)&modbus_rtu_protocol);
+}
+
+/**
+ *  Makes protocol available next to the built-in ones (see protocols.h).
+ *  protocol must stay valid as long as the program runs.
+ **/
+void frame_protocol_register(const FrameProtocol *protocol)
+{
+    frame_protocols_init();
+    g_ptr_array_add(protocols, (gpointer)protocol);
+}
+
+guint frame_protocol_count(void)
+{
+    frame_protocols_init();
+    return protocols->len;
+}
+
+const FrameProtocol *frame_protocol_get(guint n)
+{
+    frame_protocols_init();
+    return g_ptr_array_index(protocols, n);
+}
+
+FrameDecoder *frame_decoder_new(const FrameProtocol *protocol)
+{
+    FrameDecoder *decoder = g_slice_new0(FrameDecoder);
+
+    decoder->protocol = protocol;
+    decoder->state = protocol->state_new();
+    decoder->frames = g_array_new(FALSE, FALSE, sizeof(Frame));
+
+    return decoder;
+}
+
+void frame_decoder_free(FrameDecoder *decoder)
+{
+    decoder->protocol->state_free(decoder->state);
+    g_array_free(decoder->frames, TRUE);
+    g_slice_free(FrameDecoder, decoder);
+}
+
+const FrameProtocol *frame_decoder_get_protocol(FrameDecoder *decoder)
+{
+    return decoder->protocol;
+}
+
+/**
+ *  Sets line speed, for protocols framed by silence.
+ **/
+void frame_decoder_set_baudrate(FrameDecoder *decoder, guint baudrate)
+{
+    decoder->baudrate = baudrate;
+}
+
+/**
+ *  \return line speed, 0 if unknown
+ **/
+guint frame_decoder_get_baudrate(FrameDecoder *decoder)
+{
+    return decoder->baudrate;
+}
+
+/**
+ *  Decodes data received at arrival; data[0] is at offset in the receive
+ *  store and must directly follow data fed before.
+ **/
+void frame_decoder_feed(FrameDecoder *decoder, const guint8 *data, gsize len,
+                        guint64 offset, gint64 arrival)
+{
+    if (len > 0)
+        decoder->protocol->feed(decoder, decoder->state, data, len, offset, arrival);
+}
+
+/**
+ *  Called by protocols for each complete frame made of raw bytes
+ *  [start, end) with given payload length.
+ **/
+void frame_decoder_emit(FrameDecoder *decoder, guint64 start, guint64 end,
+                        gsize payload, gint64 time, FrameStatus status)
+{
+    Frame frame;
+
+    frame.offset = start;
+    frame.len = MIN(end - start, G_MAXUINT32);
+    frame.payload = MIN(payload, G_MAXUINT32);
+    frame.time = time;
+    frame.status = status;
+    g_array_append_val(decoder->frames, frame);
+
+    if (status == FRAME_BAD_CHECK || status == FRAME_MALFORMED)
+        decoder->errors++;
+}
+
+guint64 frame_decoder_get_count(FrameDecoder *decoder)
+{
+    return decoder->frames->len;
+}
+
+/**
+ *  \return number of frames with bad check or malformed
+ **/
+guint64 frame_decoder_get_errors(FrameDecoder *decoder)
+{
+    return decoder->errors;
+}
+
+/**
+ *  \return frame n, which must be < frame_decoder_get_count()
+ **/
+const Frame *frame_decoder_get_frame(FrameDecoder *decoder, guint64 n)
+{
+    return &g_array_index(decoder->frames, Frame, n);
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <glib.h>
+
+/**
+ *  Splits received byte stream into frames of a framed protocol. Frames
+ *  are not copied: each one refers to its raw bytes by offset in the
+ *  receive store (see bytestore.h), payload is unescaped on demand with
+ *  the protocol's decode().
+ **/
+typedef struct _FrameDecoder FrameDecoder;
+
+typedef enum {
+    FRAME_OK,        /* check passed */
+    FRAME_NO_CHECK,  /* protocol has no check */
+    FRAME_BAD_CHECK,
+    FRAME_MALFORMED, /* invalid escape, truncated, too long... */
+} FrameStatus;
+
+extern gchar *frame_status_labels[];
+
+typedef struct {
+    guint64 offset;  /* of first raw byte, delimiters excluded */
+    guint32 len;     /* raw bytes */
+    guint32 payload; /* bytes after unescaping, check excluded */
+    gint64 time;     /* arrival of first byte, monotonic */
+    FrameStatus status;
+} Frame;
+
+/**
+ *  A protocol. State is created for each decoder. feed() gets data in
+ *  stream order, data[0] being at offset, and reports every complete
+ *  frame with frame_decoder_emit(). decode() unescapes raw frame bytes
+ *  into payload, which has room for len bytes, and returns payload
+ *  length, check included.
+ **/
+typedef struct {
+    const gchar *name;
+    gpointer (*state_new)(void);
+    void (*state_free)(gpointer state);
+    void (*feed)(FrameDecoder *decoder, gpointer state, const guint8 *data,
+                 gsize len, guint64 offset, gint64 arrival);
+    gsize (*decode)(const guint8 *raw, gsize len, guint8 *payload);
+} FrameProtocol;
+
+void frame_protocol_register(const FrameProtocol *protocol);
+guint frame_protocol_count(void);
+const FrameProtocol *frame_protocol_get(guint n);
+
+FrameDecoder *frame_decoder_new(const FrameProtocol *protocol);
+void frame_decoder_free(FrameDecoder *decoder);
+const FrameProtocol *frame_decoder_get_protocol(FrameDecoder *decoder);
+
+void frame_decoder_set_baudrate(FrameDecoder *decoder, guint baudrate);
+guint frame_decoder_get_baudrate(FrameDecoder *decoder);
+
+void frame_decoder_feed(FrameDecoder *decoder, const guint8 *data, gsize len,
+                        guint64 offset, gint64 arrival);
+void frame_decoder_emit(FrameDecoder *decoder, guint64 start, guint64 end,
+                        gsize payload, gint64 time, FrameStatus status);
+
+guint64 frame_decoder_get_count(FrameDecoder *decoder);
+guint64 frame_decoder_get_errors(FrameDecoder *decoder);
+const Frame *frame_decoder_get_frame(FrameDecoder *decoder, guint64 n);
+
+#endif /* DECODER_H */
@@ -0,0 +1,734 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "display.h"
+#include "sanitizer.h"
+
+/*
+   Frame clock does not tick while the view is unmapped (e.g. other notebook
+   page is shown or window is minimized), so pending data is also flushed
+   from a timeout this long after the configured latency expired.
+*/
+#define DISPLAY_FALLBACK_MS 100
+
+/*
+   Scrollback is kept as a queue of chunks, each holding about
+   limit / SCROLLBACK_CHUNKS of data. Only whole chunks are evicted, so
+   trimming costs the same no matter how much scrollback is kept.
+*/
+#define SCROLLBACK_CHUNKS 8
+
+/* view counts as scrolled to the end this close to it, in pixels */
+#define FOLLOW_SLACK 4
+
+#define TIMESTAMP_PADDING 4
+
+typedef struct {
+    GtkTextMark *end; /* NULL for the chunk still being filled */
+    gsize bytes;
+    gsize lines;
+    guint64 raw_end;  /* received bytes shown up to end, once sealed */
+} ScrollbackChunk;
+
+struct _Display {
+    GtkTextView *view;
+    GtkTextBuffer *buffer;
+    GtkTextMark *end_mark;
+    GtkTextMark *goto_mark;
+    gboolean follow;      /* view is at the end, keep it there */
+
+    GByteArray *pending;  /* raw received bytes */
+    GArray *breaks;       /* of guint, pending lengths at which lines end */
+    GByteArray *text;     /* pending bytes made valid UTF-8, reused */
+    Utf8Sanitizer *sanitizer;
+    gint64 pending_since; /* monotonic time of oldest pending byte */
+    gint64 latency;       /* in microseconds */
+    guint64 flushed;      /* received bytes passed to text buffer so far */
+    guint64 flushes;
+    gint64 lag_last, lag_max, lag_sum;
+
+    guint tick_id;
+    guint timeout_id;
+
+    /*
+       With line index set, text buffer holds exactly one line for each
+       indexed line: CR and LF from data are dropped and '\n' is inserted
+       where index found terminator. first_line is number of indexed
+       lines evicted by scrollback. first_shown is offset of the first
+       received byte still in text buffer, first line may start after
+       its indexed start.
+    */
+    LineIndex *lines;
+    guint64 first_line;
+    guint64 first_shown;
+    DisplayTimestamps timestamps;
+    gint timestamp_width;
+
+    GtkTextTag *match_tag;
+    GtkTextTag *current_tag; /* created later, so it takes precedence */
+
+    /*
+       Characters counted up to the last located byte. Matches come in
+       order, so the next one on the same line is counted on from there
+       instead of from line start.
+    */
+    Utf8Sanitizer *col_sanitizer;
+    guint64 col_start;  /* offset counting started at */
+    guint64 col_offset; /* bytes before it are counted */
+    gint col_chars;
+
+    GQueue chunks;     /* of ScrollbackChunk, oldest first */
+    gsize total_bytes;
+    gsize total_lines;
+    gsize limit;       /* 0 means unlimited */
+    ScrollbackUnit unit;
+};
+
+static gsize count_lines(const guint8 *data, gsize len)
+{
+    const guint8 *end = data + len;
+    gsize lines = 0;
+
+    if (len == 0)
+        return 0;
+
+    while ((data = memchr(data, '\n', end - data)) != NULL)
+    {
+        lines++;
+        data++;
+    }
+
+    return lines;
+}
+
+static gsize chunk_size(ScrollbackChunk *chunk, ScrollbackUnit unit)
+{
+    return (unit == GUART_SCROLLBACK_BYTES) ? chunk->bytes : chunk->lines;
+}
+
+/**
+ *  Accounts newly inserted text to the last chunk and seals it when full.
+ **/
+static void scrollback_add(Display *display, const guint8 *data, gsize len)
+{
+    ScrollbackChunk *chunk = g_queue_peek_tail(&display->chunks);
+    gsize lines = count_lines(data, len);
+    gsize chunk_limit = MAX(display->limit / SCROLLBACK_CHUNKS, 1);
+
+    chunk->bytes += len;
+    chunk->lines += lines;
+    display->total_bytes += len;
+    display->total_lines += lines;
+
+    if (display->limit != 0 && chunk_size(chunk, display->unit) >= chunk_limit)
+    {
+        GtkTextIter end;
+
+        /* left gravity, so the mark stays before text appended later */
+        gtk_text_buffer_get_end_iter(display->buffer, &end);
+        chunk->end = gtk_text_buffer_create_mark(display->buffer, NULL, &end, TRUE);
+        /* bytes held back by sanitizer are shown in the next chunk */
+        chunk->raw_end = display->flushed - utf8_sanitizer_get_held(display->sanitizer);
+
+        g_queue_push_tail(&display->chunks, g_slice_new0(ScrollbackChunk));
+    }
+}
+
+/**
+ *  Evicts oldest chunks as long as the rest still satisfies the limit.
+ **/
+static void scrollback_trim(Display *display)
+{
+    ScrollbackChunk *chunk;
+    GtkTextIter start, end;
+    GtkTextMark *last = NULL;
+
+    if (display->limit == 0)
+        return;
+
+    while ((chunk = g_queue_peek_head(&display->chunks))->end != NULL)
+    {
+        gsize total = (display->unit == GUART_SCROLLBACK_BYTES) ?
+                      display->total_bytes : display->total_lines;
+
+        if (total - chunk_size(chunk, display->unit) < display->limit)
+            break;
+
+        display->total_bytes -= chunk->bytes;
+        display->total_lines -= chunk->lines;
+        display->first_line += chunk->lines;
+        display->first_shown = chunk->raw_end;
+
+        if (last != NULL)
+            gtk_text_buffer_delete_mark(display->buffer, last);
+        last = chunk->end;
+
+        g_queue_pop_head(&display->chunks);
+        g_slice_free(ScrollbackChunk, chunk);
+    }
+
+    if (last != NULL)
+    {
+        /* single delete for all evicted chunks */
+        gtk_text_buffer_get_start_iter(display->buffer, &start);
+        gtk_text_buffer_get_iter_at_mark(display->buffer, &end, last);
+        gtk_text_buffer_delete(display->buffer, &start, &end);
+        gtk_text_buffer_delete_mark(display->buffer, last);
+    }
+}
+
+static void display_cancel_flush(Display *display)
+{
+    if (display->tick_id != 0)
+    {
+        gtk_widget_remove_tick_callback(GTK_WIDGET(display->view), display->tick_id);
+        display->tick_id = 0;
+    }
+
+    if (display->timeout_id != 0)
+    {
+        g_source_remove(display->timeout_id);
+        display->timeout_id = 0;
+    }
+}
+
+static gboolean display_tick_cb(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    Display *display = (Display*)data;
+    gint64 now = gdk_frame_clock_get_frame_time(clock);
+
+    if (now - display->pending_since < display->latency)
+    {
+        /* keep batching until latency expires */
+        return G_SOURCE_CONTINUE;
+    }
+
+    display->tick_id = 0;
+    display_flush(display);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean display_timeout_cb(gpointer data)
+{
+    Display *display = (Display*)data;
+
+    display->timeout_id = 0;
+    display_flush(display);
+
+    return FALSE;
+}
+
+static void display_value_changed_cb(GtkAdjustment *adj, Display *display)
+{
+    display->follow = gtk_adjustment_get_value(adj) + gtk_adjustment_get_page_size(adj) +
+                      FOLLOW_SLACK >= gtk_adjustment_get_upper(adj);
+}
+
+/**
+ *  \return new description of the font received data is shown in by all
+ *  views, free with pango_font_description_free()
+ **/
+PangoFontDescription *display_font_new(void)
+{
+    /* TODO: make this configurable */
+    return pango_font_description_from_string("Monospace 10");
+}
+
+/**
+ *  Formats monotonic time as local wall clock time of day, HH:MM:SS.uuuuuu.
+ **/
+gchar *display_format_time(gint64 time)
+{
+    gint64 real = time - g_get_monotonic_time() + g_get_real_time();
+    GDateTime *dt = g_date_time_new_from_unix_local(real / G_USEC_PER_SEC);
+    gchar *hms = g_date_time_format(dt, "%H:%M:%S");
+    gchar *text = g_strdup_printf("%s.%06d", hms, (gint)(real % G_USEC_PER_SEC));
+
+    g_free(hms);
+    g_date_time_unref(dt);
+
+    return text;
+}
+
+/**
+ *  Formats time between two arrivals, given in ns, as +m.uuu ms below a
+ *  second and +s.uuuuuu s above.
+ **/
+gchar *display_format_gap(gint64 gap)
+{
+    if (gap < 1000000000)
+        return g_strdup_printf("+%.3f ms", gap / 1e6);
+
+    return g_strdup_printf("+%.6f s", gap / 1e9);
+}
+
+/**
+ *  Draws arrival time of each visible line, or time since previous line
+ *  arrived, into left border window.
+ **/
+static gboolean display_draw_cb(GtkWidget *widget, cairo_t *cr, Display *display)
+{
+    GtkTextView *view = display->view;
+    GdkWindow *window = gtk_text_view_get_window(view, GTK_TEXT_WINDOW_LEFT);
+    GtkStyleContext *style = gtk_widget_get_style_context(widget);
+    PangoLayout *layout;
+    GdkRectangle visible;
+    GtkTextIter iter;
+    guint64 n_lines;
+
+    if (display->timestamps == DISPLAY_TIMESTAMPS_NONE || display->lines == NULL ||
+        window == NULL || !gtk_cairo_should_draw_window(cr, window))
+    {
+        return FALSE;
+    }
+
+    n_lines = line_index_get_lines(display->lines);
+    gtk_text_view_get_visible_rect(view, &visible);
+    gtk_text_view_get_line_at_y(view, &iter, visible.y, NULL);
+    layout = gtk_widget_create_pango_layout(widget, NULL);
+
+    cairo_save(cr);
+    gtk_cairo_transform_to_window(cr, widget, window);
+    for (;;)
+    {
+        guint64 line = display->first_line + gtk_text_iter_get_line(&iter);
+        gint y, height;
+        gchar *text;
+
+        gtk_text_view_get_line_yrange(view, &iter, &y, &height);
+        if (y >= visible.y + visible.height || line >= n_lines)
+            break;
+
+        if (display->timestamps == DISPLAY_TIMESTAMPS_ABSOLUTE)
+        {
+            text = display_format_time(line_index_get_time(display->lines, line));
+        }
+        else if (line > 0)
+        {
+            text = display_format_gap((line_index_get_time(display->lines, line) -
+                                       line_index_get_time(display->lines, line - 1)) * 1000);
+        }
+        else
+        {
+            text = g_strdup("");
+        }
+        pango_layout_set_text(layout, text, -1);
+        g_free(text);
+
+        gtk_text_view_buffer_to_window_coords(view, GTK_TEXT_WINDOW_LEFT,
+                                              0, y, NULL, &y);
+        gtk_render_layout(style, cr, TIMESTAMP_PADDING, y, layout);
+
+        if (!gtk_text_iter_forward_line(&iter))
+            break;
+    }
+    cairo_restore(cr);
+
+    g_object_unref(layout);
+
+    return FALSE;
+}
+
+Display *display_new(GtkTextView *view)
+{
+    Display *display = g_slice_new0(Display);
+    GtkAdjustment *vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(view));
+    GtkTextIter end;
+
+    display->view = view;
+    display->buffer = gtk_text_view_get_buffer(view);
+    display->follow = TRUE;
+    display->pending = g_byte_array_new();
+    display->breaks = g_array_new(FALSE, FALSE, sizeof(guint));
+    display->text = g_byte_array_new();
+    display->sanitizer = utf8_sanitizer_new();
+    display->col_sanitizer = utf8_sanitizer_new();
+    utf8_sanitizer_set_line_breaks(display->col_sanitizer, FALSE);
+
+    g_queue_init(&display->chunks);
+    g_queue_push_tail(&display->chunks, g_slice_new0(ScrollbackChunk));
+
+    gtk_text_buffer_get_end_iter(display->buffer, &end);
+    /* right gravity, so the mark stays at the end while we append */
+    display->end_mark = gtk_text_buffer_create_mark(display->buffer, NULL, &end, FALSE);
+    display->goto_mark = gtk_text_buffer_create_mark(display->buffer, NULL, &end, TRUE);
+    display->match_tag = gtk_text_buffer_create_tag(display->buffer, NULL,
+                                                     "background", "yellow",
+                                                     "foreground", "black", NULL);
+    display->current_tag = gtk_text_buffer_create_tag(display->buffer, NULL,
+                                                       "background", "orange",
+                                                       "foreground", "black", NULL);
+
+    /* view must already be in a scrolled window */
+    g_signal_connect(G_OBJECT(vadj), "value-changed",
+                     G_CALLBACK(display_value_changed_cb), display);
+    g_signal_connect_after(G_OBJECT(view), "draw",
+                           G_CALLBACK(display_draw_cb), display);
+
+    return display;
+}
+
+void display_free(Display *display)
+{
+    ScrollbackChunk *chunk;
+
+    display_cancel_flush(display);
+    g_signal_handlers_disconnect_by_data(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(display->view)),
+                                         display);
+    g_signal_handlers_disconnect_by_data(display->view, display);
+    while ((chunk = g_queue_pop_head(&display->chunks)) != NULL)
+    {
+        if (chunk->end != NULL)
+            gtk_text_buffer_delete_mark(display->buffer, chunk->end);
+        g_slice_free(ScrollbackChunk, chunk);
+    }
+    gtk_text_buffer_delete_mark(display->buffer, display->end_mark);
+    gtk_text_buffer_delete_mark(display->buffer, display->goto_mark);
+    g_byte_array_free(display->pending, TRUE);
+    g_array_free(display->breaks, TRUE);
+    g_byte_array_free(display->text, TRUE);
+    utf8_sanitizer_free(display->sanitizer);
+    utf8_sanitizer_free(display->col_sanitizer);
+    g_slice_free(Display, display);
+}
+
+/**
+ *  Sets maximum time received data may be held before it is shown.
+ *  0 means data is shown on the next frame.
+ **/
+void display_set_latency(Display *display, guint latency_ms)
+{
+    display->latency = (gint64)latency_ms * 1000;
+}
+
+/**
+ *  Sets how much received data is kept in text buffer.
+ *  Takes effect on next flush; limit 0 means unlimited.
+ **/
+void display_set_scrollback(Display *display, guint limit, ScrollbackUnit unit)
+{
+    ScrollbackChunk *chunk;
+
+    /* chunks carry both counts, so changing unit needs no rebuild */
+    display->unit = unit;
+    display->limit = limit;
+
+    chunk = g_queue_peek_tail(&display->chunks);
+    if (display->limit != 0 &&
+        chunk_size(chunk, unit) >= MAX(limit / SCROLLBACK_CHUNKS, 1))
+    {
+        /* seal current chunk, so the new limit applies right away */
+        scrollback_add(display, NULL, 0);
+    }
+}
+
+/**
+ *  Frames text into lines found by index, which must outlive display.
+ *  Call display_end_line() after data ending each line. Index should be
+ *  set before any data is appended, so that lines match.
+ **/
+void display_set_line_index(Display *display, LineIndex *index)
+{
+    display->lines = index;
+    utf8_sanitizer_set_line_breaks(display->sanitizer, index == NULL);
+}
+
+/**
+ *  Shows or hides arrival time of each line, or gap since previous one,
+ *  in a column left of text. Needs line index.
+ **/
+void display_set_timestamps(Display *display, DisplayTimestamps timestamps)
+{
+    GtkTextView *view = display->view;
+    gboolean show = timestamps != DISPLAY_TIMESTAMPS_NONE;
+
+    if (show && display->timestamp_width == 0)
+    {
+        /* wider than any gap shown */
+        PangoLayout *layout = gtk_widget_create_pango_layout(GTK_WIDGET(view),
+                                                             "00:00:00.000000");
+
+        pango_layout_get_pixel_size(layout, &display->timestamp_width, NULL);
+        display->timestamp_width += 2 * TIMESTAMP_PADDING;
+        g_object_unref(layout);
+    }
+
+    display->timestamps = timestamps;
+    gtk_text_view_set_border_window_size(view, GTK_TEXT_WINDOW_LEFT,
+                                         show ? display->timestamp_width : 0);
+}
+
+/**
+ *  Scrolls view so that given indexed line is at the top and stops
+ *  following new data until view is scrolled back to the end.
+ *
+ *  \return FALSE if line is no longer in scrollback or not shown yet
+ **/
+gboolean display_scroll_to_line(Display *display, guint64 line)
+{
+    GtkTextIter iter;
+
+    if (display->lines == NULL || line < display->first_line ||
+        line - display->first_line >= (guint64)gtk_text_buffer_get_line_count(display->buffer))
+    {
+        return FALSE;
+    }
+
+    gtk_text_buffer_get_iter_at_line(display->buffer, &iter,
+                                     (gint)(line - display->first_line));
+    gtk_text_buffer_move_mark(display->buffer, display->goto_mark, &iter);
+    gtk_text_view_scroll_to_mark(display->view, display->goto_mark, 0.0, TRUE, 0.0, 0.0);
+    display->follow = FALSE;
+
+    return TRUE;
+}
+
+/**
+ *  Finds text position of received byte at offset in store, which holds
+ *  data indexed by line index. Text before offset on its line, from the
+ *  first byte still shown, is escaped again to count characters; only
+ *  bytes after the previous call are when it was on the same line.
+ *
+ *  \return FALSE if byte is not shown
+ **/
+static gboolean display_get_iter_at_offset(Display *display, ByteStore *store,
+                                           guint64 offset, GtkTextIter *iter)
+{
+    guint64 line, start;
+    GByteArray *raw;
+    gint chars;
+
+    if (display->lines == NULL || line_index_get_lines(display->lines) == 0 ||
+        offset < display->first_shown)
+    {
+        return FALSE;
+    }
+
+    line = line_index_find(display->lines, offset);
+    if (line < display->first_line ||
+        line - display->first_line >= (guint64)gtk_text_buffer_get_line_count(display->buffer))
+    {
+        return FALSE;
+    }
+
+    /* first line may be cut by scrollback, its text starts at first_shown */
+    start = MAX(line_index_get_offset(display->lines, line), display->first_shown);
+    if (start != display->col_start || offset < display->col_offset)
+    {
+        utf8_sanitizer_reset(display->col_sanitizer);
+        display->col_start = start;
+        display->col_offset = start;
+        display->col_chars = 0;
+    }
+
+    raw = g_byte_array_sized_new(offset - display->col_offset);
+    g_byte_array_set_size(raw, offset - display->col_offset);
+    g_byte_array_set_size(raw, byte_store_read(store, display->col_offset,
+                                               raw->data, raw->len));
+
+    g_byte_array_set_size(display->text, 0);
+    utf8_sanitizer_feed(display->col_sanitizer, raw->data, raw->len, display->text);
+    display->col_chars += g_utf8_strlen((const gchar*)display->text->data,
+                                        display->text->len);
+    display->col_offset += raw->len;
+    chars = display->col_chars;
+    g_byte_array_free(raw, TRUE);
+
+    gtk_text_buffer_get_iter_at_line(display->buffer, iter,
+                                     (gint)(line - display->first_line));
+    if (!gtk_text_iter_ends_line(iter))
+    {
+        /* part of line may still be pending */
+        gtk_text_iter_forward_to_line_end(iter);
+        chars = MIN(chars, gtk_text_iter_get_line_offset(iter));
+        gtk_text_iter_set_line_offset(iter, chars);
+    }
+
+    return TRUE;
+}
+
+/**
+ *  Highlights received bytes [offset, offset + len) of store. The current
+ *  one is highlighted differently and scrolled to, which stops following
+ *  new data like display_scroll_to_line().
+ *
+ *  \return FALSE if bytes are not shown
+ **/
+gboolean display_highlight(Display *display, ByteStore *store, guint64 offset,
+                           guint64 len, gboolean current)
+{
+    GtkTextIter start, end;
+
+    if (!display_get_iter_at_offset(display, store, offset, &start) ||
+        !display_get_iter_at_offset(display, store, offset + len, &end))
+    {
+        return FALSE;
+    }
+
+    gtk_text_buffer_apply_tag(display->buffer,
+                              current ? display->current_tag : display->match_tag,
+                              &start, &end);
+
+    if (current)
+    {
+        gtk_text_buffer_move_mark(display->buffer, display->goto_mark, &start);
+        gtk_text_view_scroll_to_mark(display->view, display->goto_mark, 0.0, TRUE, 0.0, 0.5);
+        display->follow = FALSE;
+    }
+
+    return TRUE;
+}
+
+void display_clear_highlights(Display *display)
+{
+    GtkTextIter start, end;
+
+    gtk_text_buffer_get_bounds(display->buffer, &start, &end);
+    gtk_text_buffer_remove_tag(display->buffer, display->match_tag, &start, &end);
+    gtk_text_buffer_remove_tag(display->buffer, display->current_tag, &start, &end);
+}
+
+/**
+ *  \return number of first indexed line still in scrollback
+ **/
+guint64 display_get_first_line(Display *display)
+{
+    return display->first_line;
+}
+
+/**
+ *  Queues data for the next flush. arrival is monotonic time at which data
+ *  was received, latency is counted from it.
+ **/
+void display_append(Display *display, const guint8 *data, gsize len,
+                    gint64 arrival)
+{
+    if (len == 0)
+        return;
+
+    if (display->pending->len == 0)
+    {
+        display->pending_since = arrival;
+    }
+    g_byte_array_append(display->pending, data, len);
+
+    if (display->tick_id == 0)
+    {
+        display->tick_id = gtk_widget_add_tick_callback(GTK_WIDGET(display->view),
+                                                        display_tick_cb,
+                                                        display, NULL);
+    }
+
+    if (display->timeout_id == 0)
+    {
+        display->timeout_id = g_timeout_add(display->latency / 1000 + DISPLAY_FALLBACK_MS,
+                                            display_timeout_cb, display);
+    }
+}
+
+/**
+ *  Ends current line after data appended so far.
+ **/
+void display_end_line(Display *display)
+{
+    guint end = display->pending->len;
+
+    g_array_append_val(display->breaks, end);
+}
+
+/**
+ *  Inserts all pending data into text buffer and scrolls to the end,
+ *  unless view was scrolled away from it.
+ **/
+void display_flush(Display *display)
+{
+    GdkWindow *gutter;
+    GtkTextIter iter;
+    gint64 lag;
+    guint start = 0;
+    guint i;
+
+    display_cancel_flush(display);
+
+    if (display->pending->len == 0)
+        return;
+
+    /*
+       Text buffer takes only valid UTF-8; a character split between
+       flushes is completed by the next one, but never across line end.
+    */
+    g_byte_array_set_size(display->text, 0);
+    for (i = 0; i < display->breaks->len; i++)
+    {
+        guint end = g_array_index(display->breaks, guint, i);
+
+        utf8_sanitizer_feed(display->sanitizer, display->pending->data + start,
+                            end - start, display->text);
+        utf8_sanitizer_finish(display->sanitizer, display->text);
+        g_byte_array_append(display->text, (const guint8*)"\n", 1);
+        start = end;
+    }
+    utf8_sanitizer_feed(display->sanitizer, display->pending->data + start,
+                        display->pending->len - start, display->text);
+    g_array_set_size(display->breaks, 0);
+
+    gtk_text_buffer_get_end_iter(display->buffer, &iter);
+    gtk_text_buffer_insert(display->buffer, &iter,
+                           (const gchar*)display->text->data,
+                           display->text->len);
+    display->flushed += display->pending->len;
+    scrollback_add(display, display->text->data, display->text->len);
+    scrollback_trim(display);
+    g_byte_array_set_size(display->pending, 0);
+
+    lag = g_get_monotonic_time() - display->pending_since;
+    display->flushes++;
+    display->lag_last = lag;
+    display->lag_max = MAX(display->lag_max, lag);
+    display->lag_sum += lag;
+
+    gutter = gtk_text_view_get_window(display->view, GTK_TEXT_WINDOW_LEFT);
+    if (display->timestamps != DISPLAY_TIMESTAMPS_NONE && gutter != NULL)
+    {
+        /* new lines may be drawn without their timestamps otherwise */
+        gdk_window_invalidate_rect(gutter, NULL, FALSE);
+    }
+
+    if (display->follow)
+        gtk_text_view_scroll_mark_onscreen(display->view, display->end_mark);
+}
+
+/**
+ *  \return number of received bytes passed to text buffer since display was
+ *  created, counted before escaping
+ **/
+guint64 display_get_flushed(Display *display)
+{
+    return display->flushed;
+}
+
+void display_get_stats(Display *display, DisplayStats *stats)
+{
+    stats->flushed = display->flushed;
+    stats->pending = display->pending->len;
+    stats->flushes = display->flushes;
+    stats->lag_last = display->lag_last;
+    stats->lag_max = display->lag_max;
+    stats->lag_sum = display->lag_sum;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <gtk/gtk.h>
+#include "conf.h"
+#include "lineindex.h"
+#include "bytestore.h"
+
+/**
+ *  Batches received data for a GtkTextView. Data passed to display_append()
+ *  is held and inserted into the text buffer at most once per frame,
+ *  followed by a single scroll to the end. Binary data is shown with
+ *  escapes (see sanitizer.h).
+ *  With a line index (see lineindex.h) text is split into lines by the
+ *  index, which can be shown with arrival timestamps and jumped to.
+ **/
+typedef struct _Display Display;
+
+typedef struct {
+    guint64 flushed;  /* received bytes passed to text buffer */
+    gsize pending;    /* bytes waiting for next flush */
+    guint64 flushes;
+    gint64 lag_last;  /* arrival to insertion of oldest byte, in us */
+    gint64 lag_max;
+    gint64 lag_sum;   /* over all flushes, for averages */
+} DisplayStats;
+
+typedef enum {
+    DISPLAY_TIMESTAMPS_NONE,
+    DISPLAY_TIMESTAMPS_ABSOLUTE,
+    DISPLAY_TIMESTAMPS_GAP, /* since previous line arrived */
+} DisplayTimestamps;
+
+Display *display_new(GtkTextView *view);
+void display_free(Display *display);
+
+void display_set_latency(Display *display, guint latency_ms);
+void display_set_scrollback(Display *display, guint limit, ScrollbackUnit unit);
+void display_set_line_index(Display *display, LineIndex *index);
+void display_set_timestamps(Display *display, DisplayTimestamps timestamps);
+void display_append(Display *display, const guint8 *data, gsize len,
+                    gint64 arrival);
+void display_end_line(Display *display);
+void display_flush(Display *display);
+guint64 display_get_flushed(Display *display);
+void display_get_stats(Display *display, DisplayStats *stats);
+gboolean display_scroll_to_line(Display *display, guint64 line);
+guint64 display_get_first_line(Display *display);
+gboolean display_highlight(Display *display, ByteStore *store, guint64 offset,
+                           guint64 len, gboolean current);
+void display_clear_highlights(Display *display);
+
+PangoFontDescription *display_font_new(void);
+gchar *display_format_time(gint64 time);
+gchar *display_format_gap(gint64 gap);
+
+#endif /* DISPLAY_H */
@@ -0,0 +1,297 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "filesender.h"
+#include "txqueue.h"
+
+#define SEND_CHUNK (64 * 1024)  /* most pushed to queue at once */
+#define RATE_TICK 10            /* ms, how often rate pacing refills queue */
+#define PROGRESS_INTERVAL 100000 /* us, between progress callbacks */
+
+/**
+ * Pacing labels, order must match SendPacing enum
+ **/
+gchar *pacing_labels[] = {
+    "None",
+    "Bytes per second",
+    "Delay after line (ms)",
+    "Delay after byte (ms)",
+};
+const guint n_pacing_labels = G_N_ELEMENTS(pacing_labels);
+
+typedef enum {
+    PIECE_READY,      /* next line or byte can be queued */
+    PIECE_WAIT_DRAIN, /* waiting until queued piece is written */
+    PIECE_WAIT_DELAY, /* waiting for delay after it */
+} PieceState;
+
+struct _FileSender {
+    GMappedFile *mapped;
+    const guint8 *contents;
+    gsize size;
+    gsize offset;    /* queued so far */
+    gsize piece_end; /* end of line being queued, for line delay */
+
+    TxQueue *tx;
+    gsize written_base; /* TX queue written counter at start */
+
+    SendPacing pacing;
+    guint value;
+    gchar *terminator;
+    gint n_terminator_chars;
+    PieceState state;
+
+    gint64 start_time;
+    gint64 last_progress;
+    guint timeout_id;
+
+    FileSenderFunc func;
+    gpointer data;
+};
+
+static void file_sender_fill(FileSender *sender);
+
+static gboolean file_sender_timeout_cb(gpointer data)
+{
+    FileSender *sender = (FileSender*)data;
+
+    if (sender->pacing == PACING_RATE)
+    {
+        file_sender_fill(sender);
+        return TRUE;
+    }
+
+    sender->timeout_id = 0;
+    sender->state = PIECE_READY;
+    file_sender_fill(sender);
+
+    return FALSE;
+}
+
+/**
+ *  \return offset just after the line starting at offset
+ **/
+static gsize file_sender_line_end(FileSender *sender, gsize offset)
+{
+    const gchar *term = sender->n_terminator_chars > 0 ? sender->terminator : "\n";
+    gsize n_term = sender->n_terminator_chars > 0 ? sender->n_terminator_chars : 1;
+
+    while (offset < sender->size)
+    {
+        const guint8 *p = memchr(sender->contents + offset, term[0],
+                                 sender->size - offset);
+
+        if (p == NULL)
+            break;
+
+        offset = p - sender->contents;
+        if (sender->size - offset >= n_term && memcmp(p, term, n_term) == 0)
+            return offset + n_term;
+        offset++;
+    }
+
+    return sender->size;
+}
+
+/**
+ *  \return how many bytes may be queued now
+ **/
+static gsize file_sender_allowed(FileSender *sender)
+{
+    gsize remaining = sender->size - sender->offset;
+    gsize allowed;
+
+    switch (sender->pacing)
+    {
+        case PACING_RATE:
+            allowed = (gsize)((g_get_monotonic_time() - sender->start_time) *
+                              (gdouble)sender->value / G_USEC_PER_SEC);
+            return MIN(remaining, allowed - MIN(allowed, sender->offset));
+
+        case PACING_LINE_DELAY:
+        case PACING_CHAR_DELAY:
+            if (sender->state == PIECE_WAIT_DRAIN && tx_queue_get_depth(sender->tx) == 0)
+            {
+                /* previous piece left the port, delay before the next one */
+                sender->state = PIECE_WAIT_DELAY;
+                sender->timeout_id = g_timeout_add(sender->value,
+                                                   file_sender_timeout_cb, sender);
+            }
+            if (sender->state != PIECE_READY)
+                return 0;
+
+            if (sender->pacing == PACING_CHAR_DELAY)
+                return MIN(remaining, 1);
+
+            if (sender->piece_end <= sender->offset)
+                sender->piece_end = file_sender_line_end(sender, sender->offset);
+            return sender->piece_end - sender->offset;
+
+        default:
+            return remaining;
+    }
+}
+
+/**
+ *  Queues as much as pacing and queue space allow, then reports progress.
+ *  Nothing may touch sender after the callback, it may free it.
+ **/
+static void file_sender_fill(FileSender *sender)
+{
+    gint64 now;
+    gsize len;
+
+    len = MIN(file_sender_allowed(sender), tx_queue_get_space(sender->tx));
+    len = MIN(len, SEND_CHUNK);
+    if (len > 0)
+    {
+        sender->offset += tx_queue_push(sender->tx, sender->contents + sender->offset, len);
+
+        /* whole line or byte is queued, wait for it to be written */
+        if ((sender->pacing == PACING_LINE_DELAY && sender->offset == sender->piece_end) ||
+            sender->pacing == PACING_CHAR_DELAY)
+        {
+            sender->state = PIECE_WAIT_DRAIN;
+        }
+    }
+
+    now = g_get_monotonic_time();
+    if (file_sender_is_done(sender) ||
+        now - sender->last_progress >= PROGRESS_INTERVAL)
+    {
+        sender->last_progress = now;
+        sender->func(sender, sender->data);
+    }
+}
+
+/**
+ *  Maps filename and starts sending it through tx. Progress is reported
+ *  to func, at the latest when everything was written.
+ *  file_sender_poll() must be called whenever tx written something.
+ *
+ *  \return NULL on error
+ **/
+FileSender *file_sender_new(const gchar *filename, TxQueue *tx,
+                            SendPacing pacing, guint value,
+                            const gchar *terminator, gint n_terminator_chars,
+                            FileSenderFunc func, gpointer data)
+{
+    FileSender *sender;
+    TxQueueStats stats;
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(filename, FALSE, &error);
+
+    if (mapped == NULL)
+    {
+        g_message("Unable to open %s: %s", filename, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    if (pacing == PACING_RATE && value == 0)
+    {
+        g_message("Send rate must not be 0");
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+
+    sender = g_slice_new0(FileSender);
+    sender->mapped = mapped;
+    sender->contents = (const guint8*)g_mapped_file_get_contents(mapped);
+    sender->size = g_mapped_file_get_length(mapped);
+    sender->tx = tx;
+    sender->pacing = pacing;
+    sender->value = value;
+    sender->terminator = g_malloc(MAX(n_terminator_chars, 1));
+    memcpy(sender->terminator, terminator, n_terminator_chars);
+    sender->n_terminator_chars = n_terminator_chars;
+    sender->state = PIECE_READY;
+    sender->func = func;
+    sender->data = data;
+
+    tx_queue_get_stats(tx, &stats);
+    sender->written_base = stats.written;
+    sender->start_time = g_get_monotonic_time();
+    sender->last_progress = sender->start_time;
+
+    if (pacing == PACING_RATE)
+        sender->timeout_id = g_timeout_add(RATE_TICK, file_sender_timeout_cb, sender);
+
+    return sender;
+}
+
+/**
+ *  Stops sending. What is already queued is left in the queue.
+ **/
+void file_sender_free(FileSender *sender)
+{
+    if (sender->timeout_id != 0)
+        g_source_remove(sender->timeout_id);
+
+    g_mapped_file_unref(sender->mapped);
+    g_free(sender->terminator);
+    g_slice_free(FileSender, sender);
+}
+
+/**
+ *  Continues sending, call after transmit queue written data and once
+ *  after file_sender_new().
+ **/
+void file_sender_poll(FileSender *sender)
+{
+    file_sender_fill(sender);
+}
+
+guint64 file_sender_get_size(FileSender *sender)
+{
+    return sender->size;
+}
+
+/**
+ *  \return number of bytes of file that were written to the port
+ **/
+guint64 file_sender_get_written(FileSender *sender)
+{
+    TxQueueStats stats;
+
+    tx_queue_get_stats(sender->tx, &stats);
+
+    /* other data may share the queue, never count more than was queued */
+    return MIN(stats.written - sender->written_base, sender->offset);
+}
+
+/**
+ *  \return average throughput since start, in bytes per second
+ **/
+gdouble file_sender_get_rate(FileSender *sender)
+{
+    gint64 elapsed = g_get_monotonic_time() - sender->start_time;
+
+    if (elapsed <= 0)
+        return 0;
+
+    return file_sender_get_written(sender) * (gdouble)G_USEC_PER_SEC / elapsed;
+}
+
+/**
+ *  \return TRUE when whole file was queued and queue is empty
+ **/
+gboolean file_sender_is_done(FileSender *sender)
+{
+    return sender->offset == sender->size && tx_queue_get_depth(sender->tx) == 0;
+}
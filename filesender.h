@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef FILESENDER_H
+#define FILESENDER_H
+
+#include <glib.h>
+#include "txqueue.h"
+
+/**
+ *  Sends a memory mapped file through transmit queue, from the main loop.
+ *  Without pacing queue is kept full, so the port runs as fast as its
+ *  flow control allows. Pacing is for devices without flow control:
+ *  limit to value bytes/s, or wait value ms after each line (ending with
+ *  terminator, '\n' if there is none) or after each byte has been sent.
+ **/
+typedef struct _FileSender FileSender;
+
+typedef enum {
+    PACING_NONE,
+    PACING_RATE,
+    PACING_LINE_DELAY,
+    PACING_CHAR_DELAY,
+} SendPacing;
+
+/* labels, in order of SendPacing */
+extern gchar *pacing_labels[];
+extern const guint n_pacing_labels;
+
+/* called with progress from main loop, sender may be freed from it */
+typedef void (*FileSenderFunc)(FileSender *sender, gpointer data);
+
+FileSender *file_sender_new(const gchar *filename, TxQueue *tx,
+                            SendPacing pacing, guint value,
+                            const gchar *terminator, gint n_terminator_chars,
+                            FileSenderFunc func, gpointer data);
+void file_sender_free(FileSender *sender);
+
+void file_sender_poll(FileSender *sender);
+
+guint64 file_sender_get_size(FileSender *sender);
+guint64 file_sender_get_written(FileSender *sender);
+gdouble file_sender_get_rate(FileSender *sender);
+gboolean file_sender_is_done(FileSender *sender);
+
+#endif /* FILESENDER_H */
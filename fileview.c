@@ -0,0 +1,279 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "fileview.h"
+#include "capturefile.h"
+#include "hexview.h"
+#include "display.h"
+
+#define SCROLL_LINES 3
+#define REFRESH_INTERVAL 200 /* ms, while file is being indexed */
+
+/**
+ *  Offline viewer window for capture files. Text view draws only lines
+ *  that are visible, finding them through CaptureFile line index.
+ **/
+typedef struct {
+    CaptureFile *cf;
+    gchar *basename;
+
+    GtkWidget *window;
+    GtkWidget *area;
+    GtkAdjustment *adjustment; /* in lines */
+    PangoFontDescription *font;
+    gint line_height;
+
+    HexView *hexview;
+    guint refresh_id;
+} FileView;
+
+static void append_line(GString *str, const guint8 *line, gsize len)
+{
+    gboolean utf8 = g_utf8_validate((const gchar*)line, len, NULL);
+    gsize i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (line[i] == '\t')
+            g_string_append_c(str, ' ');
+        else if (line[i] < 0x20 || line[i] == 0x7F || (!utf8 && line[i] >= 0x80))
+            g_string_append_c(str, '.');
+        else
+            g_string_append_c(str, line[i]);
+    }
+    g_string_append_c(str, '\n');
+}
+
+static gboolean file_view_draw_cb(GtkWidget *widget, cairo_t *cr, FileView *fv)
+{
+    GtkStyleContext *context = gtk_widget_get_style_context(widget);
+    guint64 line = (guint64)gtk_adjustment_get_value(fv->adjustment);
+    guint64 n_lines = capture_file_get_lines(fv->cf);
+    gint rows = gtk_widget_get_allocated_height(widget) / fv->line_height + 1;
+    guint8 buf[CAPTURE_FILE_MAX_LINE];
+    guint64 offset;
+    GString *text;
+    PangoLayout *layout;
+    GdkRGBA color;
+    gint i;
+
+    gtk_render_background(context, cr, 0, 0,
+                          gtk_widget_get_allocated_width(widget),
+                          gtk_widget_get_allocated_height(widget));
+
+    if (line >= n_lines)
+        return FALSE;
+
+    text = g_string_sized_new(rows * 80);
+    offset = capture_file_get_line_offset(fv->cf, line);
+    for (i = 0; i < rows && line + i < n_lines; i++)
+    {
+        gsize len = capture_file_read_line(fv->cf, offset, buf, &offset);
+
+        append_line(text, buf, len);
+    }
+
+    layout = gtk_widget_create_pango_layout(widget, NULL);
+    pango_layout_set_font_description(layout, fv->font);
+    pango_layout_set_text(layout, text->str, text->len);
+
+    gtk_style_context_get_color(context, gtk_widget_get_state_flags(widget), &color);
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_move_to(cr, 2, 0);
+    pango_cairo_show_layout(cr, layout);
+
+    g_object_unref(layout);
+    g_string_free(text, TRUE);
+
+    return FALSE;
+}
+
+static void file_view_update_range(FileView *fv)
+{
+    gdouble page = gtk_adjustment_get_page_size(fv->adjustment);
+
+    gtk_adjustment_configure(fv->adjustment,
+                             gtk_adjustment_get_value(fv->adjustment),
+                             0, (gdouble)capture_file_get_lines(fv->cf),
+                             1, MAX(page - 1, 1), page);
+}
+
+static void file_view_size_allocate_cb(GtkWidget *widget, GdkRectangle *allocation,
+                                       FileView *fv)
+{
+    gtk_adjustment_set_page_size(fv->adjustment,
+                                 MAX(allocation->height / fv->line_height, 1));
+    file_view_update_range(fv);
+}
+
+static gboolean file_view_scroll_cb(GtkWidget *widget, GdkEventScroll *event,
+                                    FileView *fv)
+{
+    gdouble delta;
+    gdouble value = gtk_adjustment_get_value(fv->adjustment);
+
+    switch (event->direction)
+    {
+        case GDK_SCROLL_UP: delta = -SCROLL_LINES; break;
+        case GDK_SCROLL_DOWN: delta = SCROLL_LINES; break;
+        case GDK_SCROLL_SMOOTH: delta = event->delta_y * SCROLL_LINES; break;
+        default: return FALSE;
+    }
+
+    gtk_adjustment_set_value(fv->adjustment, value + delta);
+
+    return TRUE;
+}
+
+static void file_view_value_changed_cb(GtkAdjustment *adjustment, FileView *fv)
+{
+    gtk_widget_queue_draw(fv->area);
+}
+
+static gboolean file_view_refresh_cb(gpointer data)
+{
+    FileView *fv = (FileView*)data;
+    gboolean indexing = capture_file_is_indexing(fv->cf);
+    gchar *title;
+
+    file_view_update_range(fv);
+    hex_view_data_changed(fv->hexview);
+    gtk_widget_queue_draw(fv->area);
+
+    if (indexing)
+    {
+        title = g_strdup_printf("%s (indexing %d%%)", fv->basename,
+                                (gint)(capture_file_get_progress(fv->cf) * 100));
+    }
+    else
+    {
+        title = g_strdup_printf("%s (%" G_GUINT64_FORMAT " bytes, %"
+                                G_GUINT64_FORMAT " lines)", fv->basename,
+                                capture_file_get_size(fv->cf),
+                                capture_file_get_lines(fv->cf));
+        fv->refresh_id = 0;
+    }
+    gtk_window_set_title(GTK_WINDOW(fv->window), title);
+    g_free(title);
+
+    return indexing;
+}
+
+static void file_view_destroy_cb(GtkWidget *widget, FileView *fv)
+{
+    if (fv->refresh_id != 0)
+        g_source_remove(fv->refresh_id);
+
+    capture_file_close(fv->cf);
+    pango_font_description_free(fv->font);
+    g_object_unref(fv->adjustment);
+    g_free(fv->basename);
+    g_slice_free(FileView, fv);
+}
+
+static guint64 file_get_start(gpointer data)
+{
+    return 0;
+}
+
+static guint64 file_get_end(gpointer data)
+{
+    return capture_file_get_size((CaptureFile*)data);
+}
+
+static gsize file_read(gpointer data, guint64 offset, guint8 *buf, gsize len)
+{
+    return capture_file_read((CaptureFile*)data, offset, buf, len);
+}
+
+static const HexViewSource capture_file_source = {
+    file_get_start,
+    file_get_end,
+    file_read,
+};
+
+/**
+ *  Opens capture (or any other) file in a new viewer window.
+ *
+ *  \return FALSE if file could not be opened
+ **/
+gboolean file_view_open(GtkWindow *parent, const gchar *filename)
+{
+    FileView *fv;
+    GtkWidget *notebook, *hbox, *scrollbar;
+    PangoLayout *layout;
+    CaptureFile *cf = capture_file_open(filename);
+
+    if (cf == NULL)
+        return FALSE;
+
+    fv = g_slice_new0(FileView);
+    fv->cf = cf;
+    fv->basename = g_path_get_basename(filename);
+
+    fv->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_transient_for(GTK_WINDOW(fv->window), parent);
+    gtk_window_set_title(GTK_WINDOW(fv->window), fv->basename);
+    gtk_window_set_default_size(GTK_WINDOW(fv->window), 650, 500);
+
+    fv->adjustment = gtk_adjustment_new(0, 0, 0, 1, 1, 1);
+    g_object_ref_sink(fv->adjustment);
+
+    hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox), FALSE);
+    fv->area = gtk_drawing_area_new();
+    scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, fv->adjustment);
+    gtk_box_pack_start(GTK_BOX(hbox), fv->area, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), scrollbar, FALSE, FALSE, 0);
+
+    fv->font = display_font_new();
+    layout = gtk_widget_create_pango_layout(fv->area, "0");
+    pango_layout_set_font_description(layout, fv->font);
+    pango_layout_get_pixel_size(layout, NULL, &fv->line_height);
+    fv->line_height = MAX(fv->line_height, 1);
+    g_object_unref(layout);
+
+    gtk_widget_add_events(fv->area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+
+    fv->hexview = hex_view_new(&capture_file_source, cf);
+    hex_view_set_follow(fv->hexview, FALSE);
+
+    notebook = gtk_notebook_new();
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), hbox,
+                             gtk_label_new("Text View"));
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), hex_view_get_widget(fv->hexview),
+                             gtk_label_new("Hex View"));
+    gtk_container_add(GTK_CONTAINER(fv->window), notebook);
+
+    g_signal_connect(G_OBJECT(fv->area), "draw",
+                     G_CALLBACK(file_view_draw_cb), fv);
+    g_signal_connect(G_OBJECT(fv->area), "size-allocate",
+                     G_CALLBACK(file_view_size_allocate_cb), fv);
+    g_signal_connect(G_OBJECT(fv->area), "scroll-event",
+                     G_CALLBACK(file_view_scroll_cb), fv);
+    g_signal_connect(G_OBJECT(fv->adjustment), "value-changed",
+                     G_CALLBACK(file_view_value_changed_cb), fv);
+    g_signal_connect(G_OBJECT(fv->window), "destroy",
+                     G_CALLBACK(file_view_destroy_cb), fv);
+
+    fv->refresh_id = g_timeout_add(REFRESH_INTERVAL, file_view_refresh_cb, fv);
+
+    gtk_widget_show_all(fv->window);
+
+    return TRUE;
+}
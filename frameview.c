@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <gtk/gtk.h>
+#include "frameview.h"
+#include "display.h"
+
+/* payload bytes shown for each frame */
+#define FRAME_PREVIEW 32
+
+enum {
+    COL_NUMBER,
+    COL_TIME,
+    COL_OFFSET,
+    COL_LENGTH,
+    COL_STATUS,
+    COL_PAYLOAD,
+    N_COLUMNS
+};
+
+struct _FrameView {
+    ByteStore *store;
+    FrameDecoder *decoder; /* NULL if no protocol is selected */
+    guint baudrate;
+
+    GtkWidget *box;
+    GtkWidget *tree;
+    GtkWidget *lbl_count;
+    GtkListStore *list;
+    guint rows;
+    guint64 shown; /* frames up to this one were listed */
+
+    guint tick_id;
+};
+
+static gchar *format_payload(FrameView *fv, const Frame *frame)
+{
+    const FrameProtocol *protocol = frame_decoder_get_protocol(fv->decoder);
+    /* enough raw bytes for preview even if every other byte is escape */
+    guint8 raw[FRAME_PREVIEW * 2 + 2];
+    guint8 payload[sizeof(raw)];
+    GString *str = g_string_sized_new(FRAME_PREVIEW * 3 + 4);
+    gsize len, i;
+
+    len = byte_store_read(fv->store, frame->offset, raw, MIN(frame->len, sizeof(raw)));
+    len = protocol->decode(raw, len, payload);
+    len = MIN(MIN(len, frame->payload), FRAME_PREVIEW);
+
+    for (i = 0; i < len; i++)
+        g_string_append_printf(str, i == 0 ? "%02X" : " %02X", payload[i]);
+    if (frame->payload > len)
+        g_string_append(str, " \u2026");
+
+    return g_string_free(str, FALSE);
+}
+
+static void frame_view_append(FrameView *fv, guint64 n)
+{
+    const Frame *frame = frame_decoder_get_frame(fv->decoder, n);
+    gchar *time = display_format_time(frame->time);
+    gchar *payload = format_payload(fv, frame);
+    GtkTreeIter iter;
+
+    gtk_list_store_append(fv->list, &iter);
+    gtk_list_store_set(fv->list, &iter,
+                       COL_NUMBER, n + 1,
+                       COL_TIME, time,
+                       COL_OFFSET, frame->offset,
+                       COL_LENGTH, frame->len,
+                       COL_STATUS, frame_status_labels[frame->status],
+                       COL_PAYLOAD, payload,
+                       -1);
+    fv->rows++;
+
+    g_free(time);
+    g_free(payload);
+}
+
+static void frame_view_update(FrameView *fv)
+{
+    GtkAdjustment *vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(fv->tree));
+    gboolean at_end = gtk_adjustment_get_value(vadj) + gtk_adjustment_get_page_size(vadj) >=
+                      gtk_adjustment_get_upper(vadj) - 1;
+    guint64 count, n;
+    gchar *text;
+
+    if (fv->decoder == NULL)
+        return;
+
+    count = frame_decoder_get_count(fv->decoder);
+    if (count == fv->shown)
+        return;
+
+    /* frames that would be trimmed right away are not listed at all */
+    for (n = MAX(fv->shown, count > FRAME_VIEW_ROWS ? count - FRAME_VIEW_ROWS : 0);
+         n < count; n++)
+    {
+        frame_view_append(fv, n);
+    }
+    fv->shown = count;
+
+    while (fv->rows > FRAME_VIEW_ROWS)
+    {
+        GtkTreeIter iter;
+
+        gtk_tree_model_get_iter_first(GTK_TREE_MODEL(fv->list), &iter);
+        gtk_list_store_remove(fv->list, &iter);
+        fv->rows--;
+    }
+
+    text = g_strdup_printf("%" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " errors",
+                           count, frame_decoder_get_errors(fv->decoder));
+    gtk_label_set_text(GTK_LABEL(fv->lbl_count), text);
+    g_free(text);
+
+    if (at_end)
+    {
+        GtkTreePath *path = gtk_tree_path_new_from_indices(fv->rows - 1, -1);
+
+        gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(fv->tree), path, NULL, FALSE, 0, 0);
+        gtk_tree_path_free(path);
+    }
+}
+
+static void protocol_changed_cb(GtkComboBox *combo, FrameView *fv)
+{
+    gint active = gtk_combo_box_get_active(combo);
+
+    if (fv->decoder != NULL)
+    {
+        frame_decoder_free(fv->decoder);
+        fv->decoder = NULL;
+    }
+    gtk_list_store_clear(fv->list);
+    fv->rows = 0;
+    fv->shown = 0;
+
+    /* first entry is "None" */
+    if (active > 0)
+    {
+        fv->decoder = frame_decoder_new(frame_protocol_get(active - 1));
+        frame_decoder_set_baudrate(fv->decoder, fv->baudrate);
+        gtk_label_set_text(GTK_LABEL(fv->lbl_count), "0 frames");
+    }
+    else
+    {
+        gtk_label_set_text(GTK_LABEL(fv->lbl_count), NULL);
+    }
+}
+
+static void frame_view_destroy_cb(GtkWidget *widget, FrameView *fv)
+{
+    if (fv->tick_id != 0)
+        gtk_widget_remove_tick_callback(fv->tree, fv->tick_id);
+    if (fv->decoder != NULL)
+        frame_decoder_free(fv->decoder);
+    g_object_unref(fv->list);
+    g_slice_free(FrameView, fv);
+}
+
+static void add_column(GtkTreeView *tree, const gchar *title, gint column)
+{
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+
+    gtk_tree_view_insert_column_with_attributes(tree, -1, title, renderer,
+                                                "text", column, NULL);
+}
+
+/**
+ *  Creates view of frames found in data appended to store from the
+ *  moment a protocol is selected.
+ **/
+FrameView *frame_view_new(ByteStore *store)
+{
+    FrameView *fv = g_slice_new0(FrameView);
+    GtkWidget *hbox;
+    GtkWidget *combo;
+    GtkWidget *scrolled_window;
+    PangoFontDescription *font_desc;
+    guint i;
+
+    fv->store = store;
+    fv->list = gtk_list_store_new(N_COLUMNS, G_TYPE_UINT64, G_TYPE_STRING, G_TYPE_UINT64,
+                                  G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+
+    combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "None");
+    for (i = 0; i < frame_protocol_count(); i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), frame_protocol_get(i)->name);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+    g_signal_connect(G_OBJECT(combo), "changed",
+                     G_CALLBACK(protocol_changed_cb), fv);
+
+    fv->lbl_count = gtk_label_new(NULL);
+    hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(hbox), gtk_label_new("Protocol:"), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), combo, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), fv->lbl_count, FALSE, FALSE, 0);
+
+    fv->tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(fv->list));
+    add_column(GTK_TREE_VIEW(fv->tree), "#", COL_NUMBER);
+    add_column(GTK_TREE_VIEW(fv->tree), "Time", COL_TIME);
+    add_column(GTK_TREE_VIEW(fv->tree), "Offset", COL_OFFSET);
+    add_column(GTK_TREE_VIEW(fv->tree), "Length", COL_LENGTH);
+    add_column(GTK_TREE_VIEW(fv->tree), "Status", COL_STATUS);
+    add_column(GTK_TREE_VIEW(fv->tree), "Payload", COL_PAYLOAD);
+    font_desc = display_font_new();
+    gtk_widget_modify_font(fv->tree, font_desc);
+    pango_font_description_free(font_desc);
+
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), fv->tree);
+
+    fv->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(fv->box), hbox, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(fv->box), scrolled_window, TRUE, TRUE, 0);
+
+    g_signal_connect(G_OBJECT(fv->box), "destroy",
+                     G_CALLBACK(frame_view_destroy_cb), fv);
+
+    return fv;
+}
+
+GtkWidget *frame_view_get_widget(FrameView *fv)
+{
+    return fv->box;
+}
+
+/**
+ *  \return decoder to be fed with received data, NULL if none is selected
+ **/
+FrameDecoder *frame_view_get_decoder(FrameView *fv)
+{
+    return fv->decoder;
+}
+
+/**
+ *  Sets line speed passed to decoders, for protocols framed by silence.
+ **/
+void frame_view_set_baudrate(FrameView *fv, guint baudrate)
+{
+    fv->baudrate = baudrate;
+    if (fv->decoder != NULL)
+        frame_decoder_set_baudrate(fv->decoder, baudrate);
+}
+
+static gboolean frame_view_tick_cb(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    FrameView *fv = (FrameView*)data;
+
+    fv->tick_id = 0;
+    frame_view_update(fv);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ *  Must be called after decoder was fed. List is updated on next frame.
+ **/
+void frame_view_data_changed(FrameView *fv)
+{
+    if (fv->decoder != NULL && fv->tick_id == 0)
+    {
+        fv->tick_id = gtk_widget_add_tick_callback(fv->tree, frame_view_tick_cb,
+                                                   fv, NULL);
+    }
+}
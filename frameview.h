@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <gtk/gtk.h>
+#include "bytestore.h"
+#include "decoder.h"
+
+/**
+ *  Lists frames decoded from received data, with a choice of protocol.
+ *  Frames refer to data in store. Only the newest FRAME_VIEW_ROWS frames
+ *  are listed. Freed when its widget is destroyed.
+ **/
+typedef struct _FrameView FrameView;
+
+#define FRAME_VIEW_ROWS 10000
+
+FrameView *frame_view_new(ByteStore *store);
+GtkWidget *frame_view_get_widget(FrameView *fv);
+FrameDecoder *frame_view_get_decoder(FrameView *fv);
+void frame_view_set_baudrate(FrameView *fv, guint baudrate);
+void frame_view_data_changed(FrameView *fv);
+
+#endif /* FRAMEVIEW_H */
@@ -14,424 +14,155 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses>.
  */
 
-#include <stdio.h>
 #include <gtk/gtk.h>
-#include <gio/gio.h>
-#include <string.h>
-#include <unistd.h>
-#include <hex-document.h>
 #include "guart.h"
 #include "conf.h"
-#include "serial.h"
+#include "session.h"
+#include "fileview.h"
 
 static GtkWidget *window = NULL;
-static GtkWidget *view;
-static GtkWidget *lbl_cfg;
-static GtkWidget *btn_cfg;
-static GtkWidget *btn_connect;
-static GtkTextBuffer *databuffer;
-#ifdef HAVE_LIBGTKHEX
-static HexDocument *hexdocument;
-#endif
-
-static GtkWidget *txt_dtr, *txt_dsr, *txt_rts, *txt_cts;
-
-static GIOChannel *serial_channel = NULL;
-static guint serial_channel_source;
-static int serial_fd;
+static GtkWidget *sessions;
+static IoStatsDump *stats_dump = NULL;
 
 void destroy(void)
 {
-    if (serial_channel != NULL)
-    {
-        g_source_remove(serial_channel_source);
-        serial_channel = NULL;
-    }
-
     gtk_main_quit();
 }
 
-static void cfg_button_cb(GtkButton *btn, gpointer data)
-{
-    configure(GTK_WIDGET(data), g_object_get_data(G_OBJECT(data), "cfg"));
-    gchar *conf = get_configuration_string(g_object_get_data(G_OBJECT(data), "cfg"));
-    g_message(conf);
-    gtk_label_set_text(GTK_LABEL(lbl_cfg), conf);
-    g_free(conf);
-}
-
-#define BUFF_SIZE 256
-
-gboolean serial_read_cb(GIOChannel *source, GIOCondition condition, gpointer data)
-{
-    if (condition == G_IO_IN || condition == G_IO_PRI)
-    {
-        GtkTextIter iter;
-        GtkTextMark *mark;
-        gchar c[BUFF_SIZE];
-        gint bytes_read = read(serial_fd, c, BUFF_SIZE);
-
-        gtk_text_buffer_get_end_iter(databuffer, &iter);
-        gtk_text_buffer_insert(databuffer, &iter, c, bytes_read);
-
-        /* scroll to end */
-        mark = gtk_text_buffer_get_insert(databuffer);
-        gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(view), mark);
-
-#ifdef HAVE_LIBGTKHEX
-        hex_document_set_data(hexdocument, hexdocument->file_size,
-                              bytes_read, 0 /* rep_len? */, (guchar*)c, FALSE);
-#endif
-    }
-
-    return TRUE;
-}
-
-static void serial_detach_notify(gpointer data)
-{
-
-}
-
-static inline void check_line_change(gchar current, gchar previous, GtkWidget *w)
-{
-    if (current != previous)
-    {
-        previous = current;
-        gtk_label_set_text(GTK_LABEL(w), current ? "High" : "Low");
-    }
-}
-
 /**
- *  Checks DTR, DSR, RTS and CTS lines for change.
- *  Updates appropriate labels (prev_dtr, prev_dsr, prev_rts, prev_cts) if needed.
- *  create_control_line_widgets() *must* be called prior to this function.
- *  Supposed to be called as idle source.
- *
- *  \return FALSE if not connected to any
+ *  Opens new session tab. Configuration is copied from current session,
+ *  if there is one.
  **/
-static gboolean update_control_lines_cb(gpointer data)
-{
-    static gchar prev_dtr = -1, prev_dsr = -1, prev_rts = -1, prev_cts = -1;
-    gchar dtr, dsr, rts, cts;
-
-    if (serial_channel == NULL)
-        return FALSE;
-
-    if (get_control_lines(serial_fd, &dtr, &dsr, &rts, &cts) == FALSE)
-        return FALSE;
-
-    check_line_change(dtr, prev_dtr, txt_dtr);
-    check_line_change(dsr, prev_dsr, txt_dsr);
-    check_line_change(rts, prev_rts, txt_rts);
-    check_line_change(cts, prev_cts, txt_cts);
-
-    return TRUE;
-}
-
-static void connect_button_cb(GtkButton *btn, gpointer data)
+static void add_session(Configuration *template)
 {
-    Configuration *cfg = g_object_get_data(G_OBJECT(data), "cfg");
+    Configuration *cfg = configuration_new();
+    Session *session;
+    gint page;
 
-    if (gtk_widget_is_sensitive(btn_cfg) == TRUE)
+    if (template != NULL)
     {
-        /* Connect to serial port */
-        if (serial_channel)
-        {
-            g_io_channel_unref(serial_channel);
-        }
-        serial_channel = serial_connect(cfg, &serial_fd);
-
-        if (serial_channel == NULL)
-        {
-            g_message("Unable to connect");
-            return;
-        }
-
-        serial_channel_source =
-            g_io_add_watch_full(serial_channel, G_PRIORITY_DEFAULT, G_IO_IN | G_IO_PRI,
-                                serial_read_cb, NULL, serial_detach_notify);
-        g_io_channel_unref(serial_channel);
-
-        g_idle_add_full(G_PRIORITY_LOW, update_control_lines_cb, NULL, NULL);
-
-        gtk_widget_set_sensitive(btn_cfg, FALSE);
-        gtk_button_set_label(btn, "Disconnect");
+        g_free(cfg->port);
+        g_free(cfg->terminator);
+        configuration_copy(cfg, template);
     }
     else
     {
-        /* Disconnect from serial port */
-        if (serial_channel != NULL)
-        {
-            g_source_remove(serial_channel_source);
-            serial_channel = NULL;
-        }
-        gtk_widget_set_sensitive(btn_cfg, TRUE);
-        gtk_button_set_label(btn, "Connect");
+        /* TODO: save last used settings */
+        cfg->port = g_strdup("/dev/ttyUSB0");
+        cfg->terminator = g_strdup_printf("%c", 0x0A); /* LF */
+        cfg->n_terminator_chars = 1;
     }
+
+    session = session_new(GTK_WINDOW(window), cfg);
+    session_set_stats_dump(session, stats_dump);
+    gtk_widget_show_all(session_get_widget(session));
+    page = gtk_notebook_append_page(GTK_NOTEBOOK(sessions), session_get_widget(session),
+                                    session_get_tab_label(session));
+    gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(sessions), session_get_widget(session), TRUE);
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(sessions), page);
+    g_object_set_data(G_OBJECT(session_get_widget(session)), "session", session);
 }
 
-static void send_button_cb(GtkButton *btn, GtkWidget *window)
+static void new_session_button_cb(GtkButton *btn, gpointer data)
 {
-    GtkWidget *entry = GTK_WIDGET(g_object_get_data(G_OBJECT(window), "entry"));
-    Configuration *cfg = (Configuration*)g_object_get_data(G_OBJECT(window), "cfg");
+    gint page = gtk_notebook_get_current_page(GTK_NOTEBOOK(sessions));
+    Session *current = NULL;
 
-    if (serial_channel != NULL)
+    if (page >= 0)
     {
-        const gchar *entry_text = gtk_entry_get_text(GTK_ENTRY(entry));
-        gint entry_text_length = strlen(entry_text);
-        gint i;
+        GtkWidget *child = gtk_notebook_get_nth_page(GTK_NOTEBOOK(sessions), page);
 
-        if (entry_text_length == 0)
-        {
-            return;
-        }
-
-        /* create send data buffer (includes terminator characters) */
-        gchar *data = g_malloc(entry_text_length + cfg->n_terminator_chars);
-        memcpy((void*)data, (void*)entry_text, entry_text_length);
-        for (i = 0; i<cfg->n_terminator_chars; i++)
-        {
-            data[entry_text_length+i] = cfg->terminator[i];
-        }
-
-        i = write(serial_fd, data, entry_text_length + cfg->n_terminator_chars);
-#ifdef DEBUG
-        for (i=0;i<entry_text_length+cfg->n_terminator_chars;i++)
-            printf("%02x ", data[i]);
-        printf("\n");
-        g_message("Wrote %d bytes", i);
-#endif
-        g_free(data);
-
-        gtk_entry_set_text(GTK_ENTRY(entry), "");
+        current = g_object_get_data(G_OBJECT(child), "session");
     }
-}
 
-static void
-entry_cb(GtkEntry *entry, GtkWidget *window)
-{
-    send_button_cb(NULL, window);
+    add_session(current != NULL ? session_get_configuration(current) : NULL);
 }
 
-static gboolean
-show_menu_cb(GtkWidget *widget, GdkEvent *event)
+static void open_button_cb(GtkButton *btn, GtkWidget *window)
 {
-    GtkMenu *menu;
+    GtkWidget *dialog;
 
-    g_return_val_if_fail(widget != NULL, FALSE);
-    g_return_val_if_fail(GTK_IS_MENU(widget), FALSE);
-    g_return_val_if_fail(event != NULL, FALSE);
+    dialog = gtk_file_chooser_dialog_new("Open capture", GTK_WINDOW(window),
+                                         GTK_FILE_CHOOSER_ACTION_OPEN,
+                                         GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+                                         NULL);
 
-    if (serial_channel == NULL)
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
     {
-        /* there's no point in showing menu if we're not connected to any tty */
-        return FALSE;
-    }
-
-    menu = GTK_MENU (widget);
-    if (event->type == GDK_BUTTON_PRESS)
-    {
-        GdkEventButton *event_button = (GdkEventButton *) event;
-        if (event_button->button == 3)
-        {
-            gtk_menu_popup(GTK_MENU(menu), NULL, NULL, NULL, NULL,
-                           event_button->button, event_button->time);
-            return TRUE;
-        }
-    }
-    return FALSE;
-}
-
-static void status_line_menu_item_cb(GtkMenuItem *item, gpointer data)
-{
-    gint state = GPOINTER_TO_INT(data);
-    void (*callback)(int fd, gchar state) = g_object_get_data(G_OBJECT(item), "callback");
+        gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
 
-    if (serial_channel == NULL)
-    {
-        /* not connected to any tty */
-        return;
-    }
-    if (callback != NULL)
-    {
-        callback(serial_fd, (gchar)state);
+        file_view_open(GTK_WINDOW(window), filename);
+        g_free(filename);
     }
+    gtk_widget_destroy(dialog);
 }
 
-static void create_control_line_widget(GtkWidget *box, gchar *lbl,
-                                       GtkWidget **widget, gchar *menu_lbl,
-                                       void (*callback)(int fd, gchar state))
-{
-    GtkWidget *label;
-
-    if (callback != NULL)
-    {
-        /* pack label inside GtkEventBox, so we can get button press event */
-        label = gtk_event_box_new();
-        GtkWidget *text = gtk_label_new(lbl);
-        gtk_container_add(GTK_CONTAINER(label), text);
-    }
-    else
+int main(int argc, char *argv[]) {
+    GtkWidget *vbox;
+    GtkWidget *hbox_buttons;
+    GtkWidget *btn_new;
+    GtkWidget *btn_open;
+    gchar *stats_target = NULL;
+    GOptionEntry entries[] = {
+        {"stats", 's', 0, G_OPTION_ARG_FILENAME, &stats_target, "Write I/O statistics of connected ports every second, as JSON lines, to FILE or to clients of unix:SOCKET", "FILE"},
+        {NULL}
+    };
+    GError *error = NULL;
+
+    if (!gtk_init_with_args(&argc, &argv, "- serial port terminal", entries, NULL, &error))
     {
-        label = gtk_label_new(lbl);
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
     }
-    *widget = gtk_label_new(NULL);
-
-    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(box), *widget, FALSE, FALSE, 0);
 
-    if (callback != NULL && menu_lbl != NULL)
+    if (stats_target != NULL)
     {
-        /* prepare right click menu */
-        GtkWidget *menu = gtk_menu_new();
-        gchar *high = g_strdup_printf("Set %s high", menu_lbl);
-        gchar *low = g_strdup_printf("Set %s low", menu_lbl);
-
-        GtkWidget *i_high = gtk_menu_item_new_with_label(high);
-        GtkWidget *i_low = gtk_menu_item_new_with_label(low);
-
-        gtk_menu_shell_append(GTK_MENU_SHELL(menu), i_high);
-        gtk_menu_shell_append(GTK_MENU_SHELL(menu), i_low);
-
-        g_object_set_data(G_OBJECT(i_high), "callback", callback);
-        g_signal_connect(i_high, "activate",
-                         G_CALLBACK(status_line_menu_item_cb),
-                         GINT_TO_POINTER(1));
-
-        g_object_set_data(G_OBJECT(i_low), "callback", callback);
-        g_signal_connect(i_low, "activate",
-                         G_CALLBACK(status_line_menu_item_cb),
-                         GINT_TO_POINTER(0));
-
-        g_signal_connect_swapped(label, "button-press-event",
-                                 G_CALLBACK(show_menu_cb), menu);
-
-        g_free(high);
-        g_free(low);
-
-        /*
-           show menu widgets now, so later just gtk_menu_popup() will suffice
-        */
-        gtk_widget_show_all(menu);
+        stats_dump = io_stats_dump_new(stats_target);
+        g_free(stats_target);
+        if (stats_dump == NULL)
+            return 1;
     }
-}
-
-static GtkWidget *create_control_line_widgets()
-{
-    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-    gtk_box_set_homogeneous(GTK_BOX(hbox), TRUE);
-
-    create_control_line_widget(hbox, "DTR:", &txt_dtr, "DTR", set_dtr);
-    create_control_line_widget(hbox, "DSR:", &txt_dsr, NULL, NULL);
-    create_control_line_widget(hbox, "RTS:", &txt_rts, "RTS", set_rts);
-    create_control_line_widget(hbox, "CTS:", &txt_cts, NULL, NULL);
-
-    return hbox;
-}
-
-int main(int argc, char *argv[]) {
-    GtkWidget *vbox;
-    GtkWidget *hbox_conf;
-    GtkWidget *scrolled_window;
-#ifdef HAVE_LIBGTKHEX
-    GtkWidget *hexview;
-    GtkWidget *notebook;
-#endif
-    GtkWidget *hbox_input;
-    GtkWidget *entry;
-    GtkWidget *btn_send;
-    GtkWidget *control_lines;
-    gchar *cfg_text;
-
-    Configuration *cfg = configuration_new();
-    /* TODO: save last used settings */
-    cfg->port = g_strdup("/dev/ttyUSB0");
-    cfg->terminator = g_strdup_printf("%c", 0x0A); /* LF */
-    cfg->n_terminator_chars = 1;
-
-    gtk_init(&argc, &argv);
 
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_widget_set_size_request(window, 650, 500);
     g_signal_connect(G_OBJECT(window), "destroy",
                      G_CALLBACK(destroy), NULL);
 
-    g_object_set_data_full(G_OBJECT(window), "cfg", cfg, (GDestroyNotify)configuration_free);
-
     vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     gtk_box_set_homogeneous(GTK_BOX(vbox), FALSE);
 
-    hbox_conf = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    gtk_box_set_homogeneous(GTK_BOX(hbox_conf), FALSE);
-
-    cfg_text = get_configuration_string(cfg);
-    lbl_cfg = gtk_label_new(cfg_text);
-    g_free(cfg_text);
-
-    btn_cfg = gtk_button_new_with_label("Configure");
-    btn_connect = gtk_button_new_with_label("Connect");
-
-    g_signal_connect(G_OBJECT(btn_cfg), "clicked",
-                     G_CALLBACK(cfg_button_cb), window);
-    g_signal_connect(G_OBJECT(btn_connect), "clicked",
-                     G_CALLBACK(connect_button_cb), window);
+    hbox_buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_buttons), FALSE);
 
-    gtk_box_pack_start(GTK_BOX(hbox_conf), lbl_cfg, TRUE, TRUE, 0);
-    gtk_box_pack_start(GTK_BOX(hbox_conf), btn_cfg, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(hbox_conf), btn_connect, FALSE, FALSE, 0);
+    btn_new = gtk_button_new_with_label("New session");
+    btn_open = gtk_button_new_with_label("Open capture");
 
-    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
-                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    databuffer = gtk_text_buffer_new(NULL);
-    view = gtk_text_view_new_with_buffer(databuffer);
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(view), FALSE);
-    gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(view), FALSE);
-    /* TODO: make this configurable */
-    PangoFontDescription *font_desc = pango_font_description_from_string("Monospace 10");
-    gtk_widget_modify_font(GTK_WIDGET(view), font_desc);
-    gtk_container_add(GTK_CONTAINER(scrolled_window), view);
+    g_signal_connect(G_OBJECT(btn_new), "clicked",
+                     G_CALLBACK(new_session_button_cb), NULL);
+    g_signal_connect(G_OBJECT(btn_open), "clicked",
+                     G_CALLBACK(open_button_cb), window);
 
-#ifdef HAVE_LIBGTKHEX
-    notebook = gtk_notebook_new();
-    hexdocument = hex_document_new();
-    hexview = hex_document_add_view(hexdocument);
-#endif
+    gtk_box_pack_start(GTK_BOX(hbox_buttons), btn_new, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_buttons), btn_open, FALSE, FALSE, 0);
 
-    hbox_input = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-    gtk_box_set_homogeneous(GTK_BOX(hbox_input), FALSE);
+    sessions = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(sessions), TRUE);
 
-    entry = gtk_entry_new();
-    btn_send = gtk_button_new_with_label("Send");
-    gtk_box_pack_start(GTK_BOX(hbox_input), entry, TRUE, TRUE, 0);
-    gtk_box_pack_start(GTK_BOX(hbox_input), btn_send, FALSE, FALSE, 0);
-
-    g_object_set_data(G_OBJECT(window), "entry", entry);
-    g_signal_connect(G_OBJECT(btn_send), "clicked",
-                     G_CALLBACK(send_button_cb), window);
-    g_signal_connect(G_OBJECT(entry), "activate",
-                     G_CALLBACK(entry_cb), window);
-
-    control_lines = create_control_line_widgets();
-
-    gtk_box_pack_start(GTK_BOX(vbox), hbox_conf, FALSE, FALSE, 0);
-#ifdef HAVE_LIBGTKHEX
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), scrolled_window,
-                             gtk_label_new("Text View"));
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), hexview,
-                             gtk_label_new("Hex View"));
-    gtk_box_pack_start(GTK_BOX(vbox), notebook, TRUE, TRUE, 0);
-#else
-    gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
-#endif
-    gtk_box_pack_start(GTK_BOX(vbox), hbox_input, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(vbox), control_lines, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox_buttons, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), sessions, TRUE, TRUE, 0);
 
     gtk_container_add(GTK_CONTAINER(window), vbox);
 
+    add_session(NULL);
+
     gtk_widget_show_all(window);
 
     gtk_main();
 
+    if (stats_dump != NULL)
+        io_stats_dump_free(stats_dump);
+
     return 0;
 }
@@ -17,6 +17,4 @@
 #ifndef GUART_H
 #define GUART_H
 
-#define HAVE_LIBGTKHEX
-
 #endif /* GUART_H */
@@ -0,0 +1,312 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+/*
+   Headless capture: opens serial port with the same settings code as guart
+   and streams everything received to a file or stdout, either raw or in
+   capture file format (see capture.h). Links only against GLib.
+*/
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include "conf.h"
+#include "serial.h"
+#include "capture.h"
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+static int stop_pipe[2] = {-1, -1};
+
+static void stop_signal_handler(int sig)
+{
+    char c = 0;
+
+    /* wake up poll(), main loop will notice and exit */
+    if (write(stop_pipe[1], &c, 1) < 0)
+        return;
+}
+
+static gboolean install_signal_handlers()
+{
+    if (pipe(stop_pipe) < 0)
+    {
+        g_message("pipe() failed: %s", strerror(errno));
+        return FALSE;
+    }
+    fcntl(stop_pipe[1], F_SETFL, O_NONBLOCK);
+
+    signal(SIGINT, stop_signal_handler);
+    signal(SIGTERM, stop_signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    return TRUE;
+}
+
+/**
+ *  Finds value in labels (case insensitive).
+ *
+ *  \return FALSE if value is not one of labels
+ **/
+static gboolean parse_label(const gchar *name, const gchar *value,
+                            gchar **labels, guint n_labels, gint *result)
+{
+    guint i;
+
+    if (value == NULL)
+        return TRUE;
+
+    for (i = 0; i < n_labels; i++)
+    {
+        if (g_ascii_strcasecmp(value, labels[i]) == 0)
+        {
+            *result = i;
+            return TRUE;
+        }
+    }
+
+    g_printerr("Invalid %s: %s\n", name, value);
+    return FALSE;
+}
+
+static gboolean write_all(int fd, const guint8 *data, gsize len)
+{
+    while (len > 0)
+    {
+        ssize_t ret = write(fd, data, len);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            g_message("Write failed: %s", strerror(errno));
+            return FALSE;
+        }
+
+        data += ret;
+        len -= ret;
+    }
+
+    return TRUE;
+}
+
+/**
+ *  Copies data from serial port until signal, hangup or write error.
+ *  Either out_fd or capture is used.
+ **/
+static void run(int serial_fd, int out_fd, CaptureWriter *capture)
+{
+    guint8 *buffer = g_malloc(READ_BUFFER_SIZE);
+    struct pollfd fds[2];
+
+    fds[0].fd = serial_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_pipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;)
+    {
+        ssize_t len;
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            g_message("poll() failed: %s", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents != 0)
+            break;
+
+        if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+            continue;
+
+        len = read(serial_fd, buffer, READ_BUFFER_SIZE);
+        if (len < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+
+            g_message("Read failed: %s", strerror(errno));
+            break;
+        }
+        else if (len == 0)
+        {
+            g_message("Serial port hangup");
+            break;
+        }
+
+        if (capture != NULL)
+        {
+            capture_writer_append(capture, CAPTURE_RX, g_get_monotonic_time(),
+                                  buffer, len);
+        }
+        else if (!write_all(out_fd, buffer, len))
+        {
+            break;
+        }
+    }
+
+    g_free(buffer);
+}
+
+int main(int argc, char *argv[])
+{
+    gchar *port = NULL;
+    gint baud = 0;
+    gchar *databits = NULL;
+    gchar *parity = NULL;
+    gchar *stopbits = NULL;
+    gchar *flow = NULL;
+    gchar *output = NULL;
+    gboolean capture_format = FALSE;
+    gboolean low_latency = FALSE;
+    GOptionEntry entries[] = {
+        {"port", 'p', 0, G_OPTION_ARG_STRING, &port, "Serial port (default /dev/ttyUSB0)", "DEVICE"},
+        {"baud", 'b', 0, G_OPTION_ARG_INT, &baud, "Baud rate, any rate the port supports (default 115200)", "RATE"},
+        {"databits", 'd', 0, G_OPTION_ARG_STRING, &databits, "Data bits (5-8)", "BITS"},
+        {"parity", 'y', 0, G_OPTION_ARG_STRING, &parity, "Parity (Even, Odd, None)", "PARITY"},
+        {"stopbits", 's', 0, G_OPTION_ARG_STRING, &stopbits, "Stop bits (1, 2)", "BITS"},
+        {"flow", 'f', 0, G_OPTION_ARG_STRING, &flow, "Flow control (None, RTS/CTS, DTR/DSR, XON/XOFF)", "FLOW"},
+        {"low-latency", 'L', 0, G_OPTION_ARG_NONE, &low_latency, "Lower driver latency (low latency flag, USB latency timer)", NULL},
+        {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Output file (default stdout)", "FILE"},
+        {"capture", 'c', 0, G_OPTION_ARG_NONE, &capture_format, "Write capture file format instead of raw data", NULL},
+        {NULL}
+    };
+    GOptionContext *context;
+    GError *error = NULL;
+    Configuration *cfg;
+    GIOChannel *channel;
+    CaptureWriter *capture = NULL;
+    int serial_fd;
+    int out_fd = STDOUT_FILENO;
+    gint value;
+    gboolean valid = TRUE;
+
+    context = g_option_context_new("- capture serial port data without GUI");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    cfg = configuration_new();
+    cfg->port = g_strdup(port != NULL ? port : "/dev/ttyUSB0");
+    cfg->low_latency = low_latency;
+
+    if (baud < 0)
+    {
+        g_printerr("Invalid baud rate: %d\n", baud);
+        valid = FALSE;
+    }
+    else if (baud > 0)
+    {
+        cfg->rate = baud;
+    }
+    value = cfg->databits;
+    valid &= parse_label("data bits", databits, databits_labels, n_databits_labels, &value);
+    cfg->databits = value;
+    value = cfg->parity;
+    valid &= parse_label("parity", parity, parity_labels, n_parity_labels, &value);
+    cfg->parity = value;
+    value = cfg->stopbits;
+    valid &= parse_label("stop bits", stopbits, stopbits_labels, n_stopbits_labels, &value);
+    cfg->stopbits = value;
+    value = cfg->flow;
+    valid &= parse_label("flow control", flow, flow_labels, n_flow_labels, &value);
+    cfg->flow = value;
+
+    if (capture_format && (output == NULL || strcmp(output, "-") == 0))
+    {
+        g_printerr("Capture format needs an output file\n");
+        valid = FALSE;
+    }
+
+    if (!valid || !install_signal_handlers())
+    {
+        configuration_free(cfg);
+        return 1;
+    }
+
+    if (capture_format)
+    {
+        capture = capture_writer_new(output);
+        if (capture == NULL)
+        {
+            configuration_free(cfg);
+            return 1;
+        }
+    }
+    else if (output != NULL && strcmp(output, "-") != 0)
+    {
+        out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            g_printerr("Unable to open %s: %s\n", output, strerror(errno));
+            configuration_free(cfg);
+            return 1;
+        }
+    }
+
+    channel = serial_connect(cfg, &serial_fd);
+    if (channel != NULL)
+    {
+        gchar *cfg_text = get_configuration_string(cfg);
+
+        g_message("Capturing from %s", cfg_text);
+        g_free(cfg_text);
+
+        run(serial_fd, out_fd, capture);
+        serial_restore(serial_fd);
+        g_io_channel_unref(channel);
+    }
+
+    if (capture != NULL)
+    {
+        if (capture_writer_get_dropped(capture) > 0)
+        {
+            g_message("%" G_GSIZE_FORMAT " bytes dropped, disk too slow",
+                      capture_writer_get_dropped(capture));
+        }
+        capture_writer_close(capture);
+    }
+    else if (out_fd != STDOUT_FILENO)
+    {
+        close(out_fd);
+    }
+
+    configuration_free(cfg);
+    g_free(port);
+    g_free(databits);
+    g_free(parity);
+    g_free(stopbits);
+    g_free(flow);
+    g_free(output);
+
+    return channel != NULL ? 0 : 1;
+}
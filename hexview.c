@@ -0,0 +1,480 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "hexview.h"
+#include "bytestore.h"
+#include "display.h"
+
+#define BYTES_PER_ROW 16
+#define SCROLL_ROWS 3
+
+struct _HexView {
+    const HexViewSource *source;
+    gpointer data;
+
+    GtkWidget *box;
+    GtkWidget *area;
+    GtkAdjustment *adjustment; /* in rows, row 0 is at offset 0 */
+
+    PangoFontDescription *font;
+    gint row_height;
+    gint char_width;
+
+    guint tick_id; /* pending hex_view_data_changed() update */
+    gboolean follow; /* stay at the end when data is added */
+
+    const SearchMatch *matches; /* highlighted, ordered by offset */
+    guint n_matches;
+    guint current;
+
+    TimeIndex *times; /* arrival of data, shown on hover, may be NULL */
+};
+
+static gboolean hex_view_is_at_end(HexView *hv)
+{
+    gdouble value = gtk_adjustment_get_value(hv->adjustment);
+    gdouble page = gtk_adjustment_get_page_size(hv->adjustment);
+
+    if (!hv->follow)
+        return FALSE;
+
+    return value + page >= gtk_adjustment_get_upper(hv->adjustment) - 0.5;
+}
+
+static void hex_view_update_range(HexView *hv, gboolean follow)
+{
+    guint64 start = hv->source->get_start(hv->data);
+    guint64 end = hv->source->get_end(hv->data);
+    gdouble lower = (gdouble)(start / BYTES_PER_ROW);
+    gdouble upper = (gdouble)((end + BYTES_PER_ROW - 1) / BYTES_PER_ROW);
+    gdouble page = gtk_adjustment_get_page_size(hv->adjustment);
+    gdouble value = gtk_adjustment_get_value(hv->adjustment);
+
+    if (follow)
+        value = upper - page;
+
+    gtk_adjustment_configure(hv->adjustment, MAX(value, lower), lower, upper,
+                             1, MAX(page - 1, 1), page);
+}
+
+/**
+ *  \return index in str where hex bytes of row start
+ **/
+static gsize format_row(GString *str, guint64 offset, const guint8 *row, gsize len)
+{
+    gsize hex_start;
+    gsize i;
+
+    g_string_append_printf(str, "%08" G_GINT64_MODIFIER "X  ", offset);
+    hex_start = str->len;
+
+    for (i = 0; i < BYTES_PER_ROW; i++)
+    {
+        if (i < len)
+            g_string_append_printf(str, "%02X ", row[i]);
+        else
+            g_string_append(str, "   ");
+
+        if (i == BYTES_PER_ROW / 2 - 1)
+            g_string_append_c(str, ' ');
+    }
+
+    g_string_append_c(str, ' ');
+    for (i = 0; i < len; i++)
+    {
+        g_string_append_c(str, g_ascii_isprint(row[i]) ? row[i] : '.');
+    }
+    g_string_append_c(str, '\n');
+
+    return hex_start;
+}
+
+static void add_highlight(PangoAttrList *attrs, guint start, guint end, gboolean current)
+{
+    PangoAttribute *attr;
+
+    if (current)
+        attr = pango_attr_background_new(0xFFFF, 0xA5A5, 0);
+    else
+        attr = pango_attr_background_new(0xFFFF, 0xFFFF, 0);
+    attr->start_index = start;
+    attr->end_index = end;
+    pango_attr_list_insert(attrs, attr);
+
+    attr = pango_attr_foreground_new(0, 0, 0);
+    attr->start_index = start;
+    attr->end_index = end;
+    pango_attr_list_insert(attrs, attr);
+}
+
+/**
+ *  Highlights matches overlapping row in both hex and ASCII columns.
+ *  All row text is ASCII, so byte indexes equal character indexes.
+ **/
+static void highlight_row(HexView *hv, PangoAttrList *attrs, gsize hex_start,
+                          guint64 offset, gsize len)
+{
+    gsize ascii_start = hex_start + BYTES_PER_ROW * 3 + 2;
+    guint lo = 0, hi = hv->n_matches;
+
+    /* first match ending after row start */
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (hv->matches[mid].offset + hv->matches[mid].len <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < hv->n_matches && hv->matches[lo].offset < offset + len; lo++)
+    {
+        const SearchMatch *m = &hv->matches[lo];
+        gsize first = m->offset > offset ? m->offset - offset : 0;
+        gsize last = MIN(m->offset + m->len - offset, len) - 1;
+
+        add_highlight(attrs, hex_start + first * 3 + (first >= BYTES_PER_ROW / 2),
+                      hex_start + last * 3 + 2 + (last >= BYTES_PER_ROW / 2),
+                      lo == hv->current);
+        add_highlight(attrs, ascii_start + first, ascii_start + last + 1,
+                      lo == hv->current);
+    }
+}
+
+static gboolean hex_view_draw_cb(GtkWidget *widget, cairo_t *cr, HexView *hv)
+{
+    GtkStyleContext *context = gtk_widget_get_style_context(widget);
+    guint64 start = hv->source->get_start(hv->data);
+    guint64 end = hv->source->get_end(hv->data);
+    guint64 first_row = (guint64)gtk_adjustment_get_value(hv->adjustment);
+    gint rows = gtk_widget_get_allocated_height(widget) / hv->row_height + 1;
+    guint8 buf[BYTES_PER_ROW * 256];
+    GString *text;
+    PangoLayout *layout;
+    PangoAttrList *attrs;
+    GdkRGBA color;
+    guint64 offset;
+    gsize len;
+    gint i;
+
+    gtk_render_background(context, cr, 0, 0,
+                          gtk_widget_get_allocated_width(widget),
+                          gtk_widget_get_allocated_height(widget));
+
+    rows = MIN(rows, (gint)(sizeof(buf) / BYTES_PER_ROW));
+    offset = MAX(first_row * BYTES_PER_ROW, start);
+    offset -= offset % BYTES_PER_ROW;
+
+    if (offset >= end)
+        return FALSE;
+
+    /* fetch only what is visible */
+    len = hv->source->read(hv->data, offset, buf,
+                           MIN((guint64)rows * BYTES_PER_ROW, end - offset));
+
+    text = g_string_sized_new(rows * 80);
+    attrs = pango_attr_list_new();
+    for (i = 0; (gsize)i * BYTES_PER_ROW < len; i++)
+    {
+        gsize row_len = MIN(BYTES_PER_ROW, len - i * BYTES_PER_ROW);
+        gsize hex_start = format_row(text, offset + i * BYTES_PER_ROW,
+                                     buf + i * BYTES_PER_ROW, row_len);
+
+        if (hv->n_matches > 0)
+            highlight_row(hv, attrs, hex_start, offset + i * BYTES_PER_ROW, row_len);
+    }
+
+    layout = gtk_widget_create_pango_layout(widget, NULL);
+    pango_layout_set_font_description(layout, hv->font);
+    pango_layout_set_text(layout, text->str, text->len);
+    pango_layout_set_attributes(layout, attrs);
+    pango_attr_list_unref(attrs);
+
+    gtk_style_context_get_color(context, gtk_widget_get_state_flags(widget), &color);
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_move_to(cr, 2, 0);
+    pango_cairo_show_layout(cr, layout);
+
+    g_object_unref(layout);
+    g_string_free(text, TRUE);
+
+    return FALSE;
+}
+
+/**
+ *  Finds byte under point of drawing area, in either column.
+ *
+ *  \return FALSE if there is none
+ **/
+static gboolean hex_view_offset_at(HexView *hv, gint x, gint y, guint64 *offset)
+{
+    guint64 row = (guint64)gtk_adjustment_get_value(hv->adjustment) + y / hv->row_height;
+    guint64 row_offset = row * BYTES_PER_ROW;
+    /* see format_row(), offset has at least 8 digits */
+    gchar *prefix = g_strdup_printf("%08" G_GINT64_MODIFIER "X  ", row_offset);
+    gint col = (x - 2) / hv->char_width;
+    gint hex_start = strlen(prefix);
+    gint ascii_start = hex_start + BYTES_PER_ROW * 3 + 2;
+    gint i;
+
+    g_free(prefix);
+    if (x < 2)
+        return FALSE;
+
+    for (i = 0; i < BYTES_PER_ROW; i++)
+    {
+        gint first = hex_start + i * 3 + (i >= BYTES_PER_ROW / 2);
+
+        if ((col >= first && col < first + 2) || col == ascii_start + i)
+        {
+            *offset = row_offset + i;
+            return *offset >= hv->source->get_start(hv->data) &&
+                   *offset < hv->source->get_end(hv->data);
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ *  Shows when byte under pointer arrived and the gap before its chunk.
+ **/
+static gboolean hex_view_query_tooltip_cb(GtkWidget *widget, gint x, gint y,
+                                          gboolean keyboard_mode, GtkTooltip *tooltip,
+                                          HexView *hv)
+{
+    guint64 offset;
+    TimeChunk chunk;
+    gchar *time;
+    gchar *gap;
+    gchar *text;
+
+    if (hv->times == NULL || keyboard_mode || !hex_view_offset_at(hv, x, y, &offset) ||
+        !time_index_find(hv->times, offset, &chunk))
+    {
+        return FALSE;
+    }
+
+    time = display_format_time(chunk.monotonic);
+    gap = chunk.gap < 0 ? g_strdup("-") : display_format_gap(chunk.gap);
+    text = g_strdup_printf("Offset %08" G_GINT64_MODIFIER "X received %s\n"
+                           "Read of %" G_GSIZE_FORMAT " bytes at %08" G_GINT64_MODIFIER "X\n"
+                           "Since previous read: %s",
+                           offset, time, chunk.len, chunk.offset, gap);
+    gtk_tooltip_set_text(tooltip, text);
+
+    g_free(text);
+    g_free(gap);
+    g_free(time);
+
+    return TRUE;
+}
+
+static void hex_view_size_allocate_cb(GtkWidget *widget, GdkRectangle *allocation,
+                                      HexView *hv)
+{
+    gboolean follow = hex_view_is_at_end(hv);
+
+    gtk_adjustment_set_page_size(hv->adjustment,
+                                 MAX(allocation->height / hv->row_height, 1));
+    hex_view_update_range(hv, follow);
+}
+
+static gboolean hex_view_scroll_cb(GtkWidget *widget, GdkEventScroll *event,
+                                   HexView *hv)
+{
+    gdouble delta;
+    gdouble value = gtk_adjustment_get_value(hv->adjustment);
+
+    switch (event->direction)
+    {
+        case GDK_SCROLL_UP: delta = -SCROLL_ROWS; break;
+        case GDK_SCROLL_DOWN: delta = SCROLL_ROWS; break;
+        case GDK_SCROLL_SMOOTH: delta = event->delta_y * SCROLL_ROWS; break;
+        default: return FALSE;
+    }
+
+    value = CLAMP(value + delta, gtk_adjustment_get_lower(hv->adjustment),
+                  gtk_adjustment_get_upper(hv->adjustment) -
+                  gtk_adjustment_get_page_size(hv->adjustment));
+    gtk_adjustment_set_value(hv->adjustment, value);
+
+    return TRUE;
+}
+
+static void hex_view_value_changed_cb(GtkAdjustment *adjustment, HexView *hv)
+{
+    gtk_widget_queue_draw(hv->area);
+}
+
+static void hex_view_destroy_cb(GtkWidget *widget, HexView *hv)
+{
+    if (hv->tick_id != 0)
+        gtk_widget_remove_tick_callback(hv->area, hv->tick_id);
+    pango_font_description_free(hv->font);
+    g_object_unref(hv->adjustment);
+    g_slice_free(HexView, hv);
+}
+
+HexView *hex_view_new(const HexViewSource *source, gpointer data)
+{
+    HexView *hv = g_slice_new0(HexView);
+    GtkWidget *scrollbar;
+    PangoLayout *layout;
+
+    hv->source = source;
+    hv->data = data;
+    hv->follow = TRUE;
+
+    hv->adjustment = gtk_adjustment_new(0, 0, 0, 1, 1, 1);
+    g_object_ref_sink(hv->adjustment);
+
+    hv->box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hv->box), FALSE);
+    hv->area = gtk_drawing_area_new();
+    scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, hv->adjustment);
+    gtk_box_pack_start(GTK_BOX(hv->box), hv->area, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hv->box), scrollbar, FALSE, FALSE, 0);
+
+    hv->font = display_font_new();
+    layout = gtk_widget_create_pango_layout(hv->area, "0");
+    pango_layout_set_font_description(layout, hv->font);
+    pango_layout_get_pixel_size(layout, &hv->char_width, &hv->row_height);
+    hv->row_height = MAX(hv->row_height, 1);
+    hv->char_width = MAX(hv->char_width, 1);
+    g_object_unref(layout);
+
+    gtk_widget_add_events(hv->area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+
+    g_signal_connect(G_OBJECT(hv->area), "draw",
+                     G_CALLBACK(hex_view_draw_cb), hv);
+    g_signal_connect(G_OBJECT(hv->area), "size-allocate",
+                     G_CALLBACK(hex_view_size_allocate_cb), hv);
+    g_signal_connect(G_OBJECT(hv->area), "scroll-event",
+                     G_CALLBACK(hex_view_scroll_cb), hv);
+    g_signal_connect(G_OBJECT(hv->area), "query-tooltip",
+                     G_CALLBACK(hex_view_query_tooltip_cb), hv);
+    g_signal_connect(G_OBJECT(hv->adjustment), "value-changed",
+                     G_CALLBACK(hex_view_value_changed_cb), hv);
+    g_signal_connect(G_OBJECT(hv->box), "destroy",
+                     G_CALLBACK(hex_view_destroy_cb), hv);
+
+    return hv;
+}
+
+static guint64 store_get_start(gpointer data)
+{
+    return byte_store_get_start((ByteStore*)data);
+}
+
+static guint64 store_get_end(gpointer data)
+{
+    return byte_store_get_end((ByteStore*)data);
+}
+
+static gsize store_read(gpointer data, guint64 offset, guint8 *buf, gsize len)
+{
+    return byte_store_read((ByteStore*)data, offset, buf, len);
+}
+
+static const HexViewSource byte_store_source = {
+    store_get_start,
+    store_get_end,
+    store_read,
+};
+
+HexView *hex_view_new_for_store(ByteStore *store)
+{
+    return hex_view_new(&byte_store_source, store);
+}
+
+GtkWidget *hex_view_get_widget(HexView *hv)
+{
+    return hv->box;
+}
+
+/**
+ *  Sets whether view showing the end keeps showing it as data is added.
+ **/
+void hex_view_set_follow(HexView *hv, gboolean follow)
+{
+    hv->follow = follow;
+}
+
+/**
+ *  Highlights matches, current one differently. matches must be ordered
+ *  by offset and stay valid until highlights are replaced; NULL clears
+ *  highlights.
+ **/
+void hex_view_set_highlights(HexView *hv, const SearchMatch *matches,
+                             guint n_matches, guint current)
+{
+    hv->matches = matches;
+    hv->n_matches = matches != NULL ? n_matches : 0;
+    hv->current = current;
+    gtk_widget_queue_draw(hv->area);
+}
+
+/**
+ *  Shows arrival time of byte under pointer from times, whose offsets
+ *  must match those of source. NULL turns it off.
+ **/
+void hex_view_set_time_index(HexView *hv, TimeIndex *times)
+{
+    hv->times = times;
+    gtk_widget_set_has_tooltip(hv->area, times != NULL);
+}
+
+/**
+ *  Scrolls so that row holding offset is in the middle of the view.
+ **/
+void hex_view_scroll_to(HexView *hv, guint64 offset)
+{
+    gdouble page = gtk_adjustment_get_page_size(hv->adjustment);
+    gdouble row = (gdouble)(offset / BYTES_PER_ROW);
+
+    hex_view_update_range(hv, FALSE);
+    gtk_adjustment_set_value(hv->adjustment,
+                             CLAMP(row - page / 2, gtk_adjustment_get_lower(hv->adjustment),
+                                   gtk_adjustment_get_upper(hv->adjustment) - page));
+}
+
+static gboolean hex_view_tick_cb(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    HexView *hv = (HexView*)data;
+
+    hv->tick_id = 0;
+    hex_view_update_range(hv, hex_view_is_at_end(hv));
+    gtk_widget_queue_draw(hv->area);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ *  Must be called after data was added to source. The view is updated on
+ *  next frame, staying at the end if it was showing the end.
+ **/
+void hex_view_data_changed(HexView *hv)
+{
+    if (hv->tick_id == 0)
+    {
+        hv->tick_id = gtk_widget_add_tick_callback(hv->area, hex_view_tick_cb,
+                                                   hv, NULL);
+    }
+}
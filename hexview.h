@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef HEXVIEW_H
+#define HEXVIEW_H
+
+#include <gtk/gtk.h>
+#include "bytestore.h"
+#include "search.h"
+#include "timeindex.h"
+
+/**
+ *  Where hex view takes its data from. Offsets are absolute, data between
+ *  get_start() and get_end() must be readable with read().
+ **/
+typedef struct {
+    guint64 (*get_start)(gpointer data);
+    guint64 (*get_end)(gpointer data);
+    gsize (*read)(gpointer data, guint64 offset, guint8 *buf, gsize len);
+} HexViewSource;
+
+/**
+ *  Hex/ASCII viewer that only renders rows currently visible, so its cost
+ *  does not depend on amount of data shown. Freed when its widget is destroyed.
+ **/
+typedef struct _HexView HexView;
+
+HexView *hex_view_new(const HexViewSource *source, gpointer data);
+HexView *hex_view_new_for_store(ByteStore *store);
+GtkWidget *hex_view_get_widget(HexView *hv);
+void hex_view_set_follow(HexView *hv, gboolean follow);
+
+void hex_view_data_changed(HexView *hv);
+void hex_view_set_highlights(HexView *hv, const SearchMatch *matches,
+                             guint n_matches, guint current);
+void hex_view_scroll_to(HexView *hv, guint64 offset);
+void hex_view_set_time_index(HexView *hv, TimeIndex *times);
+
+#endif /* HEXVIEW_H */
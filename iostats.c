@@ -0,0 +1,280 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+/* for lstat() and S_ISSOCK */
+#define _GNU_SOURCE
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "iostats.h"
+
+#define UNIX_PREFIX "unix:"
+#define MAX_CLIENTS 16
+
+struct _IoStatsDump {
+    int fd;            /* output file, or listening socket */
+    gboolean is_socket;
+    gchar *path;
+    guint accept_id;
+    GSList *clients;   /* of GINT_TO_POINTER(fd) */
+};
+
+static gdouble per_second(gsize value, gsize prev, gint64 interval)
+{
+    if (interval <= 0)
+        return 0;
+
+    return (value - prev) * (gdouble)G_USEC_PER_SEC / interval;
+}
+
+/**
+ *  Computes rates between two snapshots. prev may be NULL, rates are
+ *  zero then.
+ **/
+void io_stats_get_rates(const IoStats *stats, const IoStats *prev, IoRates *rates)
+{
+    gint64 interval;
+
+    memset(rates, 0, sizeof(IoRates));
+    if (prev == NULL)
+        return;
+
+    interval = stats->time - prev->time;
+    rates->rx_bytes = per_second(stats->rx.bytes, prev->rx.bytes, interval);
+    rates->tx_bytes = per_second(stats->tx.written, prev->tx.written, interval);
+    rates->reads = per_second(stats->rx.reads, prev->rx.reads, interval);
+    if (stats->display_flushes > prev->display_flushes)
+    {
+        rates->lag_avg = (stats->lag_sum - prev->lag_sum) /
+                         (gint64)(stats->display_flushes - prev->display_flushes);
+    }
+}
+
+/**
+ *  Formats snapshot as single line JSON object, without newline.
+ *
+ *  \return newly allocated string
+ **/
+gchar *io_stats_to_json(const IoStats *stats, const IoStats *prev, const gchar *port)
+{
+    GString *str = g_string_sized_new(512);
+    IoRates rates;
+    const gchar *c;
+    guint i;
+
+    io_stats_get_rates(stats, prev, &rates);
+
+    g_string_append(str, "{\"port\":\"");
+    for (c = port; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            g_string_append_c(str, '\\');
+        g_string_append_c(str, *c);
+    }
+    g_string_append_printf(str, "\",\"time\":%" G_GINT64_FORMAT, g_get_real_time());
+
+    g_string_append_printf(str,
+        ",\"rx_bytes\":%" G_GSIZE_FORMAT ",\"rx_bytes_per_s\":%.0f"
+        ",\"reads\":%" G_GSIZE_FORMAT ",\"reads_per_s\":%.0f"
+        ",\"polls\":%" G_GSIZE_FORMAT ",\"ioctls\":%" G_GSIZE_FORMAT
+        ",\"overruns\":%" G_GSIZE_FORMAT ",\"ring_fill\":%" G_GSIZE_FORMAT,
+        stats->rx.bytes, rates.rx_bytes, stats->rx.reads, rates.reads,
+        stats->rx.polls, stats->rx.ioctls, stats->overruns, stats->ring_fill);
+
+    g_string_append(str, ",\"read_sizes\":[");
+    for (i = 0; i < READ_SIZE_BUCKETS; i++)
+    {
+        g_string_append_printf(str, "%s%" G_GSIZE_FORMAT, i > 0 ? "," : "",
+                               stats->rx.read_sizes[i]);
+    }
+    g_string_append_c(str, ']');
+
+    g_string_append_printf(str,
+        ",\"tx_bytes\":%" G_GSIZE_FORMAT ",\"tx_bytes_per_s\":%.0f"
+        ",\"tx_writes\":%" G_GSIZE_FORMAT ",\"tx_partial\":%" G_GSIZE_FORMAT
+        ",\"tx_dropped\":%" G_GSIZE_FORMAT ",\"tx_depth\":%" G_GSIZE_FORMAT,
+        stats->tx.written, rates.tx_bytes, stats->tx.writes, stats->tx.partial,
+        stats->tx.dropped, stats->tx_depth);
+
+    g_string_append_printf(str,
+        ",\"display_bytes\":%" G_GUINT64_FORMAT ",\"display_pending\":%" G_GSIZE_FORMAT
+        ",\"lag_us\":%" G_GINT64_FORMAT ",\"lag_avg_us\":%" G_GINT64_FORMAT
+        ",\"lag_max_us\":%" G_GINT64_FORMAT "}",
+        stats->display_flushed, stats->display_pending,
+        stats->lag_last, rates.lag_avg, stats->lag_max);
+
+    return g_string_free(str, FALSE);
+}
+
+static void io_stats_dump_drop_client(IoStatsDump *dump, int fd)
+{
+    dump->clients = g_slist_remove(dump->clients, GINT_TO_POINTER(fd));
+    close(fd);
+}
+
+static gboolean io_stats_dump_accept_cb(GIOChannel *source, GIOCondition condition,
+                                        gpointer data)
+{
+    IoStatsDump *dump = (IoStatsDump*)data;
+    int fd = accept(dump->fd, NULL, NULL);
+
+    if (fd < 0)
+        return TRUE;
+
+    if (g_slist_length(dump->clients) >= MAX_CLIENTS)
+    {
+        close(fd);
+        return TRUE;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    dump->clients = g_slist_prepend(dump->clients, GINT_TO_POINTER(fd));
+
+    return TRUE;
+}
+
+static gboolean io_stats_dump_listen(IoStatsDump *dump)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    GIOChannel *channel;
+
+    if (strlen(dump->path) >= sizeof(addr.sun_path))
+    {
+        g_message("Socket path too long: %s", dump->path);
+        return FALSE;
+    }
+
+    /* stale socket of previous run is replaced, anything else is kept */
+    if (lstat(dump->path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            g_message("%s exists and is not a socket", dump->path);
+            return FALSE;
+        }
+        unlink(dump->path);
+    }
+
+    dump->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (dump->fd < 0)
+    {
+        g_message("Unable to create socket: %s(%d)", strerror(errno), errno);
+        return FALSE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, dump->path);
+
+    if (bind(dump->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(dump->fd, MAX_CLIENTS) < 0)
+    {
+        g_message("Unable to listen on %s: %s(%d)", dump->path, strerror(errno), errno);
+        close(dump->fd);
+        return FALSE;
+    }
+
+    channel = g_io_channel_unix_new(dump->fd);
+    dump->accept_id = g_io_add_watch(channel, G_IO_IN, io_stats_dump_accept_cb, dump);
+    g_io_channel_unref(channel);
+
+    return TRUE;
+}
+
+/**
+ *  \return NULL on error
+ **/
+IoStatsDump *io_stats_dump_new(const gchar *target)
+{
+    IoStatsDump *dump = g_slice_new0(IoStatsDump);
+
+    if (g_str_has_prefix(target, UNIX_PREFIX))
+    {
+        dump->is_socket = TRUE;
+        dump->path = g_strdup(target + strlen(UNIX_PREFIX));
+        if (!io_stats_dump_listen(dump))
+        {
+            g_free(dump->path);
+            g_slice_free(IoStatsDump, dump);
+            return NULL;
+        }
+    }
+    else
+    {
+        dump->path = g_strdup(target);
+        dump->fd = open(target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (dump->fd < 0)
+        {
+            g_message("Unable to open %s: %s(%d)", target, strerror(errno), errno);
+            g_free(dump->path);
+            g_slice_free(IoStatsDump, dump);
+            return NULL;
+        }
+    }
+
+    return dump;
+}
+
+void io_stats_dump_free(IoStatsDump *dump)
+{
+    if (dump->is_socket)
+    {
+        while (dump->clients != NULL)
+            io_stats_dump_drop_client(dump, GPOINTER_TO_INT(dump->clients->data));
+        g_source_remove(dump->accept_id);
+        unlink(dump->path);
+    }
+
+    close(dump->fd);
+    g_free(dump->path);
+    g_slice_free(IoStatsDump, dump);
+}
+
+/**
+ *  Writes line followed by newline to file or to every connected client.
+ **/
+void io_stats_dump_write(IoStatsDump *dump, const gchar *line)
+{
+    gchar *text = g_strconcat(line, "\n", NULL);
+    gsize len = strlen(text);
+    GSList *l, *next;
+
+    if (!dump->is_socket)
+    {
+        if (write(dump->fd, text, len) != (ssize_t)len)
+            g_message("Unable to write statistics to %s", dump->path);
+        g_free(text);
+        return;
+    }
+
+    for (l = dump->clients; l != NULL; l = next)
+    {
+        int fd = GPOINTER_TO_INT(l->data);
+
+        next = l->next;
+
+        /* a client that does not read, or went away, is dropped */
+        if (send(fd, text, len, MSG_NOSIGNAL) != (ssize_t)len)
+            io_stats_dump_drop_client(dump, fd);
+    }
+    g_free(text);
+}
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <glib.h>
+#include "reader.h"
+#include "txqueue.h"
+
+/**
+ *  Snapshot of all I/O counters of one port. Counters only grow, rates
+ *  come from the difference of two snapshots. Taking one costs a few
+ *  atomic reads, so statistics can stay on all the time.
+ **/
+typedef struct {
+    gint64 time;              /* g_get_monotonic_time() of snapshot */
+    SerialReaderStats rx;
+    gsize overruns;
+    gsize ring_fill;          /* received, not yet taken by main loop */
+    TxQueueStats tx;
+    gsize tx_depth;
+    guint64 display_flushed;
+    gsize display_pending;    /* received, not yet shown */
+    guint64 display_flushes;
+    gint64 lag_last;          /* arrival to display, in us */
+    gint64 lag_max;
+    gint64 lag_sum;
+} IoStats;
+
+typedef struct {
+    gdouble rx_bytes;  /* per second */
+    gdouble tx_bytes;
+    gdouble reads;
+    gint64 lag_avg;    /* us, over flushes between snapshots */
+} IoRates;
+
+void io_stats_get_rates(const IoStats *stats, const IoStats *prev, IoRates *rates);
+gchar *io_stats_to_json(const IoStats *stats, const IoStats *prev, const gchar *port);
+
+/**
+ *  Sink for machine readable statistics, one JSON object per line.
+ *  Target is a file (appended to) or "unix:PATH", a listening unix socket
+ *  whose clients all get the lines. Clients that can't keep up are dropped.
+ *  Must be used from main thread.
+ **/
+typedef struct _IoStatsDump IoStatsDump;
+
+IoStatsDump *io_stats_dump_new(const gchar *target);
+void io_stats_dump_free(IoStatsDump *dump);
+void io_stats_dump_write(IoStatsDump *dump, const gchar *line);
+
+#endif /* IOSTATS_H */
@@ -0,0 +1,327 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "lineindex.h"
+
+/* delta that did not fit, entry is in overflow table */
+#define DELTA_ESCAPE G_MAXUINT32
+
+typedef struct {
+    guint64 offset; /* of first line in block */
+    gint64 time;
+    guint32 offset_delta[LINE_INDEX_BLOCK];
+    guint32 time_delta[LINE_INDEX_BLOCK];
+} LineBlock;
+
+typedef struct {
+    guint64 offset;
+    gint64 time;
+} LineEntry;
+
+struct _LineIndex {
+    guint8 *terminator;
+    gsize n_terminator;
+
+    /* last bytes before current data, for terminator split between appends */
+    guint8 *recent;
+    gsize n_recent;
+
+    guint64 end;        /* offset just after last appended byte */
+    gboolean line_open; /* last line got its first byte */
+
+    GPtrArray *blocks;
+    guint64 n_lines;
+    GHashTable *overflow; /* line number -> LineEntry */
+};
+
+static void line_index_add(LineIndex *index, guint64 offset, gint64 time)
+{
+    guint64 line = index->n_lines;
+    guint k = line % LINE_INDEX_BLOCK;
+    LineBlock *block;
+    guint64 offset_delta;
+    gint64 time_delta;
+
+    if (k == 0)
+    {
+        block = g_slice_new(LineBlock);
+        block->offset = offset;
+        block->time = time;
+        g_ptr_array_add(index->blocks, block);
+    }
+    else
+    {
+        block = g_ptr_array_index(index->blocks, index->blocks->len - 1);
+    }
+
+    offset_delta = offset - block->offset;
+    time_delta = time - block->time;
+    if (offset_delta >= DELTA_ESCAPE || time_delta < 0 || time_delta >= DELTA_ESCAPE)
+    {
+        /* line after a long pause or a huge line, rare enough for a hash table */
+        guint64 *key = g_new(guint64, 1);
+        LineEntry *entry = g_new(LineEntry, 1);
+
+        *key = line;
+        entry->offset = offset;
+        entry->time = time;
+        g_hash_table_insert(index->overflow, key, entry);
+
+        block->offset_delta[k] = DELTA_ESCAPE;
+        block->time_delta[k] = DELTA_ESCAPE;
+    }
+    else
+    {
+        block->offset_delta[k] = (guint32)offset_delta;
+        block->time_delta[k] = (guint32)time_delta;
+    }
+
+    index->n_lines++;
+}
+
+static void line_index_block_free(gpointer data)
+{
+    g_slice_free(LineBlock, data);
+}
+
+/**
+ *  Creates empty index splitting at terminator, or at '\n' if
+ *  n_terminator is 0.
+ **/
+LineIndex *line_index_new(const gchar *terminator, gsize n_terminator)
+{
+    LineIndex *index = g_slice_new0(LineIndex);
+
+    index->blocks = g_ptr_array_new_with_free_func(line_index_block_free);
+    index->overflow = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                            g_free, g_free);
+    line_index_set_terminator(index, terminator, n_terminator);
+
+    return index;
+}
+
+void line_index_free(LineIndex *index)
+{
+    g_ptr_array_free(index->blocks, TRUE);
+    g_hash_table_destroy(index->overflow);
+    g_free(index->terminator);
+    g_free(index->recent);
+    g_slice_free(LineIndex, index);
+}
+
+/**
+ *  Changes terminator for data appended from now on.
+ **/
+void line_index_set_terminator(LineIndex *index, const gchar *terminator,
+                               gsize n_terminator)
+{
+    if (n_terminator == 0)
+    {
+        terminator = "\n";
+        n_terminator = 1;
+    }
+
+    g_free(index->terminator);
+    g_free(index->recent);
+    index->terminator = g_malloc(n_terminator);
+    memcpy(index->terminator, terminator, n_terminator);
+    index->n_terminator = n_terminator;
+    index->recent = g_malloc(n_terminator);
+    index->n_recent = 0;
+}
+
+/**
+ *  \return TRUE if terminator ends at data[i]; bytes before data are
+ *  taken from recent
+ **/
+static gboolean line_index_match(LineIndex *index, const guint8 *data, gsize i)
+{
+    gsize j;
+
+    for (j = 1; j < index->n_terminator; j++)
+    {
+        guint8 c;
+
+        if (j <= i)
+        {
+            c = data[i - j];
+        }
+        else if (j - i <= index->n_recent)
+        {
+            c = index->recent[index->n_recent - (j - i)];
+        }
+        else
+        {
+            return FALSE;
+        }
+
+        if (c != index->terminator[index->n_terminator - 1 - j])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ *  Keeps last n_terminator - 1 bytes seen, data follows recent.
+ **/
+static void line_index_remember(LineIndex *index, const guint8 *data, gsize len)
+{
+    gsize keep = index->n_terminator - 1;
+
+    if (len >= keep)
+    {
+        memcpy(index->recent, data + len - keep, keep);
+        index->n_recent = keep;
+    }
+    else
+    {
+        gsize old = MIN(index->n_recent, keep - len);
+
+        memmove(index->recent, index->recent + index->n_recent - old, old);
+        memcpy(index->recent + old, data, len);
+        index->n_recent = old + len;
+    }
+}
+
+/**
+ *  Indexes data up to and including the first terminator in it. Data is
+ *  scanned with memchr() for the last terminator byte, which libc does
+ *  with vector instructions, so only candidates are compared.
+ *  Call again with the rest of data until everything is consumed.
+ *
+ *  \return number of bytes consumed, line_end is set to TRUE if they end
+ *  with terminator
+ **/
+gsize line_index_append(LineIndex *index, const guint8 *data, gsize len,
+                        gint64 arrival, gboolean *line_end)
+{
+    guint8 last = index->terminator[index->n_terminator - 1];
+    gsize pos = 0;
+    const guint8 *p;
+
+    *line_end = FALSE;
+    if (len == 0)
+        return 0;
+
+    if (!index->line_open)
+    {
+        line_index_add(index, index->end, arrival);
+        index->line_open = TRUE;
+    }
+
+    while ((p = memchr(data + pos, last, len - pos)) != NULL)
+    {
+        gsize i = p - data;
+
+        if (line_index_match(index, data, i))
+        {
+            index->end += i + 1;
+            /* terminators don't overlap, next match can't use these bytes */
+            index->n_recent = 0;
+            index->line_open = FALSE;
+            *line_end = TRUE;
+            return i + 1;
+        }
+        pos = i + 1;
+    }
+
+    index->end += len;
+    line_index_remember(index, data, len);
+
+    return len;
+}
+
+/**
+ *  Ends line being appended, so data appended from now on starts a new
+ *  line even without terminator.
+ *
+ *  \return FALSE if there was no line to end
+ **/
+gboolean line_index_end_line(LineIndex *index)
+{
+    if (!index->line_open)
+        return FALSE;
+
+    index->n_recent = 0;
+    index->line_open = FALSE;
+
+    return TRUE;
+}
+
+/**
+ *  \return number of lines that got at least one byte
+ **/
+guint64 line_index_get_lines(LineIndex *index)
+{
+    return index->n_lines;
+}
+
+static LineEntry *line_index_overflow(LineIndex *index, guint64 line)
+{
+    return g_hash_table_lookup(index->overflow, &line);
+}
+
+/**
+ *  \return offset of first byte of line, which must be < number of lines
+ **/
+guint64 line_index_get_offset(LineIndex *index, guint64 line)
+{
+    LineBlock *block = g_ptr_array_index(index->blocks, line / LINE_INDEX_BLOCK);
+    guint32 delta = block->offset_delta[line % LINE_INDEX_BLOCK];
+
+    if (delta == DELTA_ESCAPE)
+        return line_index_overflow(index, line)->offset;
+
+    return block->offset + delta;
+}
+
+/**
+ *  \return monotonic time at which first byte of line arrived
+ **/
+gint64 line_index_get_time(LineIndex *index, guint64 line)
+{
+    LineBlock *block = g_ptr_array_index(index->blocks, line / LINE_INDEX_BLOCK);
+    guint32 delta = block->time_delta[line % LINE_INDEX_BLOCK];
+
+    if (delta == DELTA_ESCAPE)
+        return line_index_overflow(index, line)->time;
+
+    return block->time + delta;
+}
+
+/**
+ *  \return number of line containing offset, 0 if there are no lines
+ **/
+guint64 line_index_find(LineIndex *index, guint64 offset)
+{
+    guint64 lo = 0, hi = index->n_lines;
+
+    /* last line starting at or before offset */
+    while (hi - lo > 1)
+    {
+        guint64 mid = lo + (hi - lo) / 2;
+
+        if (line_index_get_offset(index, mid) <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <glib.h>
+
+/**
+ *  Splits received stream into lines at terminator and remembers where
+ *  each line starts and when its first byte arrived. Lines are numbered
+ *  from 0 and offsets count bytes since index was created, like ByteStore
+ *  offsets. Looking up a line and counting lines are O(1).
+ *
+ *  Each line takes 8 bytes: entries are stored in blocks of
+ *  LINE_INDEX_BLOCK lines as 32 bit deltas from the block start.
+ **/
+typedef struct _LineIndex LineIndex;
+
+#define LINE_INDEX_BLOCK 256
+
+LineIndex *line_index_new(const gchar *terminator, gsize n_terminator);
+void line_index_free(LineIndex *index);
+void line_index_set_terminator(LineIndex *index, const gchar *terminator,
+                               gsize n_terminator);
+
+gsize line_index_append(LineIndex *index, const guint8 *data, gsize len,
+                        gint64 arrival, gboolean *line_end);
+
+gboolean line_index_end_line(LineIndex *index);
+guint64 line_index_get_lines(LineIndex *index);
+guint64 line_index_get_offset(LineIndex *index, guint64 line);
+gint64 line_index_get_time(LineIndex *index, guint64 line);
+guint64 line_index_find(LineIndex *index, guint64 offset);
+
+#endif /* LINEINDEX_H */
@@ -0,0 +1,436 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+/* required for sigaction(), sigsetjmp() and pthread_kill() */
+#define _XOPEN_SOURCE 600
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include "linemonitor.h"
+
+/* used when driver does not implement TIOCMIWAIT */
+#define POLL_INTERVAL 10000 /* us */
+
+/* transitions kept until main loop reads them, oldest are lost first */
+#define MAX_EVENTS 256
+
+/* interrupts TIOCMIWAIT when monitor is freed */
+#define STOP_SIGNAL SIGUSR2
+
+#if defined(__linux__) && defined(TIOCGICOUNT)
+#define HAVE_ICOUNT
+#endif
+
+struct _LineMonitor {
+    int fd;
+    GThread *thread;
+    pthread_t thread_id;
+    gint running;
+    gint stop;
+    sigjmp_buf stop_env;                 /* where thread leaves TIOCMIWAIT */
+    volatile sig_atomic_t stop_armed;    /* stop_env may be jumped to */
+
+    GMutex lock;
+    GCond cond;       /* signalled on stop, for polling mode */
+    guint state;      /* last seen ModemLine bits */
+    LineEvent events[MAX_EVENTS];
+    gsize first;
+    gsize n_events;
+    gsize lost;
+
+    /*
+       Transitions counted by driver (TIOCGICOUNT) minus those seen as a
+       change of level, per input line. A pulse that is over before lines
+       are read leaves 2 here. Negative while a change of level was seen
+       before the driver counted it.
+    */
+    gboolean have_counts;
+#ifdef HAVE_ICOUNT
+    struct serial_icounter_struct counts;
+#endif
+    gint credit[4]; /* DSR, CTS, DCD, RI */
+
+    GSourceFunc callback;
+    gpointer data;
+    gint wakeup_pending;
+    guint wakeup_source;
+};
+
+/* monitor run by calling thread, for stop_signal_handler() */
+static __thread LineMonitor *thread_monitor;
+
+static void stop_signal_handler(int sig)
+{
+    LineMonitor *monitor = thread_monitor;
+
+    /*
+       Leaves TIOCMIWAIT even if signal arrived just before the ioctl was
+       entered. Outside of it the signal is ignored, thread checks stop
+       before waiting again.
+    */
+    if (monitor != NULL && monitor->stop_armed)
+        siglongjmp(monitor->stop_env, 1);
+}
+
+static gpointer install_stop_handler(gpointer data)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(STOP_SIGNAL, &sa, NULL) < 0)
+    {
+        g_message("Unable to install signal handler: %s(%d)", strerror(errno), errno);
+        return GINT_TO_POINTER(FALSE);
+    }
+
+    return GINT_TO_POINTER(TRUE);
+}
+
+static gboolean line_monitor_dispatch(gpointer data)
+{
+    LineMonitor *monitor = (LineMonitor*)data;
+
+    g_atomic_int_set(&monitor->wakeup_pending, 0);
+    monitor->callback(monitor->data);
+
+    return FALSE;
+}
+
+static void line_monitor_wakeup(LineMonitor *monitor)
+{
+    if (g_atomic_int_compare_and_exchange(&monitor->wakeup_pending, 0, 1))
+    {
+        monitor->wakeup_source = g_idle_add_full(G_PRIORITY_HIGH, line_monitor_dispatch,
+                                                 monitor, NULL);
+    }
+}
+
+/**
+ *  Queues event, must be called with lock held.
+ **/
+static void line_monitor_push(LineMonitor *monitor, gint64 time, guint changed,
+                              guint state)
+{
+    LineEvent *event;
+
+    if (monitor->n_events == MAX_EVENTS)
+    {
+        monitor->first = (monitor->first + 1) % MAX_EVENTS;
+        monitor->n_events--;
+        monitor->lost++;
+    }
+
+    event = &monitor->events[(monitor->first + monitor->n_events) % MAX_EVENTS];
+    event->time = time;
+    event->changed = changed;
+    event->state = state;
+    monitor->n_events++;
+}
+
+/**
+ *  Compares interrupt counters of input lines with changes of level seen
+ *  since last call, must be called with lock held. Some drivers count
+ *  only trailing edges of RI, a ring is then found every other time.
+ *
+ *  \return input lines that went through a pulse that was not seen
+ **/
+static guint line_monitor_count(LineMonitor *monitor, guint changed)
+{
+#ifdef HAVE_ICOUNT
+    static const guint lines[] = { LINE_DSR, LINE_CTS, LINE_DCD, LINE_RI };
+    struct serial_icounter_struct counts;
+    gint delta[4];
+    guint pulsed = 0;
+    guint i;
+
+    if (ioctl(monitor->fd, TIOCGICOUNT, &counts) < 0)
+    {
+        monitor->have_counts = FALSE;
+        return 0;
+    }
+
+    if (!monitor->have_counts)
+    {
+        /* first sample, or counters were unavailable since */
+        monitor->counts = counts;
+        monitor->have_counts = TRUE;
+        memset(monitor->credit, 0, sizeof(monitor->credit));
+        return 0;
+    }
+
+    delta[0] = counts.dsr - monitor->counts.dsr;
+    delta[1] = counts.cts - monitor->counts.cts;
+    delta[2] = counts.dcd - monitor->counts.dcd;
+    delta[3] = counts.rng - monitor->counts.rng;
+    monitor->counts = counts;
+
+    for (i = 0; i < G_N_ELEMENTS(lines); i++)
+    {
+        monitor->credit[i] += delta[i] - ((changed & lines[i]) ? 1 : 0);
+        if (monitor->credit[i] >= 2)
+        {
+            /* one pulse is reported, any further ones are counted as lost */
+            pulsed |= lines[i];
+            monitor->lost += monitor->credit[i] - 2;
+            monitor->credit[i] = 0;
+        }
+    }
+
+    return pulsed;
+#else
+    return 0;
+#endif
+}
+
+/**
+ *  Reads lines and records event if any changed. all makes every line
+ *  count as changed, for the initial state. Pulses that ended before
+ *  lines were read are recorded as two events, see line_monitor_count().
+ *
+ *  \return FALSE if lines could not be read
+ **/
+static gboolean line_monitor_sample(LineMonitor *monitor, gboolean all)
+{
+    gint64 now;
+    guint state = 0;
+    guint changed, pulsed;
+    int status;
+
+    g_mutex_lock(&monitor->lock);
+    if (ioctl(monitor->fd, TIOCMGET, &status) < 0)
+    {
+        g_mutex_unlock(&monitor->lock);
+        return FALSE;
+    }
+    now = g_get_monotonic_time();
+
+    if (status & TIOCM_DTR) state |= LINE_DTR;
+    if (status & TIOCM_DSR) state |= LINE_DSR;
+    if (status & TIOCM_RTS) state |= LINE_RTS;
+    if (status & TIOCM_CTS) state |= LINE_CTS;
+    if (status & TIOCM_CD) state |= LINE_DCD;
+    if (status & TIOCM_RI) state |= LINE_RI;
+
+    changed = all ? LINE_ALL : (state ^ monitor->state);
+    pulsed = line_monitor_count(monitor, all ? 0 : changed);
+    if (pulsed != 0)
+    {
+        /* exact times are unknown, both edges get time of this sample */
+        line_monitor_push(monitor, now, pulsed, monitor->state ^ pulsed);
+        line_monitor_push(monitor, now, pulsed, monitor->state);
+    }
+    monitor->state = state;
+    if (changed != 0)
+        line_monitor_push(monitor, now, changed, state);
+    if (changed != 0 || pulsed != 0)
+        line_monitor_wakeup(monitor);
+    g_mutex_unlock(&monitor->lock);
+
+    return TRUE;
+}
+
+static gpointer line_monitor_thread(gpointer data)
+{
+    LineMonitor *monitor = (LineMonitor*)data;
+    volatile gboolean wait_supported = TRUE;
+    int ret;
+
+    thread_monitor = monitor;
+
+    /* running is set before stop is checked, see line_monitor_free() */
+    monitor->thread_id = pthread_self();
+    g_atomic_int_set(&monitor->running, 1);
+
+    while (!g_atomic_int_get(&monitor->stop))
+    {
+        if (wait_supported)
+        {
+            if (sigsetjmp(monitor->stop_env, 1) != 0)
+            {
+                /* stop signal interrupted the wait */
+                break;
+            }
+
+            /* armed before stop is checked again, so no signal is missed */
+            monitor->stop_armed = 1;
+            if (g_atomic_int_get(&monitor->stop))
+            {
+                monitor->stop_armed = 0;
+                break;
+            }
+            ret = ioctl(monitor->fd, TIOCMIWAIT,
+                        TIOCM_DSR | TIOCM_CTS | TIOCM_CD | TIOCM_RI);
+            monitor->stop_armed = 0;
+
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno != EINVAL && errno != ENOTTY)
+                {
+                    /* hangup, reader reports it */
+                    break;
+                }
+
+                g_message("Driver can't wait for control lines, polling them");
+                wait_supported = FALSE;
+                continue;
+            }
+        }
+        else
+        {
+            gint64 deadline = g_get_monotonic_time() + POLL_INTERVAL;
+
+            g_mutex_lock(&monitor->lock);
+            while (!g_atomic_int_get(&monitor->stop) &&
+                   g_cond_wait_until(&monitor->cond, &monitor->lock, deadline))
+                ;
+            g_mutex_unlock(&monitor->lock);
+        }
+
+        if (!line_monitor_sample(monitor, FALSE))
+            break;
+    }
+
+    monitor->stop_armed = 0;
+    thread_monitor = NULL;
+    g_atomic_int_set(&monitor->running, 0);
+
+    return NULL;
+}
+
+/**
+ *  Starts monitoring control lines of fd. Initial state of all lines is
+ *  reported as the first event. Must be called from main thread.
+ *
+ *  \return NULL on error
+ **/
+LineMonitor *line_monitor_new(int fd, GSourceFunc callback, gpointer data)
+{
+    static GOnce handler_once = G_ONCE_INIT;
+    LineMonitor *monitor;
+
+    /* process wide, installed once for all monitors */
+    if (!GPOINTER_TO_INT(g_once(&handler_once, install_stop_handler, NULL)))
+        return NULL;
+
+    monitor = g_slice_new0(LineMonitor);
+    monitor->fd = fd;
+    monitor->callback = callback;
+    monitor->data = data;
+    g_mutex_init(&monitor->lock);
+    g_cond_init(&monitor->cond);
+
+    if (!line_monitor_sample(monitor, TRUE))
+    {
+        g_message("Unable to read control lines: %s(%d)", strerror(errno), errno);
+        g_cond_clear(&monitor->cond);
+        g_mutex_clear(&monitor->lock);
+        g_slice_free(LineMonitor, monitor);
+        return NULL;
+    }
+
+    monitor->thread = g_thread_new("control-lines", line_monitor_thread, monitor);
+
+    return monitor;
+}
+
+/**
+ *  Stops monitor thread and frees monitor. Must be called before fd is
+ *  closed, from main thread.
+ **/
+void line_monitor_free(LineMonitor *monitor)
+{
+    g_atomic_int_set(&monitor->stop, 1);
+
+    g_mutex_lock(&monitor->lock);
+    g_cond_signal(&monitor->cond);
+    g_mutex_unlock(&monitor->lock);
+
+    /*
+       One signal is enough: if thread is not armed yet it sees stop before
+       waiting, otherwise the handler jumps out of TIOCMIWAIT. If thread did
+       not set running yet, it will see stop before waiting too.
+    */
+    if (g_atomic_int_get(&monitor->running))
+        pthread_kill(monitor->thread_id, STOP_SIGNAL);
+    g_thread_join(monitor->thread);
+
+    if (g_atomic_int_get(&monitor->wakeup_pending))
+        g_source_remove(monitor->wakeup_source);
+
+    g_cond_clear(&monitor->cond);
+    g_mutex_clear(&monitor->lock);
+    g_slice_free(LineMonitor, monitor);
+}
+
+/**
+ *  Records lines changed by us (DTR, RTS), call after setting them.
+ **/
+void line_monitor_refresh(LineMonitor *monitor)
+{
+    line_monitor_sample(monitor, FALSE);
+}
+
+/**
+ *  Takes up to n oldest recorded events.
+ *
+ *  \return number of events stored in events
+ **/
+gsize line_monitor_read(LineMonitor *monitor, LineEvent *events, gsize n)
+{
+    gsize i;
+
+    g_mutex_lock(&monitor->lock);
+    n = MIN(n, monitor->n_events);
+    for (i = 0; i < n; i++)
+    {
+        events[i] = monitor->events[monitor->first];
+        monitor->first = (monitor->first + 1) % MAX_EVENTS;
+    }
+    monitor->n_events -= n;
+    g_mutex_unlock(&monitor->lock);
+
+    return n;
+}
+
+/**
+ *  \return number of events dropped because main loop did not read them,
+ *  plus transitions of pulses counted by driver but not reported
+ **/
+gsize line_monitor_get_lost(LineMonitor *monitor)
+{
+    gsize lost;
+
+    g_mutex_lock(&monitor->lock);
+    lost = monitor->lost;
+    g_mutex_unlock(&monitor->lock);
+
+    return lost;
+}
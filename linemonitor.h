@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef LINEMONITOR_H
+#define LINEMONITOR_H
+
+#include <glib.h>
+
+/**
+ *  Modem control line monitor. A helper thread sleeps in TIOCMIWAIT until
+ *  an input line changes (or polls, for drivers without TIOCMIWAIT) and
+ *  records every transition with its time; callback is called from main
+ *  loop only when something changed. Pulses too short to be seen as a
+ *  change of level are found in the driver's interrupt counters
+ *  (TIOCGICOUNT) and recorded as two transitions. Output lines (DTR, RTS) change only
+ *  when we set them, line_monitor_refresh() records those.
+ **/
+typedef struct _LineMonitor LineMonitor;
+
+typedef enum {
+    LINE_DTR = 1 << 0,
+    LINE_DSR = 1 << 1,
+    LINE_RTS = 1 << 2,
+    LINE_CTS = 1 << 3,
+    LINE_DCD = 1 << 4,
+    LINE_RI  = 1 << 5,
+} ModemLine;
+
+#define LINE_ALL (LINE_DTR | LINE_DSR | LINE_RTS | LINE_CTS | LINE_DCD | LINE_RI)
+
+typedef struct {
+    gint64 time;    /* g_get_monotonic_time() when change was seen */
+    guint8 changed; /* ModemLine bits that changed */
+    guint8 state;   /* ModemLine bits that are high after the change */
+} LineEvent;
+
+LineMonitor *line_monitor_new(int fd, GSourceFunc callback, gpointer data);
+void line_monitor_free(LineMonitor *monitor);
+
+void line_monitor_refresh(LineMonitor *monitor);
+gsize line_monitor_read(LineMonitor *monitor, LineEvent *events, gsize n);
+gsize line_monitor_get_lost(LineMonitor *monitor);
+
+#endif /* LINEMONITOR_H */
@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+/* realpath() */
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "portwatch.h"
+
+#define DEV_DIR "/dev"
+#define SYSFS_TTY_DIR "/sys/class/tty"
+
+struct _PortWatch {
+    gchar *id;
+    int fd;
+    guint source;
+    PortWatchFunc func;
+    gpointer data;
+};
+
+/**
+ *  \return stripped contents of sysfs attribute, NULL if there is none
+ **/
+static gchar *read_attribute(const gchar *dir, const gchar *name)
+{
+    gchar *path = g_build_filename(dir, name, NULL);
+    gchar *value = NULL;
+
+    if (g_file_get_contents(path, &value, NULL, NULL))
+        g_strstrip(value);
+    g_free(path);
+
+    return value;
+}
+
+/**
+ *  Describes USB device in dir, iface is the interface directory below it
+ *  that port belongs to.
+ **/
+static gchar *identify_usb(const gchar *dir, const gchar *iface)
+{
+    gchar *vendor = read_attribute(dir, "idVendor");
+    gchar *product = read_attribute(dir, "idProduct");
+    gchar *serial = read_attribute(dir, "serial");
+    gchar *id;
+
+    if (serial != NULL && serial[0] != '\0')
+    {
+        /* "1-2:1.0" is interface 0 of configuration 1 */
+        const gchar *number = strrchr(iface, ':');
+
+        id = g_strdup_printf("usb:%s:%s:%s:%s", vendor, product != NULL ? product : "",
+                             serial, number != NULL ? number + 1 : "");
+    }
+    else
+    {
+        /* same port of same hub keeps the path across replugs */
+        id = g_strdup_printf("path:%s", iface);
+    }
+
+    g_free(vendor);
+    g_free(product);
+    g_free(serial);
+
+    return id;
+}
+
+/**
+ *  \return identity of device behind port (see portwatch.h), NULL if
+ *  port is not backed by a device in sysfs, like pseudo terminals
+ **/
+gchar *port_watch_identify(const gchar *port)
+{
+    gchar *node, *name, *link, *device, *dir, *child;
+    gchar *id = NULL;
+
+    /* port may be a symlink, e.g. in /dev/serial/by-id */
+    node = realpath(port, NULL);
+    if (node == NULL)
+        return NULL;
+
+    name = g_path_get_basename(node);
+    link = g_build_filename(SYSFS_TTY_DIR, name, "device", NULL);
+    device = realpath(link, NULL);
+    free(node);
+    g_free(name);
+    g_free(link);
+    if (device == NULL)
+        return NULL;
+
+    /* walk up to the USB device, interface is the directory below it */
+    dir = g_strdup(device);
+    child = g_strdup(device);
+    while (strlen(dir) > strlen("/sys/devices"))
+    {
+        gchar *vendor = read_attribute(dir, "idVendor");
+        gchar *parent;
+
+        if (vendor != NULL)
+        {
+            g_free(vendor);
+            id = identify_usb(dir, child);
+            break;
+        }
+
+        parent = g_path_get_dirname(dir);
+        g_free(child);
+        child = dir;
+        dir = parent;
+    }
+
+    if (id == NULL)
+        id = g_strdup_printf("path:%s", device);
+
+    g_free(dir);
+    g_free(child);
+    free(device);
+
+    return id;
+}
+
+static gboolean port_watch_event_cb(GIOChannel *source, GIOCondition condition,
+                                    gpointer data)
+{
+    PortWatch *watch = (PortWatch*)data;
+    /* aligned for struct inotify_event */
+    union {
+        struct inotify_event event;
+        gchar bytes[4096];
+    } buf;
+    ssize_t len, pos;
+
+    len = read(watch->fd, &buf, sizeof(buf));
+    if (len < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+            return TRUE;
+        g_message("Unable to read %s events: %s(%d)", DEV_DIR, strerror(errno), errno);
+        watch->source = 0;
+        return FALSE;
+    }
+
+    for (pos = 0; pos < len; )
+    {
+        struct inotify_event *event = (struct inotify_event*)(buf.bytes + pos);
+
+        pos += sizeof(struct inotify_event) + event->len;
+
+        if (event->len > 0 && g_str_has_prefix(event->name, "tty") &&
+            (event->mask & (IN_CREATE | IN_ATTRIB)) && !(event->mask & IN_ISDIR))
+        {
+            gchar *path = g_build_filename(DEV_DIR, event->name, NULL);
+            gchar *id = port_watch_identify(path);
+
+            if (id != NULL && strcmp(id, watch->id) == 0)
+                watch->func(watch, path, watch->data);
+            g_free(id);
+            g_free(path);
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ *  Starts watching for device behind port, which must be present now.
+ *
+ *  \return NULL if device can't be identified or /dev can't be watched
+ **/
+PortWatch *port_watch_new(const gchar *port, PortWatchFunc func, gpointer data)
+{
+    PortWatch *watch;
+    GIOChannel *channel;
+    gchar *id;
+    int fd;
+
+    id = port_watch_identify(port);
+    if (id == NULL)
+        return NULL;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, DEV_DIR, IN_CREATE | IN_ATTRIB) < 0)
+    {
+        g_message("Unable to watch %s: %s(%d)", DEV_DIR, strerror(errno), errno);
+        if (fd >= 0)
+            close(fd);
+        g_free(id);
+        return NULL;
+    }
+
+    watch = g_slice_new0(PortWatch);
+    watch->id = id;
+    watch->fd = fd;
+    watch->func = func;
+    watch->data = data;
+
+    channel = g_io_channel_unix_new(fd);
+    watch->source = g_io_add_watch(channel, G_IO_IN, port_watch_event_cb, watch);
+    g_io_channel_unref(channel);
+
+    return watch;
+}
+
+void port_watch_free(PortWatch *watch)
+{
+    if (watch->source != 0)
+        g_source_remove(watch->source);
+    close(watch->fd);
+    g_free(watch->id);
+    g_slice_free(PortWatch, watch);
+}
+
+/**
+ *  \return identity of watched device, see port_watch_identify()
+ **/
+const gchar *port_watch_get_id(PortWatch *watch)
+{
+    return watch->id;
+}
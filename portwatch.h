@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PORTWATCH_H
+#define PORTWATCH_H
+
+#include <glib.h>
+
+/**
+ *  Watches /dev, through inotify, for a serial port device to appear
+ *  again after it went away, e.g. a USB UART that was replugged or
+ *  re-enumerated. Device is recognized by its identity in sysfs, taken
+ *  when watch is created: vendor, product, serial number and interface
+ *  of a USB device, physical path if device has no serial number. It may
+ *  come back under another name.
+ *  Callback is called from main loop with path of every node of the
+ *  device that is created or has its permissions changed, the latter
+ *  since udev sets them right after the kernel creates the node.
+ **/
+typedef struct _PortWatch PortWatch;
+
+typedef void (*PortWatchFunc)(PortWatch *watch, const gchar *port, gpointer data);
+
+PortWatch *port_watch_new(const gchar *port, PortWatchFunc func, gpointer data);
+void port_watch_free(PortWatch *watch);
+const gchar *port_watch_get_id(PortWatch *watch);
+
+gchar *port_watch_identify(const gchar *port);
+
+#endif /* PORTWATCH_H */
@@ -0,0 +1,444 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+#include "protocols.h"
+#include "crc.h"
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+#define HDLC_FLAG 0x7E
+#define HDLC_ESC 0x7D
+#define HDLC_XOR 0x20
+
+#define MODBUS_MAX_ADU 256
+#define MODBUS_MIN_ADU 4 /* address, function, CRC */
+
+/* SLIP and HDLC: flag delimited, with an escape byte */
+typedef struct {
+    guint8 flag;
+    guint8 esc;
+    gboolean (*unescape)(guint8 c, guint8 *out);
+    gboolean fcs;
+} EscapeRules;
+
+typedef struct {
+    gboolean open;    /* frame got a byte */
+    gboolean escape;  /* last byte was escape */
+    gboolean bad;     /* invalid escape seen */
+    guint64 start;
+    gsize payload;
+    gint64 time;
+    guint16 crc;
+} EscapeState;
+
+static gpointer escape_state_new(void)
+{
+    return g_slice_new0(EscapeState);
+}
+
+static void escape_state_free(gpointer state)
+{
+    g_slice_free(EscapeState, state);
+}
+
+static void escape_end(FrameDecoder *decoder, EscapeState *s,
+                       const EscapeRules *rules, guint64 end, gboolean truncated)
+{
+    FrameStatus status;
+    gsize payload = s->payload;
+
+    if (truncated || s->bad || s->escape)
+    {
+        status = FRAME_MALFORMED;
+    }
+    else if (!rules->fcs)
+    {
+        status = FRAME_NO_CHECK;
+    }
+    else if (payload < 3)
+    {
+        /* too short to hold FCS and anything else */
+        status = FRAME_MALFORMED;
+    }
+    else
+    {
+        status = (s->crc == CRC16_X25_GOOD) ? FRAME_OK : FRAME_BAD_CHECK;
+        payload -= 2;
+    }
+
+    frame_decoder_emit(decoder, s->start, end, payload, s->time, status);
+    s->open = FALSE;
+}
+
+static void escape_feed(FrameDecoder *decoder, EscapeState *s, const EscapeRules *rules,
+                        const guint8 *data, gsize len, guint64 offset, gint64 arrival)
+{
+    gsize i = 0;
+
+    while (i < len)
+    {
+        guint8 c = data[i];
+        guint8 out;
+        gsize run;
+
+        if (c == rules->flag)
+        {
+            /* flags between frames are idle fill */
+            if (s->open)
+                escape_end(decoder, s, rules, offset + i, FALSE);
+            i++;
+            continue;
+        }
+
+        if (!s->open)
+        {
+            s->open = TRUE;
+            s->escape = FALSE;
+            s->bad = FALSE;
+            s->start = offset + i;
+            s->payload = 0;
+            s->time = arrival;
+            s->crc = CRC16_INIT;
+        }
+
+        if (s->escape)
+        {
+            s->escape = FALSE;
+            if (!rules->unescape(c, &out))
+            {
+                s->bad = TRUE;
+                out = c;
+            }
+            if (rules->fcs)
+                s->crc = crc16_x25(s->crc, &out, 1);
+            s->payload++;
+            run = 1;
+        }
+        else if (c == rules->esc)
+        {
+            s->escape = TRUE;
+            run = 1;
+        }
+        else
+        {
+            /* plain bytes are checked straight from receive buffer */
+            for (run = 1; i + run < len && data[i + run] != rules->flag &&
+                 data[i + run] != rules->esc; run++)
+                ;
+            run = MIN(run, FRAME_MAX_LEN - (offset + i - s->start));
+            if (rules->fcs)
+                s->crc = crc16_x25(s->crc, data + i, run);
+            s->payload += run;
+        }
+        i += run;
+
+        if (offset + i - s->start >= FRAME_MAX_LEN)
+            escape_end(decoder, s, rules, offset + i, TRUE);
+    }
+}
+
+static gsize escape_decode(const EscapeRules *rules, const guint8 *raw, gsize len,
+                           guint8 *payload)
+{
+    gsize n = 0;
+    gsize i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (raw[i] == rules->esc && i + 1 < len)
+        {
+            i++;
+            if (!rules->unescape(raw[i], &payload[n]))
+                payload[n] = raw[i];
+        }
+        else
+        {
+            payload[n] = raw[i];
+        }
+        n++;
+    }
+
+    return n;
+}
+
+static gboolean slip_unescape(guint8 c, guint8 *out)
+{
+    switch (c)
+    {
+        case SLIP_ESC_END: *out = SLIP_END; return TRUE;
+        case SLIP_ESC_ESC: *out = SLIP_ESC; return TRUE;
+        default: return FALSE;
+    }
+}
+
+static const EscapeRules slip_rules = {SLIP_END, SLIP_ESC, slip_unescape, FALSE};
+
+static void slip_feed(FrameDecoder *decoder, gpointer state, const guint8 *data,
+                      gsize len, guint64 offset, gint64 arrival)
+{
+    escape_feed(decoder, state, &slip_rules, data, len, offset, arrival);
+}
+
+static gsize slip_decode(const guint8 *raw, gsize len, guint8 *payload)
+{
+    return escape_decode(&slip_rules, raw, len, payload);
+}
+
+const FrameProtocol slip_protocol = {
+    "SLIP",
+    escape_state_new,
+    escape_state_free,
+    slip_feed,
+    slip_decode,
+};
+
+static gboolean hdlc_unescape(guint8 c, guint8 *out)
+{
+    *out = c ^ HDLC_XOR;
+    return TRUE;
+}
+
+static const EscapeRules hdlc_rules = {HDLC_FLAG, HDLC_ESC, hdlc_unescape, TRUE};
+
+static void hdlc_feed(FrameDecoder *decoder, gpointer state, const guint8 *data,
+                      gsize len, guint64 offset, gint64 arrival)
+{
+    escape_feed(decoder, state, &hdlc_rules, data, len, offset, arrival);
+}
+
+static gsize hdlc_decode(const guint8 *raw, gsize len, guint8 *payload)
+{
+    return escape_decode(&hdlc_rules, raw, len, payload);
+}
+
+const FrameProtocol hdlc_protocol = {
+    "HDLC",
+    escape_state_new,
+    escape_state_free,
+    hdlc_feed,
+    hdlc_decode,
+};
+
+typedef struct {
+    gboolean open;
+    guint64 start;
+    gsize payload;
+    guint remaining; /* data bytes left in current block, 0 if code is next */
+    guint8 code;     /* of current block */
+    gint64 time;
+} CobsState;
+
+static gpointer cobs_state_new(void)
+{
+    return g_slice_new0(CobsState);
+}
+
+static void cobs_state_free(gpointer state)
+{
+    g_slice_free(CobsState, state);
+}
+
+static void cobs_feed(FrameDecoder *decoder, gpointer state, const guint8 *data,
+                      gsize len, guint64 offset, gint64 arrival)
+{
+    CobsState *s = (CobsState*)state;
+    gsize i = 0;
+
+    while (i < len)
+    {
+        gsize run;
+
+        if (data[i] == 0)
+        {
+            if (s->open)
+            {
+                frame_decoder_emit(decoder, s->start, offset + i, s->payload, s->time,
+                                   s->remaining == 0 ? FRAME_NO_CHECK : FRAME_MALFORMED);
+                s->open = FALSE;
+            }
+            i++;
+            continue;
+        }
+
+        if (!s->open)
+        {
+            s->open = TRUE;
+            s->start = offset + i;
+            s->payload = 0;
+            s->remaining = 0;
+            s->code = 0xFF; /* no zero before first block */
+            s->time = arrival;
+        }
+
+        if (s->remaining == 0)
+        {
+            /* block shorter than 254 bytes stands for data followed by zero */
+            if (s->code < 0xFF)
+                s->payload++;
+            s->code = data[i];
+            s->remaining = data[i] - 1;
+            run = 1;
+        }
+        else
+        {
+            /* skip over block data up to delimiter */
+            const guint8 *zero = memchr(data + i, 0, MIN(s->remaining, len - i));
+
+            run = zero != NULL ? (gsize)(zero - data) - i : MIN(s->remaining, len - i);
+            s->remaining -= run;
+            s->payload += run;
+        }
+        i += run;
+
+        if (offset + i - s->start >= FRAME_MAX_LEN)
+        {
+            frame_decoder_emit(decoder, s->start, offset + i, s->payload, s->time,
+                               FRAME_MALFORMED);
+            s->open = FALSE;
+        }
+    }
+}
+
+static gsize cobs_decode(const guint8 *raw, gsize len, guint8 *payload)
+{
+    gsize n = 0;
+    gsize i = 0;
+
+    while (i < len)
+    {
+        guint8 code = raw[i++];
+        gsize block = MIN((gsize)code - 1, len - i);
+
+        memcpy(payload + n, raw + i, block);
+        n += block;
+        i += block;
+        if (code < 0xFF && i < len)
+            payload[n++] = 0;
+    }
+
+    return n;
+}
+
+const FrameProtocol cobs_protocol = {
+    "COBS",
+    cobs_state_new,
+    cobs_state_free,
+    cobs_feed,
+    cobs_decode,
+};
+
+typedef struct {
+    gboolean open;
+    guint64 start;
+    guint64 end;
+    guint16 crc;
+    gint64 time;
+    gint64 last; /* arrival of last data */
+} ModbusState;
+
+static gpointer modbus_state_new(void)
+{
+    return g_slice_new0(ModbusState);
+}
+
+static void modbus_state_free(gpointer state)
+{
+    g_slice_free(ModbusState, state);
+}
+
+static void modbus_end(FrameDecoder *decoder, ModbusState *s)
+{
+    gsize len = s->end - s->start;
+    FrameStatus status;
+
+    if (len < MODBUS_MIN_ADU)
+        status = FRAME_MALFORMED;
+    else
+        status = (s->crc == 0) ? FRAME_OK : FRAME_BAD_CHECK;
+
+    frame_decoder_emit(decoder, s->start, s->end, len >= 2 ? len - 2 : 0, s->time, status);
+    s->open = FALSE;
+}
+
+/**
+ *  \return 3.5 character times in microseconds; fixed 1750 us above
+ *  19200 Bd as the specification recommends
+ **/
+static gint64 modbus_silence(guint baudrate)
+{
+    if (baudrate == 0 || baudrate > 19200)
+        return 1750;
+
+    /* 11 bits per character */
+    return (gint64)35 * 11 * G_USEC_PER_SEC / 10 / baudrate;
+}
+
+static void modbus_feed(FrameDecoder *decoder, gpointer state, const guint8 *data,
+                        gsize len, guint64 offset, gint64 arrival)
+{
+    ModbusState *s = (ModbusState*)state;
+
+    if (s->open && arrival - s->last > modbus_silence(frame_decoder_get_baudrate(decoder)))
+        modbus_end(decoder, s);
+    s->last = arrival;
+
+    while (len > 0)
+    {
+        gsize n;
+
+        if (!s->open)
+        {
+            s->open = TRUE;
+            s->start = offset;
+            s->end = offset;
+            s->crc = CRC16_INIT;
+            s->time = arrival;
+        }
+
+        n = MIN(len, MODBUS_MAX_ADU - (s->end - s->start));
+        s->crc = crc16_modbus(s->crc, data, n);
+        s->end += n;
+        data += n;
+        offset += n;
+        len -= n;
+
+        if (s->end - s->start == MODBUS_MAX_ADU)
+            modbus_end(decoder, s);
+    }
+
+    if (s->open && s->end - s->start >= MODBUS_MIN_ADU && s->crc == 0)
+        modbus_end(decoder, s);
+}
+
+static gsize modbus_decode(const guint8 *raw, gsize len, guint8 *payload)
+{
+    memcpy(payload, raw, len);
+    return len;
+}
+
+const FrameProtocol modbus_rtu_protocol = {
+    "Modbus RTU",
+    modbus_state_new,
+    modbus_state_free,
+    modbus_feed,
+    modbus_decode,
+};
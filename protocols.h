@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef PROTOCOLS_H
+#define PROTOCOLS_H
+
+#include "decoder.h"
+
+/**
+ *  Built-in protocols, registered by decoder.c:
+ *  SLIP (RFC 1055), frames between 0xC0, no check.
+ *  COBS, frames between 0x00, no check.
+ *  HDLC-like async framing (RFC 1662), 0x7E flags, 16 bit FCS.
+ *  Modbus RTU, frames separated by 3.5 character times of silence,
+ *  CRC-16/MODBUS. Silence is only seen between reads, so frame is also
+ *  ended when read ends with a valid CRC.
+ **/
+extern const FrameProtocol slip_protocol;
+extern const FrameProtocol cobs_protocol;
+extern const FrameProtocol hdlc_protocol;
+extern const FrameProtocol modbus_rtu_protocol;
+
+/* longer frames are reported as malformed and split */
+#define FRAME_MAX_LEN (64 * 1024)
+
+#endif /* PROTOCOLS_H */
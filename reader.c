@@ -0,0 +1,931 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include "reader.h"
+#include "ringbuffer.h"
+#include "capture.h"
+#include "txqueue.h"
+#include "trigger.h"
+#include "serial.h"
+#include "timeindex.h"
+
+/*
+   Longest time reader keeps reading before it lets main loop see the data,
+   so a continuous stream is still shown as it arrives.
+*/
+#define DRAIN_BUDGET 2000 /* us */
+
+/* bounds of buffer used to drop data when ring buffer is full */
+#define MIN_SCRATCH_SIZE 256
+#define MAX_SCRATCH_SIZE (64 * 1024)
+
+/* reads into ring ask for at least this much, so a burst takes one read */
+#define MIN_READ_SIZE 4096
+
+/* bytes that can wait in transmit queue */
+#define TX_QUEUE_LIMIT (256 * 1024)
+
+/* trigger events kept for main loop, later matches are not reported */
+#define MAX_TRIGGER_EVENTS 1024
+
+/*
+   Data kept from a capture start trigger until main loop opens the
+   capture file, which normally takes a few milliseconds.
+*/
+#define PRE_CAPTURE_LIMIT (4 * 1024 * 1024)
+
+/* events handled per epoll_wait() */
+#define MAX_EVENTS 64
+
+struct _SerialReader {
+    int fd;
+    guint64 id; /* in epoll events, never reused unlike the address */
+    RingBuffer *ring;
+    TxQueue *tx;
+
+    GSourceFunc callback;
+    gpointer data;
+
+    gint wakeup_pending;
+    guint wakeup_source;
+    gint wakeup_priority;
+
+    GMutex chunk_lock;
+    GArray *chunks;  /* of SerialReaderChunk, in ring, taken by main loop */
+    GArray *drained; /* chunks of running drain, I/O thread only */
+
+    gsize overruns;
+    gint hangup;
+    gint baudrate;
+
+    SerialReaderStats pending; /* counted by I/O thread, not yet published */
+    SerialReaderStats stats;   /* updated atomically after each drain */
+
+    GMutex capture_lock;
+    CaptureWriter *capture;
+    GByteArray *pre_capture;      /* PreCaptureRecords, NULL unless triggered */
+    gsize pre_capture_dropped;    /* bytes over PRE_CAPTURE_LIMIT */
+    gboolean pre_capture_stopped; /* stop trigger fired before capture was set */
+
+    GMutex trigger_lock;
+    TriggerSet *triggers;
+    guint32 trigger_state;
+    GArray *trigger_events; /* of TriggerEvent, taken by main loop */
+};
+
+/* state of one trigger scan */
+typedef struct {
+    SerialReader *reader;
+    gint64 arrival;
+    guint first_send; /* index of first event waiting for transmit queue write */
+    gboolean send;
+    gboolean capture_stop;
+} TriggerScan;
+
+/* header of data kept in pre_capture, followed by len bytes */
+typedef struct {
+    gint64 timestamp;
+    gsize len;
+    CaptureRecordType type;
+} PreCaptureRecord;
+
+/**
+ *  Single I/O thread servicing all readers through one epoll set, so an
+ *  idle port costs nothing and CPU use follows traffic, not port count.
+ *  Started with the first reader and stopped with the last one; only
+ *  accessed from the main thread apart from the I/O thread itself.
+ **/
+typedef struct {
+    int epfd;
+    int stop_pipe[2];
+    GThread *thread;
+
+    GMutex lock;         /* held by I/O thread while it handles events */
+    GHashTable *readers; /* registered readers by id, events for others are stale */
+
+    guint8 *scratch;     /* for data dropped on overrun, I/O thread only */
+    gsize scratch_size;
+} IoEngine;
+
+static IoEngine *engine = NULL;
+
+/* id of last reader created, 0 stands for the stop pipe */
+static guint64 last_reader_id = 0;
+
+static gboolean serial_reader_dispatch(gpointer data)
+{
+    SerialReader *reader = (SerialReader*)data;
+
+    /*
+       Clear the flag before draining, so data arriving while callback
+       runs schedules another wakeup instead of being left in the ring.
+    */
+    g_atomic_int_set(&reader->wakeup_pending, 0);
+    reader->callback(reader->data);
+
+    return FALSE;
+}
+
+static void serial_reader_wakeup(SerialReader *reader)
+{
+    if (g_atomic_int_compare_and_exchange(&reader->wakeup_pending, 0, 1))
+    {
+        reader->wakeup_source =
+            g_idle_add_full(g_atomic_int_get(&reader->wakeup_priority),
+                            serial_reader_dispatch, reader, NULL);
+    }
+}
+
+/**
+ *  Asks driver for number of bytes waiting in it.
+ *
+ *  \return FALSE if it is unknown, backlog is then 0
+ **/
+static gboolean serial_reader_backlog(SerialReader *reader, SerialReaderStats *stats,
+                                      gsize *backlog)
+{
+    int n = 0;
+
+    *backlog = 0;
+    stats->ioctls++;
+    if (ioctl(reader->fd, FIONREAD, &n) < 0 || n < 0)
+        return FALSE;
+
+    *backlog = n;
+    return TRUE;
+}
+
+/**
+ *  \return number of bytes arriving at current baudrate during one drain
+ *  budget, 10 bits per byte
+ **/
+static gsize serial_reader_budget_bytes(SerialReader *reader)
+{
+    return (gsize)g_atomic_int_get(&reader->baudrate) / 10 * DRAIN_BUDGET / G_USEC_PER_SEC;
+}
+
+/**
+ *  Reads and drops what is waiting in driver when ring buffer is full.
+ *  Scratch buffer is sized from backlog, but never smaller than what
+ *  arrives at current baudrate during one drain budget.
+ **/
+static ssize_t serial_reader_overrun(SerialReader *reader, SerialReaderStats *stats,
+                                     guint8 **ptr)
+{
+    gsize want;
+    ssize_t bytes_read;
+
+    serial_reader_backlog(reader, stats, &want);
+    want = MAX(want, serial_reader_budget_bytes(reader));
+
+    want = CLAMP(want, MIN_SCRATCH_SIZE, MAX_SCRATCH_SIZE);
+    if (want > engine->scratch_size)
+    {
+        engine->scratch = g_realloc(engine->scratch, want);
+        engine->scratch_size = want;
+    }
+
+    *ptr = engine->scratch;
+    stats->reads++;
+    bytes_read = read(reader->fd, engine->scratch, engine->scratch_size);
+    if (bytes_read > 0)
+        g_atomic_pointer_add(&reader->overruns, bytes_read);
+
+    return bytes_read;
+}
+
+/**
+ *  Appends record to capture, or keeps it while main loop is opening the
+ *  capture after a start trigger. Called with capture lock held.
+ **/
+static void serial_reader_record(SerialReader *reader, CaptureRecordType type,
+                                 gint64 timestamp, const guint8 *data, gsize len)
+{
+    PreCaptureRecord record;
+
+    if (reader->capture != NULL)
+    {
+        capture_writer_append(reader->capture, type, timestamp, data, len);
+        return;
+    }
+
+    if (reader->pre_capture == NULL || reader->pre_capture_stopped)
+        return;
+
+    if (reader->pre_capture->len + sizeof(record) + len > PRE_CAPTURE_LIMIT)
+    {
+        reader->pre_capture_dropped += len;
+        return;
+    }
+
+    record.timestamp = timestamp;
+    record.len = len;
+    record.type = type;
+    g_byte_array_append(reader->pre_capture, (const guint8*)&record, sizeof(record));
+    g_byte_array_append(reader->pre_capture, data, len);
+}
+
+/**
+ *  Starts keeping data for a capture main loop is going to open, unless
+ *  a capture is already running. Called with trigger lock held.
+ **/
+static void serial_reader_start_capture(SerialReader *reader)
+{
+    g_mutex_lock(&reader->capture_lock);
+    if (reader->capture == NULL && reader->pre_capture == NULL)
+    {
+        reader->pre_capture = g_byte_array_new();
+        reader->pre_capture_dropped = 0;
+        reader->pre_capture_stopped = FALSE;
+    }
+    g_mutex_unlock(&reader->capture_lock);
+}
+
+/**
+ *  Stops appending to capture, main loop closes it when it gets the
+ *  trigger event.
+ **/
+static void serial_reader_stop_capture(SerialReader *reader)
+{
+    g_mutex_lock(&reader->capture_lock);
+    reader->capture = NULL;
+    if (reader->pre_capture != NULL)
+        reader->pre_capture_stopped = TRUE;
+    g_mutex_unlock(&reader->capture_lock);
+}
+
+static void serial_reader_written(gpointer data, const guint8 *buf, gsize len)
+{
+    SerialReader *reader = (SerialReader*)data;
+
+    g_mutex_lock(&reader->capture_lock);
+    serial_reader_record(reader, CAPTURE_TX, g_get_monotonic_time(), buf, len);
+    g_mutex_unlock(&reader->capture_lock);
+}
+
+/**
+ *  Carries out action of a matched trigger, called by trigger_set_scan()
+ *  with trigger lock held. Data to send is only queued here and written
+ *  once the whole read was scanned. Capture stops after the read, so
+ *  data that matched is captured.
+ **/
+static void serial_reader_fire(gpointer data, guint id, TriggerAction action,
+                               const guint8 *arg, gsize n_arg)
+{
+    TriggerScan *scan = (TriggerScan*)data;
+    SerialReader *reader = scan->reader;
+    TriggerEvent event;
+
+    switch (action)
+    {
+        case TRIGGER_SEND:
+            tx_queue_push(reader->tx, arg, n_arg);
+            if (!scan->send)
+                scan->first_send = reader->trigger_events->len;
+            scan->send = TRUE;
+            break;
+        case TRIGGER_RTS_HIGH:
+        case TRIGGER_RTS_LOW:
+            set_rts(reader->fd, action == TRIGGER_RTS_HIGH);
+            break;
+        case TRIGGER_DTR_HIGH:
+        case TRIGGER_DTR_LOW:
+            set_dtr(reader->fd, action == TRIGGER_DTR_HIGH);
+            break;
+        case TRIGGER_CAPTURE_START:
+            /* file is opened by main loop, data is kept until then */
+            serial_reader_start_capture(reader);
+            break;
+        case TRIGGER_CAPTURE_STOP:
+            scan->capture_stop = TRUE;
+            break;
+        default:
+            break;
+    }
+
+    if (reader->trigger_events->len < MAX_TRIGGER_EVENTS)
+    {
+        event.id = id;
+        event.action = action;
+        event.arrival = scan->arrival;
+        event.done = g_get_monotonic_time();
+        g_array_append_val(reader->trigger_events, event);
+    }
+}
+
+/**
+ *  Matches received data against triggers and writes whatever they sent
+ *  right away, instead of waiting for epoll to report fd writable.
+ *
+ *  \return TRUE if a trigger stopped capture
+ **/
+static gboolean serial_reader_match(SerialReader *reader, const guint8 *data, gsize len,
+                                    gint64 arrival)
+{
+    TriggerScan scan;
+    guint i;
+
+    g_mutex_lock(&reader->trigger_lock);
+    if (reader->triggers == NULL)
+    {
+        g_mutex_unlock(&reader->trigger_lock);
+        return FALSE;
+    }
+
+    scan.reader = reader;
+    scan.arrival = arrival;
+    scan.first_send = 0;
+    scan.send = FALSE;
+    scan.capture_stop = FALSE;
+    reader->trigger_state = trigger_set_scan(reader->triggers, reader->trigger_state,
+                                             data, len, serial_reader_fire, &scan);
+
+    if (scan.send)
+    {
+        gint64 done;
+
+        tx_queue_write(reader->tx, reader->fd, serial_reader_written, reader);
+        done = g_get_monotonic_time();
+        for (i = scan.first_send; i < reader->trigger_events->len; i++)
+        {
+            TriggerEvent *event = &g_array_index(reader->trigger_events, TriggerEvent, i);
+
+            if (event->action == TRIGGER_SEND)
+                event->done = done;
+        }
+    }
+    g_mutex_unlock(&reader->trigger_lock);
+
+    return scan.capture_stop;
+}
+
+/**
+ *  Reads until driver has nothing more, ring buffer is full or drain
+ *  budget is used up, then wakes up main loop once. Reads ask for what
+ *  arrives at current baudrate during the budget; when one comes back
+ *  full, FIONREAD tells whether to stop or how much the next one takes,
+ *  so a backlog is read at once and an empty driver costs no EAGAIN read.
+ *  Every read that goes into the ring is stamped with CLOCK_MONOTONIC_RAW
+ *  right after it returns; monotonic clock time is derived from it with
+ *  an offset taken once per drain, saving a clock read per read().
+ *
+ *  \return FALSE if device went away
+ **/
+static gboolean serial_reader_drain(SerialReader *reader, SerialReaderStats *stats)
+{
+    gint64 start = g_get_monotonic_time();
+    gint64 deadline = start + DRAIN_BUDGET;
+    gint64 clock_diff = start * 1000 - time_index_now();
+    gsize want = MAX(serial_reader_budget_bytes(reader), MIN_READ_SIZE);
+    gboolean received = FALSE;
+    gboolean alive = TRUE;
+
+    for (;;)
+    {
+        gsize len;
+        guint8 *ptr = ring_buffer_write_ptr(reader->ring, &len);
+        ssize_t bytes_read;
+        gboolean in_ring = ptr != NULL;
+        SerialReaderChunk chunk;
+        gboolean capture_stop;
+
+        if (ptr == NULL && received)
+        {
+            /* let main loop drain the ring before anything is dropped */
+            break;
+        }
+        else if (ptr == NULL)
+        {
+            /* main loop is not keeping up, drop data instead of blocking */
+            bytes_read = serial_reader_overrun(reader, stats, &ptr);
+            len = engine->scratch_size;
+        }
+        else
+        {
+            len = MIN(len, want);
+            stats->reads++;
+            bytes_read = read(reader->fd, ptr, len);
+            if (bytes_read > 0)
+                ring_buffer_commit(reader->ring, bytes_read);
+        }
+
+        if (bytes_read > 0)
+        {
+            stats->bytes += bytes_read;
+            stats->read_sizes[MIN(g_bit_storage(bytes_read) - 1,
+                                  READ_SIZE_BUCKETS - 1)]++;
+            received = TRUE;
+            chunk.len = bytes_read;
+            chunk.time = time_index_now();
+            chunk.monotonic = (chunk.time + clock_diff) / 1000;
+
+            /* triggers first, their latency is what the device sees */
+            capture_stop = serial_reader_match(reader, ptr, bytes_read, chunk.monotonic);
+
+            /* capture gets everything, even what did not fit in the ring */
+            g_mutex_lock(&reader->capture_lock);
+            serial_reader_record(reader, CAPTURE_RX, chunk.monotonic, ptr, bytes_read);
+            g_mutex_unlock(&reader->capture_lock);
+            if (capture_stop)
+                serial_reader_stop_capture(reader);
+
+            if (in_ring)
+                g_array_append_val(reader->drained, chunk);
+
+            /*
+               Short read means driver buffer is empty, so skip the read
+               that would only return EAGAIN. Full read into the end of
+               the ring continues at its start.
+            */
+            if ((gsize)bytes_read < len || chunk.monotonic >= deadline)
+                break;
+
+            if (in_ring && (gsize)bytes_read == want)
+            {
+                gsize backlog;
+
+                if (serial_reader_backlog(reader, stats, &backlog))
+                {
+                    if (backlog == 0)
+                        break;
+                    want = MAX(want, backlog);
+                }
+            }
+        }
+        else if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            /* EAGAIN ends the drain, EOF or any other error is a hangup */
+            if (bytes_read == 0 || errno != EAGAIN)
+                alive = FALSE;
+            break;
+        }
+    }
+
+    if (reader->drained->len > 0)
+    {
+        /* chunks are published after their data, main loop never waits */
+        g_mutex_lock(&reader->chunk_lock);
+        g_array_append_vals(reader->chunks, reader->drained->data, reader->drained->len);
+        g_mutex_unlock(&reader->chunk_lock);
+        g_array_set_size(reader->drained, 0);
+    }
+
+    if (received)
+        serial_reader_wakeup(reader);
+
+    return alive;
+}
+
+static void serial_reader_publish(SerialReader *reader, SerialReaderStats *stats)
+{
+    guint i;
+
+    g_atomic_pointer_add(&reader->stats.bytes, stats->bytes);
+    g_atomic_pointer_add(&reader->stats.reads, stats->reads);
+    g_atomic_pointer_add(&reader->stats.polls, stats->polls);
+    g_atomic_pointer_add(&reader->stats.ioctls, stats->ioctls);
+    for (i = 0; i < READ_SIZE_BUCKETS; i++)
+    {
+        if (stats->read_sizes[i] != 0)
+            g_atomic_pointer_add(&reader->stats.read_sizes[i], stats->read_sizes[i]);
+    }
+    memset(stats, 0, sizeof(SerialReaderStats));
+}
+
+/**
+ *  Watches fd for writability only while transmit queue has data, as a
+ *  tty is writable nearly all the time. Called with queue lock held.
+ **/
+static void serial_reader_kick(gpointer data, gboolean pending)
+{
+    SerialReader *reader = (SerialReader*)data;
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLPRI | (pending ? EPOLLOUT : 0);
+    ev.data.u64 = reader->id;
+
+    /* fails with ENOENT after hangup, there is nothing to write to then */
+    epoll_ctl(engine->epfd, EPOLL_CTL_MOD, reader->fd, &ev);
+}
+
+/**
+ *  Handles epoll events of one reader, called with engine lock held.
+ **/
+static void serial_reader_handle(SerialReader *reader, guint32 events)
+{
+    SerialReaderStats *stats = &reader->pending;
+    gboolean alive = TRUE;
+
+    stats->polls++;
+
+    if (events & EPOLLOUT)
+        alive = tx_queue_write(reader->tx, reader->fd, serial_reader_written, reader);
+
+    if (alive && (events & (EPOLLIN | EPOLLPRI)))
+        alive = serial_reader_drain(reader, stats);
+    else if (events & (EPOLLHUP | EPOLLERR))
+        alive = FALSE;
+
+    serial_reader_publish(reader, stats);
+    if (alive)
+        return;
+
+    /* device went away (I/O error, EOF or hangup), stop watching it */
+    epoll_ctl(engine->epfd, EPOLL_CTL_DEL, reader->fd, NULL);
+    g_atomic_int_set(&reader->hangup, 1);
+    tx_queue_clear(reader->tx);
+    serial_reader_wakeup(reader);
+}
+
+static gpointer io_engine_thread(gpointer data)
+{
+    IoEngine *e = (IoEngine*)data;
+    struct epoll_event events[MAX_EVENTS];
+    gboolean quit = FALSE;
+
+    while (!quit)
+    {
+        int i, n = epoll_wait(e->epfd, events, MAX_EVENTS, -1);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            g_message("I/O thread epoll_wait failed: %s(%d)", strerror(errno), errno);
+            break;
+        }
+
+        g_mutex_lock(&e->lock);
+        for (i = 0; i < n; i++)
+        {
+            /* copied, epoll_event may be packed */
+            guint64 id = events[i].data.u64;
+            SerialReader *reader;
+
+            if (id == 0)
+            {
+                /* last reader is gone */
+                quit = TRUE;
+            }
+            else if ((reader = g_hash_table_lookup(e->readers, &id)) != NULL)
+            {
+                serial_reader_handle(reader, events[i].events);
+            }
+        }
+        g_mutex_unlock(&e->lock);
+    }
+
+    return NULL;
+}
+
+static IoEngine *io_engine_new(void)
+{
+    IoEngine *e = g_slice_new0(IoEngine);
+    struct epoll_event ev;
+
+    e->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (e->epfd < 0)
+    {
+        g_message("Unable to create epoll set: %s(%d)", strerror(errno), errno);
+        g_slice_free(IoEngine, e);
+        return NULL;
+    }
+
+    if (pipe(e->stop_pipe) < 0)
+    {
+        g_message("Unable to create pipe: %s(%d)", strerror(errno), errno);
+        close(e->epfd);
+        g_slice_free(IoEngine, e);
+        return NULL;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->stop_pipe[0], &ev);
+
+    g_mutex_init(&e->lock);
+    e->readers = g_hash_table_new(g_int64_hash, g_int64_equal);
+    e->thread = g_thread_new("serial-io", io_engine_thread, e);
+
+    return e;
+}
+
+static void io_engine_free(IoEngine *e)
+{
+    char c = 0;
+
+    if (write(e->stop_pipe[1], &c, 1) != 1)
+    {
+        g_message("Unable to stop I/O thread: %s(%d)", strerror(errno), errno);
+    }
+    g_thread_join(e->thread);
+
+    close(e->stop_pipe[0]);
+    close(e->stop_pipe[1]);
+    close(e->epfd);
+    g_hash_table_destroy(e->readers);
+    g_mutex_clear(&e->lock);
+    g_free(e->scratch);
+    g_slice_free(IoEngine, e);
+}
+
+/**
+ *  Starts reading fd on the shared I/O thread. fd must be in non-blocking
+ *  mode and must not be read by anyone else until serial_reader_free()
+ *  is called. callback is invoked from default main context whenever new
+ *  data arrives or device hangs up; it should drain the ring buffer.
+ *  Must be called from main thread.
+ *
+ *  \return NULL on error
+ **/
+SerialReader *serial_reader_new(int fd, gsize ring_size,
+                                GSourceFunc callback, gpointer data)
+{
+    SerialReader *reader;
+    struct epoll_event ev;
+
+    if (engine == NULL && (engine = io_engine_new()) == NULL)
+        return NULL;
+
+    reader = g_slice_new0(SerialReader);
+    reader->fd = fd;
+    reader->id = ++last_reader_id;
+    g_mutex_init(&reader->capture_lock);
+    g_mutex_init(&reader->trigger_lock);
+    reader->trigger_events = g_array_new(FALSE, FALSE, sizeof(TriggerEvent));
+    g_mutex_init(&reader->chunk_lock);
+    reader->chunks = g_array_new(FALSE, FALSE, sizeof(SerialReaderChunk));
+    reader->drained = g_array_new(FALSE, FALSE, sizeof(SerialReaderChunk));
+    reader->ring = ring_buffer_new(ring_size);
+    reader->tx = tx_queue_new(TX_QUEUE_LIMIT);
+    reader->callback = callback;
+    reader->data = data;
+    reader->wakeup_priority = G_PRIORITY_DEFAULT;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLPRI;
+    ev.data.u64 = reader->id;
+
+    g_mutex_lock(&engine->lock);
+    if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        g_mutex_unlock(&engine->lock);
+        g_message("Unable to watch serial port: %s(%d)", strerror(errno), errno);
+        ring_buffer_free(reader->ring);
+        tx_queue_free(reader->tx);
+        g_mutex_clear(&reader->capture_lock);
+        g_mutex_clear(&reader->trigger_lock);
+        g_array_free(reader->trigger_events, TRUE);
+        g_mutex_clear(&reader->chunk_lock);
+        g_array_free(reader->chunks, TRUE);
+        g_array_free(reader->drained, TRUE);
+        g_slice_free(SerialReader, reader);
+        return NULL;
+    }
+    g_hash_table_insert(engine->readers, &reader->id, reader);
+    g_mutex_unlock(&engine->lock);
+
+    tx_queue_set_kick(reader->tx, serial_reader_kick, reader);
+
+    return reader;
+}
+
+/**
+ *  Stops reading and frees all resources. Does not close fd.
+ **/
+void serial_reader_free(SerialReader *reader)
+{
+    /* once I/O thread releases the lock it won't touch reader again */
+    g_mutex_lock(&engine->lock);
+    g_hash_table_remove(engine->readers, &reader->id);
+    epoll_ctl(engine->epfd, EPOLL_CTL_DEL, reader->fd, NULL);
+    g_mutex_unlock(&engine->lock);
+
+    if (g_atomic_int_get(&reader->wakeup_pending))
+    {
+        g_source_remove(reader->wakeup_source);
+    }
+
+    if (g_hash_table_size(engine->readers) == 0)
+    {
+        io_engine_free(engine);
+        engine = NULL;
+    }
+
+    ring_buffer_free(reader->ring);
+    tx_queue_free(reader->tx);
+    g_mutex_clear(&reader->capture_lock);
+    if (reader->pre_capture != NULL)
+        g_byte_array_free(reader->pre_capture, TRUE);
+    if (reader->triggers != NULL)
+        trigger_set_unref(reader->triggers);
+    g_mutex_clear(&reader->trigger_lock);
+    g_array_free(reader->trigger_events, TRUE);
+    g_mutex_clear(&reader->chunk_lock);
+    g_array_free(reader->chunks, TRUE);
+    g_array_free(reader->drained, TRUE);
+    g_slice_free(SerialReader, reader);
+}
+
+/**
+ *  Returns queue of data to be sent. It is written by the I/O thread as
+ *  fast as the port takes it; data that was written is also captured.
+ **/
+TxQueue *serial_reader_get_tx_queue(SerialReader *reader)
+{
+    return reader->tx;
+}
+
+/**
+ *  Makes reader append everything it receives and sends to capture.
+ *  When this returns, reader no longer uses previously set capture.
+ *  Data kept since a capture start trigger goes into capture first; if a
+ *  stop trigger fired meanwhile, capture gets only that data.
+ **/
+void serial_reader_set_capture(SerialReader *reader, CaptureWriter *capture)
+{
+    gboolean stopped = FALSE;
+
+    g_mutex_lock(&reader->capture_lock);
+    if (capture != NULL && reader->pre_capture != NULL)
+    {
+        const guint8 *data = reader->pre_capture->data;
+        const guint8 *end = data + reader->pre_capture->len;
+        PreCaptureRecord record;
+
+        while (data < end)
+        {
+            memcpy(&record, data, sizeof(record));
+            data += sizeof(record);
+            capture_writer_append(capture, record.type, record.timestamp, data, record.len);
+            data += record.len;
+        }
+
+        if (reader->pre_capture_dropped > 0)
+        {
+            g_message("%" G_GSIZE_FORMAT " bytes received before capture was opened were dropped",
+                      reader->pre_capture_dropped);
+        }
+        stopped = reader->pre_capture_stopped;
+        g_byte_array_free(reader->pre_capture, TRUE);
+        reader->pre_capture = NULL;
+    }
+    reader->capture = stopped ? NULL : capture;
+    g_mutex_unlock(&reader->capture_lock);
+}
+
+/**
+ *  Drops data kept since a capture start trigger, for when the capture
+ *  could not be opened.
+ **/
+void serial_reader_cancel_capture(SerialReader *reader)
+{
+    g_mutex_lock(&reader->capture_lock);
+    if (reader->pre_capture != NULL)
+    {
+        g_byte_array_free(reader->pre_capture, TRUE);
+        reader->pre_capture = NULL;
+    }
+    g_mutex_unlock(&reader->capture_lock);
+}
+
+/**
+ *  Makes reader match received data against compiled triggers, NULL stops
+ *  matching. Reader keeps a reference; a new set starts matching from
+ *  scratch with the next read.
+ **/
+void serial_reader_set_triggers(SerialReader *reader, TriggerSet *triggers)
+{
+    TriggerSet *old;
+
+    if (triggers != NULL)
+        trigger_set_ref(triggers);
+
+    g_mutex_lock(&reader->trigger_lock);
+    old = reader->triggers;
+    reader->triggers = triggers;
+    reader->trigger_state = 0;
+    g_mutex_unlock(&reader->trigger_lock);
+
+    if (old != NULL)
+        trigger_set_unref(old);
+}
+
+/**
+ *  \return triggers that fired since last call in order they fired, or NULL
+ *  if none did; free with g_array_free()
+ **/
+GArray *serial_reader_take_trigger_events(SerialReader *reader)
+{
+    GArray *events = NULL;
+
+    g_mutex_lock(&reader->trigger_lock);
+    if (reader->trigger_events->len > 0)
+    {
+        events = reader->trigger_events;
+        reader->trigger_events = g_array_new(FALSE, FALSE, sizeof(TriggerEvent));
+    }
+    g_mutex_unlock(&reader->trigger_lock);
+
+    return events;
+}
+
+RingBuffer *serial_reader_get_ring(SerialReader *reader)
+{
+    return reader->ring;
+}
+
+/**
+ *  \return number of bytes dropped because ring buffer was full
+ **/
+gsize serial_reader_get_overruns(SerialReader *reader)
+{
+    return (gsize)g_atomic_pointer_get(&reader->overruns);
+}
+
+/**
+ *  Tells reader baudrate of the port, used to size its buffers.
+ **/
+void serial_reader_set_baudrate(SerialReader *reader, guint baudrate)
+{
+    g_atomic_int_set(&reader->baudrate, MIN(baudrate, G_MAXINT));
+}
+
+/**
+ *  In low latency mode callback is dispatched ahead of redraws and any
+ *  other pending main loop work, instead of taking its turn with them.
+ **/
+void serial_reader_set_low_latency(SerialReader *reader, gboolean low_latency)
+{
+    g_atomic_int_set(&reader->wakeup_priority,
+                     low_latency ? G_PRIORITY_HIGH : G_PRIORITY_DEFAULT);
+}
+
+/**
+ *  Copies syscall counters. (reads + polls + ioctls) / bytes is the number
+ *  of syscalls reader needed per received byte.
+ **/
+void serial_reader_get_stats(SerialReader *reader, SerialReaderStats *stats)
+{
+    guint i;
+
+    stats->bytes = (gsize)g_atomic_pointer_get(&reader->stats.bytes);
+    stats->reads = (gsize)g_atomic_pointer_get(&reader->stats.reads);
+    stats->polls = (gsize)g_atomic_pointer_get(&reader->stats.polls);
+    stats->ioctls = (gsize)g_atomic_pointer_get(&reader->stats.ioctls);
+    for (i = 0; i < READ_SIZE_BUCKETS; i++)
+        stats->read_sizes[i] = (gsize)g_atomic_pointer_get(&reader->stats.read_sizes[i]);
+}
+
+gboolean serial_reader_is_hangup(SerialReader *reader)
+{
+    return g_atomic_int_get(&reader->hangup) ? TRUE : FALSE;
+}
+
+/**
+ *  Takes records of data in ring buffer, in order it was read. Data of
+ *  a chunk is always in the ring before the chunk is returned here, while
+ *  the ring may already hold data of chunks not returned yet.
+ *
+ *  \return array of SerialReaderChunk, NULL if there are no new chunks;
+ *  free with g_array_free()
+ **/
+GArray *serial_reader_take_chunks(SerialReader *reader)
+{
+    GArray *chunks = NULL;
+
+    g_mutex_lock(&reader->chunk_lock);
+    if (reader->chunks->len > 0)
+    {
+        chunks = reader->chunks;
+        reader->chunks = g_array_new(FALSE, FALSE, sizeof(SerialReaderChunk));
+    }
+    g_mutex_unlock(&reader->chunk_lock);
+
+    return chunks;
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <glib.h>
+#include "ringbuffer.h"
+#include "capture.h"
+#include "txqueue.h"
+#include "trigger.h"
+
+/**
+ *  Serial port reader. Everything that arrives on fd is read by a single
+ *  I/O thread shared by all readers into a per port ring buffer, and
+ *  callback is called from the main loop, so received data can be drained
+ *  with ring_buffer_read_ptr()/ring_buffer_consume(), in chunks whose
+ *  arrival times are taken with serial_reader_take_chunks().
+ *  Data pushed to its transmit queue is written by the same thread.
+ *
+ *  Received data is also matched against a trigger set on the I/O thread,
+ *  so sending data and changing RTS/DTR in response does not wait for
+ *  the main loop. Capture start and stop take effect at the matching read
+ *  too: data is kept from a start trigger on until main loop has opened
+ *  the capture, and nothing goes into capture after a stop trigger.
+ *  Matches are then reported to callback, which takes them with
+ *  serial_reader_take_trigger_events().
+ **/
+typedef struct _SerialReader SerialReader;
+
+/* read sizes are counted in power of two buckets, last one is open ended */
+#define READ_SIZE_BUCKETS 17
+
+typedef struct {
+    gsize bytes;  /* received, including dropped */
+    gsize reads;  /* read() calls */
+    gsize polls;  /* I/O thread wakeups for this port */
+    gsize ioctls; /* FIONREAD calls */
+    gsize read_sizes[READ_SIZE_BUCKETS]; /* [i] counts reads of 2^i..2^(i+1)-1 bytes */
+} SerialReaderStats;
+
+/* data returned by one read() */
+typedef struct {
+    gsize len;
+    gint64 time;      /* CLOCK_MONOTONIC_RAW when read() returned, in ns */
+    gint64 monotonic; /* same on g_get_monotonic_time() clock, in us */
+} SerialReaderChunk;
+
+SerialReader *serial_reader_new(int fd, gsize ring_size,
+                                GSourceFunc callback, gpointer data);
+void serial_reader_free(SerialReader *reader);
+
+RingBuffer *serial_reader_get_ring(SerialReader *reader);
+TxQueue *serial_reader_get_tx_queue(SerialReader *reader);
+gsize serial_reader_get_overruns(SerialReader *reader);
+gboolean serial_reader_is_hangup(SerialReader *reader);
+GArray *serial_reader_take_chunks(SerialReader *reader);
+
+void serial_reader_set_baudrate(SerialReader *reader, guint baudrate);
+void serial_reader_set_low_latency(SerialReader *reader, gboolean low_latency);
+void serial_reader_get_stats(SerialReader *reader, SerialReaderStats *stats);
+
+void serial_reader_set_capture(SerialReader *reader, CaptureWriter *capture);
+void serial_reader_cancel_capture(SerialReader *reader);
+void serial_reader_set_triggers(SerialReader *reader, TriggerSet *triggers);
+GArray *serial_reader_take_trigger_events(SerialReader *reader);
+
+#endif /* READER_H */
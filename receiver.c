@@ -0,0 +1,316 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include "receiver.h"
+
+/* size of ring buffer between reader thread and main loop */
+#define RX_RING_SIZE (1024 * 1024)
+
+struct _Receiver {
+    SerialReader *reader;
+    Display *display;
+    ByteStore *store;
+    HexView *hexview;
+    FrameView *frameview;
+    LineIndex *lines;
+    SearchIndex *search;
+    TimeIndex *times;
+
+    guint64 received;
+    gboolean hangup_reported;
+
+    gint64 sent_time; /* of request awaiting reply, 0 if none */
+    ReceiverRoundTripFunc round_trip_func;
+    gpointer round_trip_data;
+
+    ReceiverTriggerFunc trigger_func;
+    gpointer trigger_data;
+
+    ReceiverHangupFunc hangup_func;
+    gpointer hangup_data;
+};
+
+/**
+ *  Passes data that arrived at given time on to views and indexes.
+ **/
+static void receiver_consume(Receiver *rx, const guint8 *c, gsize bytes_read,
+                             gint64 arrival)
+{
+    gsize pos = 0;
+
+    while (pos < bytes_read)
+    {
+        gboolean line_end;
+        gsize len = line_index_append(rx->lines, c + pos, bytes_read - pos,
+                                      arrival, &line_end);
+
+        /* text view is updated once per frame */
+        display_append(rx->display, c + pos, len, arrival);
+        if (line_end)
+            display_end_line(rx->display);
+        pos += len;
+    }
+    if (rx->frameview != NULL && frame_view_get_decoder(rx->frameview) != NULL)
+    {
+        /* frames refer to data by its offset in store */
+        frame_decoder_feed(frame_view_get_decoder(rx->frameview), c, bytes_read,
+                           byte_store_get_end(rx->store), arrival);
+    }
+    byte_store_append(rx->store, c, bytes_read);
+    rx->received += bytes_read;
+}
+
+/**
+ *  Drains data received by serial reader thread.
+ *  Called from main loop whenever reader thread has put data into ring buffer.
+ *  Data is taken chunk by chunk, each with the time its read() returned;
+ *  data of chunks not published yet is left for the next call.
+ **/
+static gboolean receiver_read_cb(gpointer data)
+{
+    Receiver *rx = (Receiver*)data;
+    RingBuffer *ring;
+    guint64 bytes_total = rx->received;
+    GArray *chunks;
+    GArray *events;
+
+    if (rx->reader == NULL)
+        return FALSE;
+
+    ring = serial_reader_get_ring(rx->reader);
+    chunks = serial_reader_take_chunks(rx->reader);
+    if (chunks != NULL)
+    {
+        guint i;
+
+        for (i = 0; i < chunks->len; i++)
+        {
+            SerialReaderChunk *chunk = &g_array_index(chunks, SerialReaderChunk, i);
+            gsize left = chunk->len;
+            const guint8 *c;
+            gsize bytes_read;
+
+            /* chunk may wrap around the end of the ring */
+            while (left > 0 && (c = ring_buffer_read_ptr(ring, &bytes_read)) != NULL)
+            {
+                bytes_read = MIN(bytes_read, left);
+                receiver_consume(rx, c, bytes_read, chunk->monotonic);
+                ring_buffer_consume(ring, bytes_read);
+                left -= bytes_read;
+            }
+            time_index_append(rx->times, chunk->len - left, chunk->time, chunk->monotonic);
+        }
+        g_array_free(chunks, TRUE);
+    }
+
+    search_index_update(rx->search);
+    if (rx->hexview != NULL)
+        hex_view_data_changed(rx->hexview);
+    if (rx->frameview != NULL)
+        frame_view_data_changed(rx->frameview);
+
+    if (rx->sent_time != 0 && bytes_total != rx->received)
+    {
+        gint64 round_trip = g_get_monotonic_time() - rx->sent_time;
+
+        rx->sent_time = 0;
+        if (rx->round_trip_func != NULL)
+            rx->round_trip_func(rx, round_trip, rx->round_trip_data);
+    }
+
+    events = serial_reader_take_trigger_events(rx->reader);
+    if (events != NULL)
+    {
+        guint i;
+
+        for (i = 0; i < events->len && rx->trigger_func != NULL; i++)
+            rx->trigger_func(rx, &g_array_index(events, TriggerEvent, i), rx->trigger_data);
+        g_array_free(events, TRUE);
+    }
+
+    if (serial_reader_is_hangup(rx->reader) && !rx->hangup_reported)
+    {
+        g_message("Serial port hung up");
+        rx->hangup_reported = TRUE;
+        if (rx->hangup_func != NULL)
+            rx->hangup_func(rx, rx->hangup_data);
+    }
+
+    return FALSE;
+}
+
+/**
+ *  Creates receive path feeding given display and store.
+ *  hexview and frameview may be NULL if store is not shown or not decoded.
+ *  Received data is split into lines at terminator (see lineindex.h),
+ *  display shows one line per indexed line.
+ **/
+Receiver *receiver_new(Display *display, ByteStore *store, HexView *hexview,
+                       FrameView *frameview, const gchar *terminator,
+                       gsize n_terminator)
+{
+    Receiver *rx = g_slice_new0(Receiver);
+
+    rx->display = display;
+    rx->store = store;
+    rx->hexview = hexview;
+    rx->frameview = frameview;
+    rx->lines = line_index_new(terminator, n_terminator);
+    rx->search = search_index_new(store);
+    rx->times = time_index_new();
+    display_set_line_index(display, rx->lines);
+    if (hexview != NULL)
+        hex_view_set_time_index(hexview, rx->times);
+
+    return rx;
+}
+
+void receiver_free(Receiver *rx)
+{
+    receiver_stop(rx);
+    display_set_line_index(rx->display, NULL);
+    if (rx->hexview != NULL)
+        hex_view_set_time_index(rx->hexview, NULL);
+    line_index_free(rx->lines);
+    search_index_free(rx->search);
+    time_index_free(rx->times);
+    g_slice_free(Receiver, rx);
+}
+
+/**
+ *  Starts reading from fd. Caller keeps ownership of fd and must not close
+ *  it before receiver_stop().
+ *
+ *  \return FALSE if reader thread could not be started
+ **/
+gboolean receiver_start(Receiver *rx, int fd)
+{
+    receiver_stop(rx);
+
+    rx->reader = serial_reader_new(fd, RX_RING_SIZE, receiver_read_cb, rx);
+    rx->hangup_reported = FALSE;
+    rx->sent_time = 0;
+
+    return rx->reader != NULL;
+}
+
+void receiver_stop(Receiver *rx)
+{
+    if (rx->reader != NULL)
+    {
+        serial_reader_free(rx->reader);
+        rx->reader = NULL;
+    }
+}
+
+/**
+ *  \return running serial reader, NULL if not started
+ **/
+SerialReader *receiver_get_reader(Receiver *rx)
+{
+    return rx->reader;
+}
+
+/**
+ *  \return index of received lines, offsets in it match byte store offsets
+ **/
+LineIndex *receiver_get_line_index(Receiver *rx)
+{
+    return rx->lines;
+}
+
+/**
+ *  \return search index of byte store, kept up to date as data arrives
+ **/
+SearchIndex *receiver_get_search_index(Receiver *rx)
+{
+    return rx->search;
+}
+
+/**
+ *  \return arrival times of received chunks, offsets in it match byte
+ *  store offsets
+ **/
+TimeIndex *receiver_get_time_index(Receiver *rx)
+{
+    return rx->times;
+}
+
+/**
+ *  Splits lines received from now on at terminator, '\n' if n_terminator
+ *  is 0.
+ **/
+void receiver_set_terminator(Receiver *rx, const gchar *terminator,
+                             gsize n_terminator)
+{
+    line_index_set_terminator(rx->lines, terminator, n_terminator);
+}
+
+/**
+ *  \return number of bytes passed on to display since receiver was created
+ **/
+guint64 receiver_get_received(Receiver *rx)
+{
+    return rx->received;
+}
+
+/**
+ *  Notes that a request was just sent. Time until the first data received
+ *  after it reaches main loop is passed to round trip callback.
+ **/
+void receiver_mark_sent(Receiver *rx)
+{
+    rx->sent_time = g_get_monotonic_time();
+}
+
+void receiver_set_round_trip_func(Receiver *rx, ReceiverRoundTripFunc func,
+                                  gpointer data)
+{
+    rx->round_trip_func = func;
+    rx->round_trip_data = data;
+}
+
+/**
+ *  Sets function told about triggers that fired. Actions other than
+ *  starting and stopping capture were already carried out by reader.
+ **/
+void receiver_set_trigger_func(Receiver *rx, ReceiverTriggerFunc func, gpointer data)
+{
+    rx->trigger_func = func;
+    rx->trigger_data = data;
+}
+
+/**
+ *  Sets function told when port goes away, e.g. when USB device is
+ *  unplugged.
+ **/
+void receiver_set_hangup_func(Receiver *rx, ReceiverHangupFunc func, gpointer data)
+{
+    rx->hangup_func = func;
+    rx->hangup_data = data;
+}
+
+/**
+ *  Marks a gap in received data, like the time port was gone before it
+ *  was reopened: data received from now on starts a new line, shown with
+ *  its own timestamp.
+ **/
+void receiver_mark_gap(Receiver *rx)
+{
+    if (line_index_end_line(rx->lines))
+        display_end_line(rx->display);
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <glib.h>
+#include "reader.h"
+#include "display.h"
+#include "bytestore.h"
+#include "hexview.h"
+#include "frameview.h"
+#include "lineindex.h"
+#include "search.h"
+#include "timeindex.h"
+
+/**
+ *  Receive path of the GUI: runs serial reader on a connected fd and hands
+ *  everything it reads to text display, byte store, hex view and frame
+ *  decoder. Also
+ *  indexes received data by lines, by arrival time and for searching.
+ **/
+typedef struct _Receiver Receiver;
+
+/* round_trip is in microseconds */
+typedef void (*ReceiverRoundTripFunc)(Receiver *rx, gint64 round_trip, gpointer data);
+/* called from main loop for every trigger that fired in reader */
+typedef void (*ReceiverTriggerFunc)(Receiver *rx, const TriggerEvent *event, gpointer data);
+/* called from main loop once port went away, receiver may be stopped from it */
+typedef void (*ReceiverHangupFunc)(Receiver *rx, gpointer data);
+
+Receiver *receiver_new(Display *display, ByteStore *store, HexView *hexview,
+                       FrameView *frameview, const gchar *terminator,
+                       gsize n_terminator);
+void receiver_free(Receiver *rx);
+
+gboolean receiver_start(Receiver *rx, int fd);
+void receiver_stop(Receiver *rx);
+
+SerialReader *receiver_get_reader(Receiver *rx);
+guint64 receiver_get_received(Receiver *rx);
+LineIndex *receiver_get_line_index(Receiver *rx);
+SearchIndex *receiver_get_search_index(Receiver *rx);
+TimeIndex *receiver_get_time_index(Receiver *rx);
+void receiver_set_terminator(Receiver *rx, const gchar *terminator,
+                             gsize n_terminator);
+
+void receiver_mark_sent(Receiver *rx);
+void receiver_set_round_trip_func(Receiver *rx, ReceiverRoundTripFunc func,
+                                  gpointer data);
+void receiver_set_trigger_func(Receiver *rx, ReceiverTriggerFunc func, gpointer data);
+void receiver_set_hangup_func(Receiver *rx, ReceiverHangupFunc func, gpointer data);
+void receiver_mark_gap(Receiver *rx);
+
+#endif /* RECEIVER_H */
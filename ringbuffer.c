@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "ringbuffer.h"
+
+struct _RingBuffer {
+    guint8 *data;
+    guint size;   /* always power of two */
+    guint mask;
+
+    /*
+       Free running counters, only ever incremented. head is written by
+       the producer only, tail by the consumer only.
+    */
+    gint head;
+    gint tail;
+};
+
+RingBuffer *ring_buffer_new(gsize size)
+{
+    RingBuffer *rb = g_slice_new0(RingBuffer);
+    guint real_size = 1;
+
+    while (real_size < size)
+        real_size <<= 1;
+
+    rb->data = g_malloc(real_size);
+    rb->size = real_size;
+    rb->mask = real_size - 1;
+
+    return rb;
+}
+
+void ring_buffer_free(RingBuffer *rb)
+{
+    g_free(rb->data);
+    g_slice_free(RingBuffer, rb);
+}
+
+gsize ring_buffer_get_size(RingBuffer *rb)
+{
+    return rb->size;
+}
+
+gsize ring_buffer_get_fill(RingBuffer *rb)
+{
+    guint head = (guint)g_atomic_int_get(&rb->head);
+    guint tail = (guint)g_atomic_int_get(&rb->tail);
+
+    return head - tail;
+}
+
+/**
+ *  Returns pointer to contiguous free space and stores its length in len.
+ *  Data written there becomes visible to consumer after ring_buffer_commit().
+ *
+ *  \return NULL if ring buffer is full
+ **/
+guint8 *ring_buffer_write_ptr(RingBuffer *rb, gsize *len)
+{
+    guint head = (guint)rb->head; /* only we modify head */
+    guint tail = (guint)g_atomic_int_get(&rb->tail);
+    guint free_space = rb->size - (head - tail);
+    guint offset = head & rb->mask;
+
+    *len = MIN(free_space, rb->size - offset);
+    if (*len == 0)
+        return NULL;
+
+    return rb->data + offset;
+}
+
+void ring_buffer_commit(RingBuffer *rb, gsize len)
+{
+    g_atomic_int_set(&rb->head, (gint)((guint)rb->head + len));
+}
+
+gsize ring_buffer_write(RingBuffer *rb, const guint8 *data, gsize len)
+{
+    gsize written = 0;
+
+    while (written < len)
+    {
+        gsize chunk;
+        guint8 *ptr = ring_buffer_write_ptr(rb, &chunk);
+
+        if (ptr == NULL)
+            break;
+
+        chunk = MIN(chunk, len - written);
+        memcpy(ptr, data + written, chunk);
+        ring_buffer_commit(rb, chunk);
+        written += chunk;
+    }
+
+    return written;
+}
+
+/**
+ *  Returns pointer to contiguous readable data and stores its length in len.
+ *  Data stays valid until ring_buffer_consume() is called.
+ *
+ *  \return NULL if ring buffer is empty
+ **/
+const guint8 *ring_buffer_read_ptr(RingBuffer *rb, gsize *len)
+{
+    guint head = (guint)g_atomic_int_get(&rb->head);
+    guint tail = (guint)rb->tail; /* only we modify tail */
+    guint offset = tail & rb->mask;
+
+    *len = MIN(head - tail, rb->size - offset);
+    if (*len == 0)
+        return NULL;
+
+    return rb->data + offset;
+}
+
+void ring_buffer_consume(RingBuffer *rb, gsize len)
+{
+    g_atomic_int_set(&rb->tail, (gint)((guint)rb->tail + len));
+}
+
+gsize ring_buffer_read(RingBuffer *rb, guint8 *data, gsize len)
+{
+    gsize read = 0;
+
+    while (read < len)
+    {
+        gsize chunk;
+        const guint8 *ptr = ring_buffer_read_ptr(rb, &chunk);
+
+        if (ptr == NULL)
+            break;
+
+        chunk = MIN(chunk, len - read);
+        memcpy(data + read, ptr, chunk);
+        ring_buffer_consume(rb, chunk);
+        read += chunk;
+    }
+
+    return read;
+}
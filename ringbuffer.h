@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <glib.h>
+
+/**
+ *  Single-producer/single-consumer byte ring buffer.
+ *  Exactly one thread may call the producer functions (write, write_ptr,
+ *  commit) and exactly one thread may call the consumer functions (read,
+ *  read_ptr, consume). No locks are taken.
+ **/
+typedef struct _RingBuffer RingBuffer;
+
+RingBuffer *ring_buffer_new(gsize size);
+void ring_buffer_free(RingBuffer *rb);
+
+gsize ring_buffer_get_size(RingBuffer *rb);
+gsize ring_buffer_get_fill(RingBuffer *rb);
+
+/* producer side */
+gsize ring_buffer_write(RingBuffer *rb, const guint8 *data, gsize len);
+guint8 *ring_buffer_write_ptr(RingBuffer *rb, gsize *len);
+void ring_buffer_commit(RingBuffer *rb, gsize len);
+
+/* consumer side */
+gsize ring_buffer_read(RingBuffer *rb, guint8 *data, gsize len);
+const guint8 *ring_buffer_read_ptr(RingBuffer *rb, gsize *len);
+void ring_buffer_consume(RingBuffer *rb, gsize len);
+
+#endif /* RINGBUFFER_H */
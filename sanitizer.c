@@ -0,0 +1,342 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "sanitizer.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SSE2
+#define HAVE_AVX2
+#endif
+
+/* longest UTF-8 sequence is 4 bytes, so at most 3 are ever held back */
+#define MAX_CARRY 3
+
+struct _Utf8Sanitizer {
+    guint8 carry[MAX_CARRY];
+    gsize n_carry;
+    gboolean line_breaks;
+};
+
+typedef gsize (*AsciiScanFunc)(const guint8 *data, gsize len, gboolean breaks);
+
+static inline gboolean is_plain(guint8 c, gboolean breaks)
+{
+    return (c >= 0x20 && c < 0x7F) || c == '\t' || (breaks && (c == '\n' || c == '\r'));
+}
+
+static gsize scan_ascii_scalar(const guint8 *data, gsize len, gboolean breaks)
+{
+    gsize i;
+
+    for (i = 0; i < len && is_plain(data[i], breaks); i++)
+        ;
+
+    return i;
+}
+
+#ifdef HAVE_SSE2
+/**
+ *  \return number of leading bytes for which is_plain() holds
+ **/
+static gsize scan_ascii_sse2(const guint8 *data, gsize len, gboolean breaks)
+{
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i keep_breaks = _mm_set1_epi8(breaks ? -1 : 0);
+    gsize i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        /* signed compare, so bytes >= 0x80 count as below space too */
+        __m128i special = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        __m128i allowed = _mm_or_si128(_mm_and_si128(keep_breaks,
+                                                     _mm_or_si128(_mm_cmpeq_epi8(v, lf),
+                                                                  _mm_cmpeq_epi8(v, cr))),
+                                       _mm_cmpeq_epi8(v, tab));
+        int mask = _mm_movemask_epi8(_mm_andnot_si128(allowed, special));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_ascii_scalar(data + i, len - i, breaks);
+}
+#endif
+
+#ifdef HAVE_AVX2
+__attribute__((target("avx2")))
+static gsize scan_ascii_avx2(const guint8 *data, gsize len, gboolean breaks)
+{
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i keep_breaks = _mm256_set1_epi8(breaks ? -1 : 0);
+    gsize i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i special = _mm256_or_si256(_mm256_cmpgt_epi8(space, v),
+                                          _mm256_cmpeq_epi8(v, del));
+        __m256i allowed = _mm256_or_si256(_mm256_and_si256(keep_breaks,
+                                                           _mm256_or_si256(_mm256_cmpeq_epi8(v, lf),
+                                                                           _mm256_cmpeq_epi8(v, cr))),
+                                          _mm256_cmpeq_epi8(v, tab));
+        guint32 mask = (guint32)_mm256_movemask_epi8(_mm256_andnot_si256(allowed, special));
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_ascii_sse2(data + i, len - i, breaks);
+}
+#endif
+
+static AsciiScanFunc get_scan_func(void)
+{
+    static AsciiScanFunc scan = NULL;
+
+    if (scan == NULL)
+    {
+        scan = scan_ascii_scalar;
+#ifdef HAVE_SSE2
+        scan = scan_ascii_sse2;
+#endif
+#ifdef HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            scan = scan_ascii_avx2;
+#endif
+    }
+
+    return scan;
+}
+
+/**
+ *  Checks UTF-8 sequence starting with a byte >= 0x80.
+ *
+ *  \return length of valid sequence, 0 if p[0] does not start one, or
+ *  -1 if all avail bytes are a valid prefix of a longer sequence
+ **/
+static gint utf8_sequence(const guint8 *p, gsize avail)
+{
+    guint8 lo = 0x80, hi = 0xBF;
+    gint n, i;
+
+    if (p[0] >= 0xC2 && p[0] <= 0xDF)
+        n = 2;
+    else if (p[0] >= 0xE0 && p[0] <= 0xEF)
+        n = 3;
+    else if (p[0] >= 0xF0 && p[0] <= 0xF4)
+        n = 4;
+    else
+        return 0;
+
+    /* second byte range excludes overlong forms, surrogates and > U+10FFFF */
+    if (p[0] == 0xE0)
+        lo = 0xA0;
+    else if (p[0] == 0xED)
+        hi = 0x9F;
+    else if (p[0] == 0xF0)
+        lo = 0x90;
+    else if (p[0] == 0xF4)
+        hi = 0x8F;
+
+    for (i = 1; i < n; i++)
+    {
+        if ((gsize)i >= avail)
+            return -1;
+        if (p[i] < lo || p[i] > hi)
+            return 0;
+        lo = 0x80;
+        hi = 0xBF;
+    }
+
+    return n;
+}
+
+static void append_escape(GByteArray *out, guint8 c)
+{
+    static const gchar hex[] = "0123456789abcdef";
+    guint8 esc[4];
+
+    if (c == 0)
+    {
+        g_byte_array_append(out, (const guint8*)"<NUL>", 5);
+        return;
+    }
+
+    esc[0] = '\\';
+    esc[1] = 'x';
+    esc[2] = hex[c >> 4];
+    esc[3] = hex[c & 0x0F];
+    g_byte_array_append(out, esc, 4);
+}
+
+/**
+ *  Sanitizes data into out, stopping before a trailing incomplete sequence.
+ *
+ *  \return number of bytes consumed
+ **/
+static gsize sanitize(const guint8 *data, gsize len, gboolean breaks, GByteArray *out)
+{
+    AsciiScanFunc scan = get_scan_func();
+    gsize i = 0;
+
+    while (i < len)
+    {
+        gsize run = scan(data + i, len - i, breaks);
+        gint n;
+
+        if (run > 0)
+        {
+            g_byte_array_append(out, data + i, run);
+            i += run;
+            if (i == len)
+                break;
+        }
+
+        if (data[i] == '\n' || data[i] == '\r')
+        {
+            /* only here when line breaks are not kept */
+            i++;
+            continue;
+        }
+
+        if (data[i] < 0x80)
+        {
+            append_escape(out, data[i]);
+            i++;
+            continue;
+        }
+
+        n = utf8_sequence(data + i, len - i);
+        if (n < 0)
+            break;
+
+        if (n == 0)
+        {
+            append_escape(out, data[i]);
+            i++;
+        }
+        else
+        {
+            g_byte_array_append(out, data + i, n);
+            i += n;
+        }
+    }
+
+    return i;
+}
+
+Utf8Sanitizer *utf8_sanitizer_new(void)
+{
+    Utf8Sanitizer *sanitizer = g_slice_new0(Utf8Sanitizer);
+
+    sanitizer->line_breaks = TRUE;
+
+    return sanitizer;
+}
+
+void utf8_sanitizer_free(Utf8Sanitizer *sanitizer)
+{
+    g_slice_free(Utf8Sanitizer, sanitizer);
+}
+
+/**
+ *  Forgets held back partial sequence, e.g. when stream is restarted.
+ **/
+void utf8_sanitizer_reset(Utf8Sanitizer *sanitizer)
+{
+    sanitizer->n_carry = 0;
+}
+
+/**
+ *  Sets whether CR and LF are passed through (default) or dropped.
+ **/
+void utf8_sanitizer_set_line_breaks(Utf8Sanitizer *sanitizer, gboolean keep)
+{
+    sanitizer->line_breaks = keep;
+}
+
+/**
+ *  Appends sanitized data to out. Up to 3 bytes of a sequence that is
+ *  not complete yet are held back for the next call.
+ **/
+void utf8_sanitizer_feed(Utf8Sanitizer *sanitizer, const guint8 *data, gsize len,
+                         GByteArray *out)
+{
+    gsize done;
+
+    if (sanitizer->n_carry > 0)
+    {
+        /* held bytes plus enough new ones to finish any sequence they start */
+        guint8 work[2 * MAX_CARRY];
+        gsize n_work = sanitizer->n_carry;
+        gsize n_new = MIN(len, MAX_CARRY);
+
+        memcpy(work, sanitizer->carry, n_work);
+        memcpy(work + n_work, data, n_new);
+        done = sanitize(work, n_work + n_new, sanitizer->line_breaks, out);
+
+        if (done < sanitizer->n_carry)
+        {
+            /* still incomplete, all new bytes belong to it */
+            memmove(sanitizer->carry, work + done, n_work + n_new - done);
+            sanitizer->n_carry = n_work + n_new - done;
+            return;
+        }
+
+        /* stopped on a sequence boundary inside new data, go on from there */
+        data += done - sanitizer->n_carry;
+        len -= done - sanitizer->n_carry;
+        sanitizer->n_carry = 0;
+    }
+
+    done = sanitize(data, len, sanitizer->line_breaks, out);
+    memcpy(sanitizer->carry, data + done, len - done);
+    sanitizer->n_carry = len - done;
+}
+
+/**
+ *  Escapes held back bytes, for when no continuation will follow (e.g. at
+ *  the end of a line).
+ **/
+void utf8_sanitizer_finish(Utf8Sanitizer *sanitizer, GByteArray *out)
+{
+    gsize i;
+
+    for (i = 0; i < sanitizer->n_carry; i++)
+        append_escape(out, sanitizer->carry[i]);
+    sanitizer->n_carry = 0;
+}
+
+/**
+ *  \return number of bytes held back, which are not in output yet
+ **/
+gsize utf8_sanitizer_get_held(Utf8Sanitizer *sanitizer)
+{
+    return sanitizer->n_carry;
+}
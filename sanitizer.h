@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef SANITIZER_H
+#define SANITIZER_H
+
+#include <glib.h>
+
+/**
+ *  Turns arbitrary received bytes into valid UTF-8 text. Printable ASCII,
+ *  tab, CR, LF and well-formed multi-byte sequences are passed through;
+ *  NUL is shown as <NUL>, other control bytes and bytes that are not part
+ *  of valid UTF-8 as \xNN. A sequence split between two calls is held
+ *  back and completed by the next one. When line breaks are not kept, CR
+ *  and LF are dropped, for callers that break lines themselves.
+ *
+ *  Runs of plain ASCII, the common case, are scanned 16 (SSE2) or 32 (AVX2,
+ *  chosen at runtime) bytes at a time.
+ **/
+typedef struct _Utf8Sanitizer Utf8Sanitizer;
+
+Utf8Sanitizer *utf8_sanitizer_new(void);
+void utf8_sanitizer_free(Utf8Sanitizer *sanitizer);
+void utf8_sanitizer_reset(Utf8Sanitizer *sanitizer);
+void utf8_sanitizer_set_line_breaks(Utf8Sanitizer *sanitizer, gboolean keep);
+
+void utf8_sanitizer_feed(Utf8Sanitizer *sanitizer, const guint8 *data, gsize len,
+                         GByteArray *out);
+void utf8_sanitizer_finish(Utf8Sanitizer *sanitizer, GByteArray *out);
+gsize utf8_sanitizer_get_held(Utf8Sanitizer *sanitizer);
+
+#endif /* SANITIZER_H */
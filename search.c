@@ -0,0 +1,710 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+#include "search.h"
+
+/* one bit per trigram hash, 1 KiB per block */
+#define FILTER_SHIFT 13
+#define FILTER_BYTES ((1 << FILTER_SHIFT) / 8)
+
+/*
+   Regex is matched block by block. Window starts this much before the
+   block, so lookbehind and ^ see preceding data, and matches may run
+   this far past the block end; longer matches are not found.
+*/
+#define REGEX_CONTEXT 256
+#define REGEX_OVERLAP 4096
+
+/* shared with searches, which may outlive its place in index */
+typedef struct {
+    gint ref_count;
+    guint8 bits[FILTER_BYTES];
+} BlockFilter;
+
+struct _SearchIndex {
+    ByteStore *store;
+    GPtrArray *filters;  /* of BlockFilter, one per block from first_block */
+    guint64 first_block; /* absolute, offset / SEARCH_BLOCK_SIZE */
+    guint64 indexed;     /* offset of next byte to index */
+    guint64 origin;      /* offset indexing started at */
+    guint8 prev[2];      /* two bytes before it, case folded */
+};
+
+struct _Search {
+    ByteStoreSnapshot *snap;
+    BlockFilter **filters; /* filters of complete blocks */
+    guint64 first_block;   /* block of filters[0] */
+    guint64 n_filters;
+
+    guint8 *pattern;    /* literal, case folded if ignore_case */
+    gsize n_pattern;
+    GRegex *regex;      /* NULL for literal search */
+    gboolean ignore_case;
+    guint32 *trigrams;  /* hashes that matching block must have */
+    gsize n_trigrams;
+
+    GThread *thread;
+    gint cancelled;
+    gint done;
+    gint notify_pending;
+    guint notify_source;
+    SearchDoneFunc func;
+    gpointer data;
+
+    /* written by search thread, read after done */
+    GArray *matches;    /* of SearchMatch, ordered by offset */
+    SearchStats stats;
+};
+
+static inline guint32 trigram_hash(guint8 a, guint8 b, guint8 c)
+{
+    return (((guint32)a << 16) | ((guint32)b << 8) | c) * 2654435761u >> (32 - FILTER_SHIFT);
+}
+
+static BlockFilter *block_filter_ref(BlockFilter *filter)
+{
+    g_atomic_int_inc(&filter->ref_count);
+
+    return filter;
+}
+
+static void block_filter_unref(gpointer data)
+{
+    BlockFilter *filter = (BlockFilter*)data;
+
+    if (g_atomic_int_dec_and_test(&filter->ref_count))
+        g_free(filter);
+}
+
+/**
+ *  Drops filters of blocks evicted from store and of the oldest blocks
+ *  over SEARCH_MAX_FILTERS.
+ **/
+static void search_index_trim(SearchIndex *index)
+{
+    guint64 store_block = byte_store_get_start(index->store) / SEARCH_BLOCK_SIZE;
+    guint n = 0;
+
+    if (store_block > index->first_block)
+        n = MIN(store_block - index->first_block, index->filters->len);
+    if (index->filters->len - n > SEARCH_MAX_FILTERS)
+        n = index->filters->len - SEARCH_MAX_FILTERS;
+
+    if (n > 0)
+    {
+        g_ptr_array_remove_range(index->filters, 0, n);
+        index->first_block += n;
+    }
+}
+
+/**
+ *  Creates index of data in store, including data already there.
+ **/
+SearchIndex *search_index_new(ByteStore *store)
+{
+    SearchIndex *index = g_slice_new0(SearchIndex);
+
+    index->store = store;
+    index->filters = g_ptr_array_new_with_free_func(block_filter_unref);
+    index->indexed = byte_store_get_start(store);
+    index->origin = index->indexed;
+    index->first_block = index->indexed / SEARCH_BLOCK_SIZE;
+    search_index_update(index);
+
+    return index;
+}
+
+/**
+ *  Searches using index must have been freed already.
+ **/
+void search_index_free(SearchIndex *index)
+{
+    g_ptr_array_free(index->filters, TRUE);
+    g_slice_free(SearchIndex, index);
+}
+
+/**
+ *  Indexes data appended to store since last update. Call as data arrives,
+ *  cost is proportional to amount of new data.
+ **/
+void search_index_update(SearchIndex *index)
+{
+    guint64 store_start = byte_store_get_start(index->store);
+    const guint8 *data;
+    gsize len;
+
+    if (index->indexed < store_start)
+    {
+        /* data was evicted before it was indexed, start over after it */
+        g_ptr_array_set_size(index->filters, 0);
+        index->indexed = store_start;
+        index->origin = store_start;
+        index->first_block = store_start / SEARCH_BLOCK_SIZE;
+    }
+
+    while ((data = byte_store_peek(index->store, index->indexed, &len)) != NULL)
+    {
+        guint8 *filter = NULL;
+        guint64 filter_end = 0; /* first trigram start not in filter */
+        gsize i;
+
+        for (i = 0; i < len; i++)
+        {
+            guint8 c = g_ascii_tolower(data[i]);
+            guint64 start = index->indexed + i - 2; /* of trigram ending at c */
+            guint32 h;
+
+            if (index->indexed + i >= index->origin + 2)
+            {
+                if (filter == NULL || start >= filter_end)
+                {
+                    guint64 block = start / SEARCH_BLOCK_SIZE;
+                    BlockFilter *block_filter;
+
+                    if (index->filters->len == 0)
+                        index->first_block = block;
+                    if (block - index->first_block == index->filters->len)
+                    {
+                        block_filter = g_new0(BlockFilter, 1);
+                        block_filter->ref_count = 1;
+                        g_ptr_array_add(index->filters, block_filter);
+                    }
+                    block_filter = g_ptr_array_index(index->filters,
+                                                     block - index->first_block);
+                    filter = block_filter->bits;
+                    filter_end = (block + 1) * SEARCH_BLOCK_SIZE;
+                }
+
+                h = trigram_hash(index->prev[0], index->prev[1], c);
+                filter[h / 8] |= 1 << (h % 8);
+            }
+            index->prev[0] = index->prev[1];
+            index->prev[1] = c;
+        }
+        index->indexed += len;
+    }
+
+    search_index_trim(index);
+}
+
+static void keep_longest(GByteArray *best, GByteArray *run)
+{
+    if (run->len > best->len)
+    {
+        g_byte_array_set_size(best, 0);
+        g_byte_array_append(best, run->data, run->len);
+    }
+    g_byte_array_set_size(run, 0);
+}
+
+/**
+ *  Skips arguments of escape sequence whose letter is at p, like the
+ *  digits of \x41 or \101, the braces of \p{L} or the letter of \cA.
+ *
+ *  \return last character of escape sequence, NULL if nothing can be
+ *  told about the rest of pattern (\Q quoting)
+ **/
+static const gchar *regex_skip_escape(const gchar *p)
+{
+    const gchar *close = NULL;
+    gint i;
+
+    switch (*p)
+    {
+        case 'Q':
+            return NULL;
+        case 'c':
+            return p[1] != '\0' ? p + 1 : p;
+        case 'x':
+            if (p[1] == '{')
+            {
+                close = "}";
+            }
+            else
+            {
+                for (i = 0; i < 2 && g_ascii_isxdigit(p[1]); i++)
+                    p++;
+                return p;
+            }
+            break;
+        case 'o':
+        case 'N':
+        case 'p':
+        case 'P':
+        case 'g':
+        case 'k':
+            if (p[1] == '{')
+                close = "}";
+            else if (p[1] == '<')
+                close = ">";
+            else if (p[1] == '\'')
+                close = "'";
+            else if (*p == 'p' || *p == 'P')
+                return p[1] != '\0' ? p + 1 : p;
+            else if (*p == 'g')
+            {
+                /* \g1, \g-1 */
+                if (p[1] == '-' || p[1] == '+')
+                    p++;
+                while (g_ascii_isdigit(p[1]))
+                    p++;
+                return p;
+            }
+            break;
+        default:
+            /* back reference or octal escape */
+            while (g_ascii_isdigit(*p) && g_ascii_isdigit(p[1]))
+                p++;
+            return p;
+    }
+
+    if (close != NULL)
+    {
+        p++;
+        while (p[1] != '\0' && *p != close[0])
+            p++;
+    }
+
+    return p;
+}
+
+/**
+ *  Finds longest run of characters any match of pattern must contain.
+ *  Conservative: anything inside parentheses or any pattern with
+ *  alternation, option settings like (?x) or \Q quoting yields nothing.
+ **/
+static GByteArray *regex_required_literal(const gchar *pattern)
+{
+    GByteArray *best = g_byte_array_new();
+    GByteArray *run = g_byte_array_new();
+    gint depth = 0;
+    const gchar *p;
+
+    if (strchr(pattern, '|') != NULL)
+    {
+        g_byte_array_free(run, TRUE);
+        return best;
+    }
+
+    for (p = pattern; *p != '\0'; p++)
+    {
+        gboolean literal = FALSE;
+        guint8 c = *p;
+
+        switch (*p)
+        {
+            case '\\':
+                if (p[1] == '\0')
+                    break;
+                p++;
+                literal = !g_ascii_isalnum(*p);
+                c = *p;
+                /* \d, \x41, \101 etc. are not plain characters */
+                if (!literal && (p = regex_skip_escape(p)) == NULL)
+                {
+                    g_byte_array_set_size(best, 0);
+                    g_byte_array_free(run, TRUE);
+                    return best;
+                }
+                break;
+            case '(':
+                /* (?x) may change how the rest is parsed */
+                if (p[1] == '?')
+                {
+                    g_byte_array_set_size(best, 0);
+                    g_byte_array_free(run, TRUE);
+                    return best;
+                }
+                depth++;
+                break;
+            case ')':
+                depth = MAX(depth - 1, 0);
+                break;
+            case '[':
+                /* skip class, ']' right after '[' or '[^' is literal */
+                p++;
+                if (*p == '^')
+                    p++;
+                if (*p == ']')
+                    p++;
+                while (*p != '\0' && *p != ']')
+                {
+                    if (*p == '\\' && p[1] != '\0')
+                        p++;
+                    p++;
+                }
+                if (*p == '\0')
+                    p--;
+                break;
+            case '{':
+                while (p[1] != '\0' && *p != '}')
+                    p++;
+                /* fall through, {0,n} may make previous character optional */
+            case '?':
+            case '*':
+                if (run->len > 0)
+                    g_byte_array_set_size(run, run->len - 1);
+                break;
+            case '.':
+            case '^':
+            case '$':
+            case '+':
+                break;
+            default:
+                literal = TRUE;
+                break;
+        }
+
+        if (literal && depth == 0)
+        {
+            g_byte_array_append(run, &c, 1);
+            continue;
+        }
+
+        /* '+' repeats previous character, it is still required once */
+        keep_longest(best, run);
+    }
+
+    keep_longest(best, run);
+    g_byte_array_free(run, TRUE);
+
+    return best;
+}
+
+/**
+ *  \return TRUE if block may contain a match starting in it, judging by
+ *  filters of the block and of the next one, which the match may run into
+ **/
+static gboolean search_block_candidate(Search *search, guint64 block)
+{
+    const guint8 *a, *b;
+    gsize i;
+
+    /* blocks without filter, dropped or not complete yet, are scanned */
+    if (search->n_trigrams == 0 || block < search->first_block ||
+        block + 1 - search->first_block >= search->n_filters)
+    {
+        return TRUE;
+    }
+
+    a = search->filters[block - search->first_block]->bits;
+    b = search->filters[block + 1 - search->first_block]->bits;
+    for (i = 0; i < search->n_trigrams; i++)
+    {
+        guint32 h = search->trigrams[i];
+
+        if (((a[h / 8] | b[h / 8]) & (1 << (h % 8))) == 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void search_add_match(Search *search, guint64 offset, guint64 len)
+{
+    SearchMatch match;
+
+    match.offset = offset;
+    match.len = len;
+    g_array_append_val(search->matches, match);
+    if (search->matches->len >= SEARCH_MAX_MATCHES)
+        search->stats.truncated = TRUE;
+}
+
+/**
+ *  Finds literal matches starting in buf[0..limit), buf holds len bytes.
+ *  next_start is offset before which matches would overlap previous one.
+ **/
+static void search_literal(Search *search, const guint8 *buf, gsize len,
+                           gsize limit, guint64 base, guint64 *next_start)
+{
+    gsize pos = *next_start > base ? *next_start - base : 0;
+    const guint8 *p;
+
+    while (pos < limit && !search->stats.truncated &&
+           (p = memchr(buf + pos, search->pattern[0], limit - pos)) != NULL)
+    {
+        gsize i = p - buf;
+
+        if (len - i >= search->n_pattern &&
+            memcmp(p, search->pattern, search->n_pattern) == 0)
+        {
+            search_add_match(search, base + i, search->n_pattern);
+            *next_start = base + i + search->n_pattern;
+            pos = i + search->n_pattern;
+        }
+        else
+        {
+            pos = i + 1;
+        }
+    }
+}
+
+/**
+ *  Finds regex matches starting in buf[start..limit), buf holds len bytes.
+ **/
+static void search_regex(Search *search, const guint8 *buf, gsize len, gsize start,
+                         gsize limit, guint64 base, guint64 *next_start)
+{
+    GMatchInfo *info;
+
+    start = MAX(start, *next_start > base ? *next_start - base : 0);
+    if (start >= limit)
+        return;
+
+    g_regex_match_full(search->regex, (const gchar*)buf, len, start, 0, &info, NULL);
+    while (g_match_info_matches(info) && !search->stats.truncated)
+    {
+        gint match_start, match_end;
+
+        g_match_info_fetch_pos(info, 0, &match_start, &match_end);
+        if ((gsize)match_start >= limit)
+            break;
+
+        if (match_end > match_start)
+        {
+            search_add_match(search, base + match_start, match_end - match_start);
+            *next_start = base + match_end;
+        }
+        g_match_info_next(info, NULL);
+    }
+    g_match_info_free(info);
+}
+
+static gboolean search_done_cb(gpointer data)
+{
+    Search *search = (Search*)data;
+
+    g_atomic_int_set(&search->notify_pending, 0);
+    search->func(search, search->data);
+
+    return FALSE;
+}
+
+static gpointer search_thread(gpointer data)
+{
+    Search *search = (Search*)data;
+    guint64 start = byte_store_snapshot_get_start(search->snap);
+    guint64 end = byte_store_snapshot_get_end(search->snap);
+    guint64 first_block = start / SEARCH_BLOCK_SIZE;
+    guint64 n_blocks = (end + SEARCH_BLOCK_SIZE - 1) / SEARCH_BLOCK_SIZE;
+    gsize before = search->regex != NULL ? REGEX_CONTEXT : 0;
+    gsize after = search->regex != NULL ? REGEX_OVERLAP : search->n_pattern - 1;
+    guint8 *buf = g_malloc(before + SEARCH_BLOCK_SIZE + after);
+    gint64 start_time = g_get_monotonic_time();
+    guint64 next_start = 0;
+    guint64 block;
+
+    search->stats.blocks = n_blocks - MIN(first_block, n_blocks);
+    for (block = first_block; block < n_blocks && !search->stats.truncated; block++)
+    {
+        /* first block may be partly evicted, snapshot has nothing before start */
+        guint64 block_start = MAX(block * SEARCH_BLOCK_SIZE, start);
+        guint64 block_end = (block + 1) * SEARCH_BLOCK_SIZE;
+        guint64 base = MAX(block_start - MIN(block_start, before), start);
+        gsize len, limit;
+
+        if (g_atomic_int_get(&search->cancelled))
+            break;
+
+        if (!search_block_candidate(search, block))
+            continue;
+        search->stats.scanned++;
+
+        len = byte_store_snapshot_read(search->snap, base, buf,
+                                       block_end - base + after);
+        limit = MIN(block_end - base, len);
+
+        if (search->regex != NULL)
+        {
+            search_regex(search, buf, len, block_start - base, limit, base, &next_start);
+        }
+        else
+        {
+            gsize i;
+
+            if (search->ignore_case)
+            {
+                for (i = 0; i < len; i++)
+                    buf[i] = g_ascii_tolower(buf[i]);
+            }
+            search_literal(search, buf, len, limit, base, &next_start);
+        }
+    }
+    g_free(buf);
+
+    search->stats.time = g_get_monotonic_time() - start_time;
+    g_atomic_int_set(&search->done, 1);
+    if (!g_atomic_int_get(&search->cancelled))
+    {
+        g_atomic_int_set(&search->notify_pending, 1);
+        search->notify_source = g_idle_add(search_done_cb, search);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Starts searching data indexed so far for pattern, which is either a
+ *  literal string or a Perl compatible regular expression matched
+ *  against raw bytes. Matches do not overlap.
+ *
+ *  \return NULL if pattern is empty or not a valid regular expression
+ **/
+Search *search_new(SearchIndex *index, const gchar *pattern, SearchMode mode,
+                   gboolean ignore_case, SearchDoneFunc func, gpointer data)
+{
+    Search *search;
+    GByteArray *literal;
+    GRegex *regex = NULL;
+    guint64 end_block;
+    gsize i;
+
+    if (pattern[0] == '\0')
+        return NULL;
+
+    if (mode == SEARCH_REGEX)
+    {
+        GError *error = NULL;
+
+        regex = g_regex_new(pattern, G_REGEX_RAW | G_REGEX_MULTILINE | G_REGEX_OPTIMIZE |
+                            (ignore_case ? G_REGEX_CASELESS : 0), 0, &error);
+        if (regex == NULL)
+        {
+            g_message("Invalid regular expression: %s", error->message);
+            g_error_free(error);
+            return NULL;
+        }
+        literal = regex_required_literal(pattern);
+    }
+    else
+    {
+        literal = g_byte_array_new();
+        g_byte_array_append(literal, (const guint8*)pattern, strlen(pattern));
+    }
+
+    search = g_slice_new0(Search);
+    search->regex = regex;
+    search->ignore_case = ignore_case;
+    search->func = func;
+    search->data = data;
+    search->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+
+    if (ignore_case)
+    {
+        for (i = 0; i < literal->len; i++)
+            literal->data[i] = g_ascii_tolower(literal->data[i]);
+    }
+
+    /* filters hold case folded trigrams */
+    if (literal->len >= 3)
+    {
+        search->n_trigrams = literal->len - 2;
+        search->trigrams = g_new(guint32, search->n_trigrams);
+        for (i = 0; i < search->n_trigrams; i++)
+        {
+            search->trigrams[i] = trigram_hash(g_ascii_tolower(literal->data[i]),
+                                               g_ascii_tolower(literal->data[i + 1]),
+                                               g_ascii_tolower(literal->data[i + 2]));
+        }
+    }
+    search->n_pattern = literal->len;
+    search->pattern = g_byte_array_free(literal, FALSE);
+
+    search_index_update(index);
+    search->snap = byte_store_snapshot_new(index->store);
+    /* filter of last block is still being filled, it is always scanned */
+    end_block = index->indexed >= 2 ? (index->indexed - 2) / SEARCH_BLOCK_SIZE : 0;
+    search->first_block = index->first_block;
+    search->n_filters = end_block > index->first_block ?
+                        MIN(end_block - index->first_block, index->filters->len) : 0;
+    search->filters = g_new(BlockFilter*, search->n_filters);
+    for (i = 0; i < search->n_filters; i++)
+        search->filters[i] = block_filter_ref(g_ptr_array_index(index->filters, i));
+
+    search->thread = g_thread_new("search", search_thread, search);
+
+    return search;
+}
+
+/**
+ *  Cancels search if it is still running.
+ **/
+void search_free(Search *search)
+{
+    guint64 i;
+
+    g_atomic_int_set(&search->cancelled, 1);
+    g_thread_join(search->thread);
+    if (g_atomic_int_get(&search->notify_pending))
+        g_source_remove(search->notify_source);
+
+    byte_store_snapshot_free(search->snap);
+    for (i = 0; i < search->n_filters; i++)
+        block_filter_unref(search->filters[i]);
+    g_free(search->filters);
+    g_free(search->pattern);
+    g_free(search->trigrams);
+    if (search->regex != NULL)
+        g_regex_unref(search->regex);
+    g_array_free(search->matches, TRUE);
+    g_slice_free(Search, search);
+}
+
+gboolean search_is_done(Search *search)
+{
+    return g_atomic_int_get(&search->done);
+}
+
+/**
+ *  \return matches ordered by offset, valid once search is done
+ **/
+const SearchMatch *search_get_matches(Search *search, guint *n_matches)
+{
+    *n_matches = search->matches->len;
+
+    return (const SearchMatch*)search->matches->data;
+}
+
+/**
+ *  \return index of first match ending after offset, number of matches
+ *  if there is none
+ **/
+guint search_find(Search *search, guint64 offset)
+{
+    const SearchMatch *matches = (const SearchMatch*)search->matches->data;
+    guint lo = 0, hi = search->matches->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (matches[mid].offset + matches[mid].len <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+void search_get_stats(Search *search, SearchStats *stats)
+{
+    *stats = search->stats;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <glib.h>
+#include "bytestore.h"
+
+/**
+ *  Filter over data in a byte store, updated as data arrives. Data is
+ *  split into blocks of SEARCH_BLOCK_SIZE bytes and every block gets a
+ *  bitmap of the (ASCII case folded) trigrams starting in it. Searching
+ *  for a pattern only has to scan blocks whose bitmaps hold all of the
+ *  pattern's trigrams. Bitmaps are kept for the newest SEARCH_MAX_FILTERS
+ *  blocks still in store, older blocks are always scanned.
+ **/
+typedef struct _SearchIndex SearchIndex;
+
+#define SEARCH_BLOCK_SIZE (16 * 1024)
+
+/* 64 MiB of bitmaps, covering the newest 1 GiB of data */
+#define SEARCH_MAX_FILTERS 65536
+
+SearchIndex *search_index_new(ByteStore *store);
+void search_index_free(SearchIndex *index);
+void search_index_update(SearchIndex *index);
+
+typedef enum {
+    SEARCH_LITERAL,
+    SEARCH_REGEX,
+} SearchMode;
+
+typedef struct {
+    guint64 offset;
+    guint64 len;
+} SearchMatch;
+
+typedef struct {
+    guint64 blocks;  /* in searched data */
+    guint64 scanned; /* blocks that passed filter */
+    gint64 time;     /* in microseconds */
+    gboolean truncated; /* stopped at SEARCH_MAX_MATCHES */
+} SearchStats;
+
+#define SEARCH_MAX_MATCHES 100000
+
+/**
+ *  One search over data stored when it was started, run by its own
+ *  thread. Callback is called from main loop when search is done;
+ *  freeing the search cancels it.
+ **/
+typedef struct _Search Search;
+
+typedef void (*SearchDoneFunc)(Search *search, gpointer data);
+
+Search *search_new(SearchIndex *index, const gchar *pattern, SearchMode mode,
+                   gboolean ignore_case, SearchDoneFunc func, gpointer data);
+void search_free(Search *search);
+
+gboolean search_is_done(Search *search);
+const SearchMatch *search_get_matches(Search *search, guint *n_matches);
+guint search_find(Search *search, guint64 offset);
+void search_get_stats(Search *search, SearchStats *stats);
+
+#endif /* SEARCH_H */
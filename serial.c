@@ -14,7 +14,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses>.
  */
 
-#include <gio/gio.h>
+#include <glib.h>
 #include <fcntl.h>
 
 /* required for CRTSCTS */
@@ -24,8 +24,16 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <linux/serial.h>
+#endif
 #include "serial.h"
+#include "baudrate.h"
 #include "conf.h"
 
 #if 0
@@ -33,27 +41,231 @@
 #define CDTRDSR 004000000000 /* DTR/DSR flow control */
 #endif
 
-static tcflag_t get_cflag(Configuration *cfg)
+/* USB serial latency timer used in low latency mode, in ms */
+#define LOW_LATENCY_TIMER 1
+
+/* device settings changed by low latency mode, restored on disconnect */
+typedef struct {
+    gboolean low_latency_set; /* ASYNC_LOW_LATENCY was off */
+    gchar *timer_path;        /* latency_timer lowered by us, NULL if not */
+    gint timer;               /* its previous value */
+} SerialSaved;
+
+/* fd -> SerialSaved, main thread only */
+static GHashTable *saved_settings = NULL;
+
+static SerialSaved *serial_saved_get(int fd)
 {
-    tcflag_t cflag;
-
-    switch (cfg->rate)
-    {
-        case GUART_B150: cflag = B150; break;
-        case GUART_B300: cflag = B300; break;
-        case GUART_B600: cflag = B600; break;
-        case GUART_B1200: cflag = B1200; break;
-        case GUART_B1800: cflag = B1800; break;
-        case GUART_B2400: cflag = B2400; break;
-        case GUART_B4800: cflag = B4800; break;
-        case GUART_B9600: cflag = B9600; break;
-        case GUART_B19200: cflag = B19200; break;
-        case GUART_B38400: cflag = B38400; break;
-        case GUART_B57600: cflag = B57600; break;
-        default:
-            g_message("Invalid BaudRate, assuming 115200");
-        case GUART_B115200: cflag = B115200; break;
+    SerialSaved *saved;
+
+    if (saved_settings == NULL)
+        saved_settings = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    saved = g_hash_table_lookup(saved_settings, GINT_TO_POINTER(fd));
+    if (saved == NULL)
+    {
+        saved = g_slice_new0(SerialSaved);
+        g_hash_table_insert(saved_settings, GINT_TO_POINTER(fd), saved);
+    }
+
+    return saved;
+}
+
+/**
+ *  Writes value to latency timer at path.
+ *
+ *  \return FALSE on error
+ **/
+static gboolean write_latency_timer(const gchar *path, gint value)
+{
+    FILE *f = fopen(path, "w");
+    gboolean written;
+
+    if (f == NULL)
+        return FALSE;
+
+    written = fprintf(f, "%d", value) > 0;
+    /* closed exactly once, a failed close may be the failed write */
+    if (fclose(f) != 0)
+        written = FALSE;
+
+    return written;
+}
+
+/**
+ *  Lowers latency timer of USB serial adapters that have one (FTDI),
+ *  found through sysfs node of the tty. Previous value is restored by
+ *  serial_restore().
+ **/
+static void set_latency_timer(int fd, const gchar *port)
+{
+#ifdef __linux__
+    struct stat st;
+    gchar *path, *contents = NULL;
+
+    if (fstat(fd, &st) < 0 || !S_ISCHR(st.st_mode))
+        return;
+
+    path = g_strdup_printf("/sys/dev/char/%u:%u/device/latency_timer",
+                           major(st.st_rdev), minor(st.st_rdev));
+
+    if (g_file_get_contents(path, &contents, NULL, NULL) &&
+        atoi(contents) > LOW_LATENCY_TIMER)
+    {
+        if (write_latency_timer(path, LOW_LATENCY_TIMER))
+        {
+            SerialSaved *saved = serial_saved_get(fd);
+
+            g_message("Latency timer of %s lowered from %d to %d ms",
+                      port, atoi(contents), LOW_LATENCY_TIMER);
+            saved->timer_path = path;
+            saved->timer = atoi(contents);
+            path = NULL;
+        }
+        else
+        {
+            g_message("Unable to lower latency timer of %s: %s", port, strerror(errno));
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+#endif
+}
+
+/**
+ *  Asks driver to push received data to the tty layer right away instead
+ *  of batching it, where supported. Previous setting is restored by
+ *  serial_restore().
+ **/
+static void set_low_latency(int fd, const gchar *port)
+{
+#ifdef ASYNC_LOW_LATENCY
+    struct serial_struct serinfo;
+
+    if (ioctl(fd, TIOCGSERIAL, &serinfo) < 0)
+    {
+        g_message("%s does not support low latency flag", port);
+    }
+    else if (!(serinfo.flags & ASYNC_LOW_LATENCY))
+    {
+        serinfo.flags |= ASYNC_LOW_LATENCY;
+        if (ioctl(fd, TIOCSSERIAL, &serinfo) < 0)
+            g_message("Unable to set low latency flag on %s: %s", port, strerror(errno));
+        else
+            serial_saved_get(fd)->low_latency_set = TRUE;
+    }
+#endif
+
+    set_latency_timer(fd, port);
+}
+
+/**
+ *  Undoes changes low latency mode made to the device, which outlive the
+ *  connection otherwise. Call before fd is closed; failures are ignored,
+ *  device may be gone already.
+ **/
+void serial_restore(int fd)
+{
+    SerialSaved *saved;
+
+    if (saved_settings == NULL ||
+        (saved = g_hash_table_lookup(saved_settings, GINT_TO_POINTER(fd))) == NULL)
+        return;
+
+#ifdef ASYNC_LOW_LATENCY
+    if (saved->low_latency_set)
+    {
+        struct serial_struct serinfo;
+
+        if (ioctl(fd, TIOCGSERIAL, &serinfo) == 0)
+        {
+            serinfo.flags &= ~ASYNC_LOW_LATENCY;
+            ioctl(fd, TIOCSSERIAL, &serinfo);
+        }
+    }
+#endif
+
+    if (saved->timer_path != NULL)
+    {
+        write_latency_timer(saved->timer_path, saved->timer);
+        g_free(saved->timer_path);
+    }
+
+    g_hash_table_remove(saved_settings, GINT_TO_POINTER(fd));
+    g_slice_free(SerialSaved, saved);
+}
+
+/**
+ *  \return termios speed constant for rate, B0 if there is none
+ **/
+static speed_t get_speed(guint rate)
+{
+    switch (rate)
+    {
+        case 50: return B50;
+        case 75: return B75;
+        case 110: return B110;
+        case 134: return B134;
+        case 150: return B150;
+        case 200: return B200;
+        case 300: return B300;
+        case 600: return B600;
+        case 1200: return B1200;
+        case 1800: return B1800;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+#ifdef B230400
+        case 230400: return B230400;
+#endif
+#ifdef B460800
+        case 460800: return B460800;
+#endif
+#ifdef B500000
+        case 500000: return B500000;
+#endif
+#ifdef B576000
+        case 576000: return B576000;
+#endif
+#ifdef B921600
+        case 921600: return B921600;
+#endif
+#ifdef B1000000
+        case 1000000: return B1000000;
+#endif
+#ifdef B1152000
+        case 1152000: return B1152000;
+#endif
+#ifdef B1500000
+        case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+        case 2000000: return B2000000;
+#endif
+#ifdef B2500000
+        case 2500000: return B2500000;
+#endif
+#ifdef B3000000
+        case 3000000: return B3000000;
+#endif
+#ifdef B3500000
+        case 3500000: return B3500000;
+#endif
+#ifdef B4000000
+        case 4000000: return B4000000;
+#endif
+        default: return B0;
     }
+}
+
+static tcflag_t get_cflag(Configuration *cfg)
+{
+    tcflag_t cflag = 0;
 
     switch (cfg->databits)
     {
@@ -104,11 +316,44 @@ static tcflag_t get_cflag(Configuration *cfg)
     return cflag;
 }
 
+/**
+ *  Sets baudrate and format of cfg on fd for sampling the line (see
+ *  autobaud.h). Unlike serial_connect(), received bytes with framing or
+ *  parity errors and breaks are kept, marked as \377 \0 byte, and a
+ *  received \377 is doubled.
+ *
+ *  \return FALSE if port does not support baudrate or format
+ **/
+gboolean serial_set_probe_mode(int fd, Configuration *cfg)
+{
+    struct termios config;
+    speed_t speed = get_speed(cfg->rate);
+
+    if (tcgetattr(fd, &config) < 0)
+        return FALSE;
+
+    config.c_cflag = get_cflag(cfg);
+    config.c_iflag = INPCK | PARMRK;
+    config.c_oflag = 0;
+    config.c_lflag = 0;
+    config.c_cc[VTIME] = 0;
+    config.c_cc[VMIN] = 1;
+    cfsetispeed(&config, speed != B0 ? speed : B38400);
+    cfsetospeed(&config, speed != B0 ? speed : B38400);
+
+    if (tcsetattr(fd, TCSANOW, &config) < 0)
+        return FALSE;
+
+    return speed != B0 || baudrate_set_custom(fd, cfg->rate);
+}
+
 GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
 {
     GIOChannel *io;
     int fd;
     struct termios config;
+    speed_t speed;
+    guint actual;
 
     /* O_RDWR - Opens the port for reading and writing
      * O_NOCTTY - The port never becomes the controlling terminal of the process.
@@ -116,15 +361,19 @@ GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
      */
     fd = open(cfg->port, O_RDWR | O_NOCTTY);// | O_NDELAY);
 
-
-    tcgetattr(fd, &config);
-
-    if (fd < -1)
+    if (fd < 0)
     {
         g_message("Unable to connect to %s: %s(%d)!", cfg->port, strerror(errno), errno);
         return NULL;
     }
 
+    if (tcgetattr(fd, &config) < 0)
+    {
+        g_message("%s is not a serial port: %s(%d)", cfg->port, strerror(errno), errno);
+        close(fd);
+        return NULL;
+    }
+
     config.c_cflag = get_cflag(cfg);
     config.c_iflag = IGNPAR | IGNBRK;
     if (cfg->flow == GUART_FLOW_XONXOFF)
@@ -138,6 +387,10 @@ GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
     config.c_cc[VTIME] = 0;
     config.c_cc[VMIN] = 1;
 
+    /* non-standard rates are set with termios2 once the rest is applied */
+    speed = get_speed(cfg->rate);
+    cfsetispeed(&config, speed != B0 ? speed : B38400);
+    cfsetospeed(&config, speed != B0 ? speed : B38400);
 
     if (tcsetattr(fd, TCSANOW, &config) < 0) {
         g_message("Can't change serial settings: %s(%d)", strerror(errno), errno);
@@ -145,6 +398,22 @@ GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
         return NULL;
     }
 
+    if (speed == B0 && (cfg->rate == 0 || !baudrate_set_custom(fd, cfg->rate)))
+    {
+        g_message("Baudrate %u is not supported by %s", cfg->rate, cfg->port);
+        close(fd);
+        return NULL;
+    }
+
+    actual = baudrate_get(fd);
+    if (actual != 0 && actual != cfg->rate)
+    {
+        g_message("Requested baudrate %u, port runs at %u", cfg->rate, actual);
+    }
+
+    if (cfg->low_latency)
+        set_low_latency(fd, cfg->port);
+
     tcflush(fd, TCOFLUSH);
     tcflush(fd, TCIFLUSH);
 
@@ -152,6 +421,7 @@ GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
     g_io_channel_set_close_on_unref(io, TRUE);
 
     if (g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL) != G_IO_STATUS_NORMAL) {
+        serial_restore(fd);
         g_io_channel_unref(io);
         return NULL;
     }
@@ -160,23 +430,6 @@ GIOChannel *serial_connect(Configuration *cfg, int *serial_fd)
     return io;
 }
 
-gboolean get_control_lines(int fd, gchar *dtr, gchar *dsr, gchar *rts, gchar *cts)
-{
-    int status;
-
-    if (ioctl(fd, TIOCMGET, &status) == -1) {
-        g_message("TIOCMGET failed");
-        return FALSE;
-    }
-
-    if (status & TIOCM_DTR) *dtr = 1; else *dtr = 0;
-    if (status & TIOCM_DSR) *dsr = 1; else *dsr = 0;
-    if (status & TIOCM_RTS) *rts = 1; else *rts = 0;
-    if (status & TIOCM_CTS) *cts = 1; else *cts = 0;
-
-    return TRUE;
-}
-
 void set_rts(int fd, gchar state)
 {
     int status;
@@ -214,3 +467,11 @@ void set_dtr(int fd, gchar state)
         g_message("setRTS(): TIOCMSET failed");
     }
 }
+
+/**
+ *  \return baudrate port actually runs at, 0 if it can't be determined
+ **/
+guint serial_get_baudrate(int fd)
+{
+    return baudrate_get(fd);
+}
@@ -17,11 +17,13 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
-#include <gio/gio.h>
+#include <glib.h>
 #include "conf.h"
 
 GIOChannel *serial_connect(Configuration *cfg, int *serial_fd);
-gboolean get_control_lines(int fd, gchar *dtr, gchar *dsr, gchar *rts, gchar *cts);
+void serial_restore(int fd);
+guint serial_get_baudrate(int fd);
+gboolean serial_set_probe_mode(int fd, Configuration *cfg);
 void set_rts(int fd, gchar state);
 void set_dtr(int fd, gchar state);
 
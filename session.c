@@ -0,0 +1,1499 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+#include <unistd.h>
+#include "session.h"
+#include "confdialog.h"
+#include "serial.h"
+#include "receiver.h"
+#include "capture.h"
+#include "filesender.h"
+#include "linemonitor.h"
+#include "iostats.h"
+#include "triggerview.h"
+#include "portwatch.h"
+
+/* how often statistics are refreshed and dumped while connected */
+#define STATS_INTERVAL 1000 /* ms */
+#define STATS_BAR_WIDTH 40
+
+/* reopening a device that came back is retried while it fails, e.g. with EBUSY */
+#define RECONNECT_RETRY_INTERVAL 100 /* ms */
+#define RECONNECT_RETRIES 20
+/* node that appeared longer before hangup was seen is not the device coming back */
+#define REPLUG_MAX_AGE (G_USEC_PER_SEC / 2)
+
+struct _Session {
+    GtkWindow *window;
+    Configuration *cfg;
+
+    GtkWidget *box;
+    GtkWidget *tab;
+    GtkWidget *tab_label;
+    GtkWidget *lbl_cfg;
+    GtkWidget *btn_cfg;
+    GtkWidget *btn_connect;
+    GtkWidget *btn_capture;
+    GtkWidget *entry;
+    GtkWidget *txt_dtr, *txt_dsr, *txt_rts, *txt_cts, *txt_dcd, *txt_ri;
+    GtkWidget *lbl_round_trip;
+    GtkWidget *lbl_tx;
+    GtkWidget *spin_line;
+    GtkWidget *lbl_lines;
+    GtkWidget *search_entry;
+    GtkWidget *chk_regex;
+    GtkWidget *chk_match_case;
+    GtkWidget *lbl_search;
+    GtkWidget *hbox_progress; /* shown while file is being sent */
+    GtkWidget *progress_bar;
+
+    Display *display;
+    ByteStore *rx_store;
+    HexView *hexview;
+    FrameView *frameview;
+    TriggerView *triggerview;
+    Receiver *receiver;
+
+    GIOChannel *serial_channel;
+    int serial_fd;
+
+    /* auto reconnect, see portwatch.h */
+    PortWatch *watch;     /* from connect to disconnect */
+    gchar *replug_port;   /* device node that appeared before hangup was seen */
+    gint64 replug_time;
+    gint64 hangup_time;   /* 0 unless waiting for device to come back */
+    gchar *retry_port;    /* node whose reopening is being retried */
+    guint retry_id;
+    guint retries;
+    guint reconnects;
+    LineMonitor *lines;
+    gint64 connect_time;
+    gint64 last_line_event; /* 0 until initial state is shown */
+
+    CaptureWriter *capture;
+
+    Search *search;
+    guint search_current;
+
+    FileSender *sender;
+    SendPacing send_pacing; /* last used, offered for next file */
+    guint send_pacing_value;
+
+    /* round trip statistics since last connect, in microseconds */
+    gint64 round_trip_min, round_trip_sum;
+    guint round_trip_count;
+
+    GtkWidget *lbl_stats;
+    guint stats_id;
+    IoStats prev_stats;
+    gboolean have_prev_stats;
+    IoStatsDump *stats_dump;
+};
+
+static void stop_send(Session *session)
+{
+    if (session->sender != NULL)
+    {
+        file_sender_free(session->sender);
+        session->sender = NULL;
+        gtk_widget_hide(session->hbox_progress);
+    }
+}
+
+static void serial_disconnect(Session *session)
+{
+    if (session->serial_channel != NULL)
+    {
+        gsize unsent;
+
+        if (session->lines != NULL)
+        {
+            line_monitor_free(session->lines);
+            session->lines = NULL;
+        }
+
+        if (session->stats_id != 0)
+        {
+            g_source_remove(session->stats_id);
+            session->stats_id = 0;
+        }
+
+        unsent = tx_queue_get_depth(serial_reader_get_tx_queue(
+                     receiver_get_reader(session->receiver)));
+        if (unsent > 0)
+            g_message("%" G_GSIZE_FORMAT " queued bytes not sent", unsent);
+
+        /* sender and reader must be gone before the fd is closed */
+        stop_send(session);
+        receiver_stop(session->receiver);
+        serial_restore(session->serial_fd);
+        g_io_channel_unref(session->serial_channel);
+        session->serial_channel = NULL;
+    }
+}
+
+static void stop_capture(Session *session)
+{
+    if (session->capture != NULL)
+    {
+        if (receiver_get_reader(session->receiver) != NULL)
+            serial_reader_set_capture(receiver_get_reader(session->receiver), NULL);
+        capture_writer_close(session->capture);
+        session->capture = NULL;
+    }
+}
+
+/**
+ *  Starts capture at start_time, data reader kept since then goes first.
+ *
+ *  \return FALSE if capture file could not be created
+ **/
+static gboolean start_capture(Session *session, const gchar *filename, gint64 start_time)
+{
+    session->capture = capture_writer_new_at(filename, start_time);
+    if (session->capture == NULL)
+        return FALSE;
+
+    if (receiver_get_reader(session->receiver) != NULL)
+        serial_reader_set_capture(receiver_get_reader(session->receiver), session->capture);
+
+    return TRUE;
+}
+
+static void stop_search(Session *session)
+{
+    if (session->search != NULL)
+    {
+        hex_view_set_highlights(session->hexview, NULL, 0, 0);
+        display_clear_highlights(session->display);
+        search_free(session->search);
+        session->search = NULL;
+    }
+}
+
+static void cancel_reconnect_retry(Session *session)
+{
+    if (session->retry_id != 0)
+    {
+        g_source_remove(session->retry_id);
+        session->retry_id = 0;
+    }
+    g_free(session->retry_port);
+    session->retry_port = NULL;
+}
+
+static void stop_port_watch(Session *session)
+{
+    if (session->watch != NULL)
+    {
+        port_watch_free(session->watch);
+        session->watch = NULL;
+    }
+    cancel_reconnect_retry(session);
+    g_free(session->replug_port);
+    session->replug_port = NULL;
+    session->hangup_time = 0;
+}
+
+static void session_destroy_cb(GtkWidget *widget, Session *session)
+{
+    stop_port_watch(session);
+    serial_disconnect(session);
+    stop_capture(session);
+    stop_search(session);
+
+    receiver_free(session->receiver);
+    display_free(session->display);
+    byte_store_free(session->rx_store);
+    configuration_free(session->cfg);
+    g_slice_free(Session, session);
+}
+
+/**
+ *  Shows configuration, along with baudrate port really runs at if it
+ *  differs from requested one (actual_rate 0 if not known).
+ **/
+static void update_config_label(Session *session, guint actual_rate)
+{
+    gchar *conf = get_configuration_string(session->cfg);
+
+    if (actual_rate != 0 && actual_rate != session->cfg->rate)
+    {
+        gchar *tmp = g_strdup_printf("%s (actual %u baud)", conf, actual_rate);
+
+        g_free(conf);
+        conf = tmp;
+    }
+    gtk_label_set_text(GTK_LABEL(session->lbl_cfg), conf);
+    gtk_label_set_text(GTK_LABEL(session->tab_label), session->cfg->port);
+    g_free(conf);
+}
+
+static void cfg_button_cb(GtkButton *btn, Session *session)
+{
+    Configuration *cfg = session->cfg;
+
+    if (!configure(GTK_WIDGET(session->window), cfg))
+        return;
+
+    display_set_latency(session->display, cfg->display_latency);
+    display_set_scrollback(session->display, cfg->scrollback_limit, cfg->scrollback_unit);
+    receiver_set_terminator(session->receiver, cfg->terminator, cfg->n_terminator_chars);
+    update_config_label(session, 0);
+}
+
+/**
+ *  Updates labels of lines that changed in event and adds event to capture.
+ *  Tooltip tells when line last changed, relative to connect and to the
+ *  previous transition of any line.
+ **/
+static void show_line_event(Session *session, LineEvent *event)
+{
+    GtkWidget *labels[] = {
+        session->txt_dtr, session->txt_dsr, session->txt_rts,
+        session->txt_cts, session->txt_dcd, session->txt_ri,
+    };
+    gchar *tooltip;
+    guint i;
+
+    if (session->last_line_event == 0)
+    {
+        tooltip = g_strdup("Initial state");
+    }
+    else
+    {
+        tooltip = g_strdup_printf("Changed %.6f s after connect, %.3f ms after "
+                                  "previous change",
+                                  (event->time - session->connect_time) / 1e6,
+                                  (event->time - session->last_line_event) / 1e3);
+    }
+    session->last_line_event = event->time;
+
+    /* labels are in order of ModemLine bits */
+    for (i = 0; i < G_N_ELEMENTS(labels); i++)
+    {
+        if (event->changed & (1 << i))
+        {
+            gtk_label_set_text(GTK_LABEL(labels[i]),
+                               (event->state & (1 << i)) ? "High" : "Low");
+            gtk_widget_set_tooltip_text(labels[i], tooltip);
+        }
+    }
+    g_free(tooltip);
+
+    if (session->capture != NULL)
+    {
+        guint8 record[2];
+
+        record[0] = event->changed;
+        record[1] = event->state;
+        capture_writer_append(session->capture, CAPTURE_LINES, event->time,
+                              record, sizeof(record));
+    }
+}
+
+/**
+ *  Shows control line transitions recorded by line monitor.
+ *  Called from main loop only when some line changed.
+ **/
+static gboolean control_lines_cb(gpointer data)
+{
+    Session *session = (Session*)data;
+    LineEvent events[32];
+    gsize i, n;
+
+    if (session->lines == NULL)
+        return FALSE;
+
+    while ((n = line_monitor_read(session->lines, events, G_N_ELEMENTS(events))) > 0)
+    {
+        for (i = 0; i < n; i++)
+            show_line_event(session, &events[i]);
+    }
+
+    return FALSE;
+}
+
+static void reset_round_trip(Session *session)
+{
+    session->round_trip_min = G_MAXINT64;
+    session->round_trip_sum = 0;
+    session->round_trip_count = 0;
+    gtk_label_set_text(GTK_LABEL(session->lbl_round_trip), "Round trip: -");
+}
+
+/**
+ *  Shows time from sending data to the first reply reaching main loop.
+ **/
+static void round_trip_cb(Receiver *rx, gint64 round_trip, gpointer data)
+{
+    Session *session = (Session*)data;
+    gchar *text;
+
+    session->round_trip_min = MIN(session->round_trip_min, round_trip);
+    session->round_trip_sum += round_trip;
+    session->round_trip_count++;
+
+    text = g_strdup_printf("Round trip: %.2f ms (min %.2f, avg %.2f)",
+                           round_trip / 1000.0, session->round_trip_min / 1000.0,
+                           session->round_trip_sum / 1000.0 / session->round_trip_count);
+    gtk_label_set_text(GTK_LABEL(session->lbl_round_trip), text);
+    g_free(text);
+}
+
+/**
+ *  Takes snapshot of I/O counters, must be connected.
+ **/
+static void get_io_stats(Session *session, IoStats *stats)
+{
+    SerialReader *reader = receiver_get_reader(session->receiver);
+    TxQueue *tx = serial_reader_get_tx_queue(reader);
+    DisplayStats display;
+
+    stats->time = g_get_monotonic_time();
+    serial_reader_get_stats(reader, &stats->rx);
+    stats->overruns = serial_reader_get_overruns(reader);
+    stats->ring_fill = ring_buffer_get_fill(serial_reader_get_ring(reader));
+    tx_queue_get_stats(tx, &stats->tx);
+    stats->tx_depth = tx_queue_get_depth(tx);
+
+    display_get_stats(session->display, &display);
+    stats->display_flushed = display.flushed;
+    stats->display_pending = display.pending;
+    stats->display_flushes = display.flushes;
+    stats->lag_last = display.lag_last;
+    stats->lag_max = display.lag_max;
+    stats->lag_sum = display.lag_sum;
+}
+
+static void append_read_sizes(GString *str, const SerialReaderStats *rx)
+{
+    gsize max = 0;
+    guint i;
+
+    for (i = 0; i < READ_SIZE_BUCKETS; i++)
+        max = MAX(max, rx->read_sizes[i]);
+
+    g_string_append(str, "\nRead sizes:");
+    for (i = 0; i < READ_SIZE_BUCKETS; i++)
+    {
+        gsize width;
+        gchar *range;
+
+        if (rx->read_sizes[i] == 0)
+            continue;
+
+        if (i == 0)
+            range = g_strdup("1");
+        else if (i == READ_SIZE_BUCKETS - 1)
+            range = g_strdup_printf("%u+", 1u << i);
+        else
+            range = g_strdup_printf("%u-%u", 1u << i, (2u << i) - 1);
+
+        width = (rx->read_sizes[i] * STATS_BAR_WIDTH + max - 1) / max;
+        g_string_append_printf(str, "\n%12s %10" G_GSIZE_FORMAT " ", range,
+                               rx->read_sizes[i]);
+        while (width-- > 0)
+            g_string_append_c(str, '#');
+        g_free(range);
+    }
+}
+
+static void show_io_stats(Session *session, const IoStats *stats, const IoRates *rates)
+{
+    GString *str = g_string_sized_new(1024);
+    gchar *rx_rate = g_format_size((guint64)rates->rx_bytes);
+    gchar *tx_rate = g_format_size((guint64)rates->tx_bytes);
+    gchar *stored_size, *used_size;
+    guint64 stored, used;
+
+    g_string_append_printf(str,
+        "RX: %s/s, %" G_GSIZE_FORMAT " bytes, %.0f reads/s (%" G_GSIZE_FORMAT
+        " reads, %" G_GSIZE_FORMAT " polls, %" G_GSIZE_FORMAT " ioctls), %"
+        G_GSIZE_FORMAT " bytes dropped\n",
+        rx_rate, stats->rx.bytes, rates->reads, stats->rx.reads,
+        stats->rx.polls, stats->rx.ioctls, stats->overruns);
+    g_string_append_printf(str,
+        "TX: %s/s, %" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " writes (%"
+        G_GSIZE_FORMAT " partial), %" G_GSIZE_FORMAT " bytes queued\n",
+        tx_rate, stats->tx.written, stats->tx.writes, stats->tx.partial,
+        stats->tx_depth);
+    g_string_append_printf(str,
+        "Backlog: %" G_GSIZE_FORMAT " bytes in ring, %" G_GSIZE_FORMAT
+        " bytes waiting for display\n",
+        stats->ring_fill, stats->display_pending);
+    g_string_append_printf(str,
+        "Display lag: %.2f ms last, %.2f ms avg, %.2f ms max\n",
+        stats->lag_last / 1000.0, rates->lag_avg / 1000.0, stats->lag_max / 1000.0);
+    byte_store_get_memory(session->rx_store, &stored, &used);
+    stored_size = g_format_size(stored);
+    used_size = g_format_size(used);
+    g_string_append_printf(str, "Scrollback: %s kept in %s", stored_size, used_size);
+    g_free(stored_size);
+    g_free(used_size);
+    append_read_sizes(str, &stats->rx);
+
+    gtk_label_set_text(GTK_LABEL(session->lbl_stats), str->str);
+
+    g_free(tx_rate);
+    g_free(rx_rate);
+    g_string_free(str, TRUE);
+}
+
+static void update_lines_label(Session *session)
+{
+    guint64 lines = line_index_get_lines(receiver_get_line_index(session->receiver));
+    guint64 first = display_get_first_line(session->display);
+    gchar *text;
+
+    if (first > 0)
+    {
+        text = g_strdup_printf("Lines: %" G_GUINT64_FORMAT " (from %" G_GUINT64_FORMAT ")",
+                               lines, first + 1);
+    }
+    else
+    {
+        text = g_strdup_printf("Lines: %" G_GUINT64_FORMAT, lines);
+    }
+    gtk_label_set_text(GTK_LABEL(session->lbl_lines), text);
+    g_free(text);
+}
+
+/**
+ *  Refreshes statistics panel and writes statistics to dump, if any.
+ *  Called every STATS_INTERVAL while connected.
+ **/
+static gboolean stats_cb(gpointer data)
+{
+    Session *session = (Session*)data;
+    IoStats stats;
+    IoRates rates;
+    const IoStats *prev = session->have_prev_stats ? &session->prev_stats : NULL;
+
+    get_io_stats(session, &stats);
+    io_stats_get_rates(&stats, prev, &rates);
+
+    if (gtk_widget_get_mapped(session->lbl_stats))
+        show_io_stats(session, &stats, &rates);
+    update_lines_label(session);
+
+    if (session->stats_dump != NULL)
+    {
+        gchar *line = io_stats_to_json(&stats, prev, session->cfg->port);
+
+        io_stats_dump_write(session->stats_dump, line);
+        g_free(line);
+    }
+
+    session->prev_stats = stats;
+    session->have_prev_stats = TRUE;
+
+    return TRUE;
+}
+
+static void update_tx_label(Session *session, TxQueue *tx)
+{
+    gchar *text;
+
+    text = g_strdup_printf("TX queue: %" G_GSIZE_FORMAT "%s",
+                           tx_queue_get_depth(tx),
+                           tx_queue_is_full(tx) ? " (full)" : "");
+    gtk_label_set_text(GTK_LABEL(session->lbl_tx), text);
+    g_free(text);
+}
+
+static gboolean tx_written_cb(gpointer data)
+{
+    Session *session = (Session*)data;
+    SerialReader *reader = receiver_get_reader(session->receiver);
+
+    if (reader != NULL)
+        update_tx_label(session, serial_reader_get_tx_queue(reader));
+
+    if (session->sender != NULL)
+        file_sender_poll(session->sender);
+
+    return FALSE;
+}
+
+/**
+ *  Opens port with session configuration and starts receiving, port
+ *  overrides the configured one if not NULL.
+ *
+ *  \return FALSE if port could not be opened
+ **/
+static gboolean session_open(Session *session, const gchar *port)
+{
+    Configuration *cfg = session->cfg;
+    Configuration *cfg_port = NULL;
+    SerialReader *reader;
+    guint actual_rate;
+
+    if (port != NULL && g_strcmp0(port, cfg->port) != 0)
+    {
+        /* device came back under another name */
+        cfg_port = configuration_new();
+        configuration_copy(cfg_port, cfg);
+        g_free(cfg_port->port);
+        cfg_port->port = g_strdup(port);
+    }
+
+    serial_disconnect(session);
+    session->serial_channel = serial_connect(cfg_port != NULL ? cfg_port : cfg,
+                                             &session->serial_fd);
+    if (cfg_port != NULL)
+        configuration_free(cfg_port);
+
+    if (session->serial_channel == NULL)
+        return FALSE;
+
+    if (!receiver_start(session->receiver, session->serial_fd))
+    {
+        g_message("Unable to start serial reader");
+        serial_restore(session->serial_fd);
+        g_io_channel_unref(session->serial_channel);
+        session->serial_channel = NULL;
+        return FALSE;
+    }
+    reader = receiver_get_reader(session->receiver);
+    actual_rate = serial_get_baudrate(session->serial_fd);
+    serial_reader_set_capture(reader, session->capture);
+    serial_reader_set_triggers(reader, trigger_view_get_set(session->triggerview));
+    serial_reader_set_baudrate(reader, actual_rate != 0 ? actual_rate : cfg->rate);
+    frame_view_set_baudrate(session->frameview, actual_rate != 0 ? actual_rate : cfg->rate);
+    serial_reader_set_low_latency(reader, cfg->low_latency);
+    tx_queue_set_callback(serial_reader_get_tx_queue(reader), tx_written_cb, session);
+    update_tx_label(session, serial_reader_get_tx_queue(reader));
+    reset_round_trip(session);
+    session->have_prev_stats = FALSE;
+    session->stats_id = g_timeout_add(STATS_INTERVAL, stats_cb, session);
+    update_config_label(session, actual_rate);
+
+    session->connect_time = g_get_monotonic_time();
+    session->last_line_event = 0;
+    session->lines = line_monitor_new(session->serial_fd, control_lines_cb, session);
+
+    return TRUE;
+}
+
+/**
+ *  Closes port, stops waiting for it to come back and shows session as
+ *  disconnected.
+ **/
+static void session_close(Session *session)
+{
+    stop_port_watch(session);
+    serial_disconnect(session);
+    update_config_label(session, 0);
+    update_lines_label(session);
+    gtk_label_set_text(GTK_LABEL(session->lbl_tx), "TX queue: -");
+    gtk_widget_set_sensitive(session->btn_cfg, TRUE);
+    gtk_button_set_label(GTK_BUTTON(session->btn_connect), "Connect");
+}
+
+/**
+ *  Reopens port after its device came back as port. Time it was gone is
+ *  marked in received data and in capture.
+ *
+ *  \return FALSE if port could not be opened
+ **/
+static gboolean reconnect(Session *session, const gchar *port)
+{
+    gint64 downtime;
+    gchar *text;
+
+    if (!session_open(session, port))
+        return FALSE;
+
+    downtime = g_get_monotonic_time() - session->hangup_time;
+    receiver_mark_gap(session->receiver);
+    if (session->capture != NULL)
+    {
+        guint64 record = GUINT64_TO_LE((guint64)downtime * 1000);
+
+        capture_writer_append(session->capture, CAPTURE_GAP, session->hangup_time,
+                              (const guint8*)&record, sizeof(record));
+    }
+
+    session->reconnects++;
+    text = g_strdup_printf("Reconnected %u times, last time %s was gone for %.1f ms",
+                           session->reconnects, port, downtime / 1000.0);
+    gtk_widget_set_tooltip_text(session->lbl_cfg, text);
+    g_free(text);
+
+    session->hangup_time = 0;
+
+    return TRUE;
+}
+
+static gboolean reconnect_retry_cb(gpointer data)
+{
+    Session *session = (Session*)data;
+
+    if (!reconnect(session, session->retry_port) &&
+        ++session->retries < RECONNECT_RETRIES)
+        return TRUE;
+
+    if (session->hangup_time != 0)
+        g_message("Giving up on %s, waiting for device to be plugged in again",
+                  session->retry_port);
+
+    /* source is removed by returning FALSE */
+    session->retry_id = 0;
+    cancel_reconnect_retry(session);
+
+    return FALSE;
+}
+
+/**
+ *  Reopens port, retrying for a while if that fails.
+ **/
+static void try_reconnect(Session *session, const gchar *port)
+{
+    cancel_reconnect_retry(session);
+    if (reconnect(session, port))
+        return;
+
+    session->retry_port = g_strdup(port);
+    session->retries = 0;
+    session->retry_id = g_timeout_add(RECONNECT_RETRY_INTERVAL, reconnect_retry_cb, session);
+}
+
+static void port_watch_cb(PortWatch *watch, const gchar *port, gpointer data)
+{
+    Session *session = (Session*)data;
+
+    if (session->hangup_time != 0)
+    {
+        try_reconnect(session, port);
+    }
+    else
+    {
+        /*
+           Events may be dispatched before the hangup of the old port. Also
+           sent once the port is open, e.g. when udev sets permissions after
+           we opened the node as root, hence the age check at hangup.
+        */
+        g_free(session->replug_port);
+        session->replug_port = g_strdup(port);
+        session->replug_time = g_get_monotonic_time();
+    }
+}
+
+/**
+ *  Closes port whose device went away, keeping everything else, and waits
+ *  for device to come back if auto reconnect is on. Otherwise, or if the
+ *  device can't be watched, session is simply disconnected.
+ **/
+static void hangup_cb(Receiver *rx, gpointer data)
+{
+    Session *session = (Session*)data;
+    gchar *replug_port = session->replug_port;
+    gchar *text;
+
+    if (session->watch == NULL)
+    {
+        session_close(session);
+        return;
+    }
+
+    session->replug_port = NULL;
+    session->hangup_time = g_get_monotonic_time();
+    serial_disconnect(session);
+    update_lines_label(session);
+    gtk_label_set_text(GTK_LABEL(session->lbl_tx), "TX queue: -");
+
+    text = g_strdup_printf("%s (waiting for device)", session->cfg->port);
+    gtk_label_set_text(GTK_LABEL(session->lbl_cfg), text);
+    g_free(text);
+
+    if (replug_port != NULL &&
+        session->hangup_time - session->replug_time <= REPLUG_MAX_AGE)
+    {
+        gchar *id = port_watch_identify(replug_port);
+
+        /* node is gone or belongs to another device by now */
+        if (g_strcmp0(id, port_watch_get_id(session->watch)) == 0)
+            try_reconnect(session, replug_port);
+        g_free(id);
+    }
+    g_free(replug_port);
+}
+
+static void connect_button_cb(GtkButton *btn, Session *session)
+{
+    Configuration *cfg = session->cfg;
+
+    if (gtk_widget_is_sensitive(session->btn_cfg) == TRUE)
+    {
+        /* Connect to serial port */
+        if (!session_open(session, NULL))
+        {
+            g_message("Unable to connect");
+            return;
+        }
+
+        session->reconnects = 0;
+        gtk_widget_set_tooltip_text(session->lbl_cfg, NULL);
+        if (cfg->auto_reconnect)
+            session->watch = port_watch_new(cfg->port, port_watch_cb, session);
+
+        gtk_widget_set_sensitive(session->btn_cfg, FALSE);
+        gtk_button_set_label(btn, "Disconnect");
+    }
+    else
+    {
+        /* Disconnect from serial port, or stop waiting for it */
+        session_close(session);
+    }
+}
+
+static void send_button_cb(GtkButton *btn, Session *session)
+{
+    Configuration *cfg = session->cfg;
+
+    if (session->serial_channel != NULL)
+    {
+        const gchar *entry_text = gtk_entry_get_text(GTK_ENTRY(session->entry));
+        gsize entry_text_length = strlen(entry_text);
+        TxQueue *tx;
+
+        if (entry_text_length == 0)
+        {
+            return;
+        }
+
+        /* line and its terminator are queued whole or not at all */
+        tx = serial_reader_get_tx_queue(receiver_get_reader(session->receiver));
+        if (tx_queue_get_space(tx) < entry_text_length + cfg->n_terminator_chars)
+        {
+            g_message("Transmit queue full, line not sent");
+            return;
+        }
+
+        tx_queue_push(tx, (const guint8*)entry_text, entry_text_length);
+        tx_queue_push(tx, (const guint8*)cfg->terminator, cfg->n_terminator_chars);
+        receiver_mark_sent(session->receiver);
+        update_tx_label(session, tx);
+#ifdef DEBUG
+        g_message("Queued %" G_GSIZE_FORMAT " bytes",
+                  entry_text_length + cfg->n_terminator_chars);
+#endif
+
+        gtk_entry_set_text(GTK_ENTRY(session->entry), "");
+    }
+}
+
+static void send_progress_cb(FileSender *sender, gpointer data)
+{
+    Session *session = (Session*)data;
+    guint64 size = file_sender_get_size(sender);
+    guint64 written = file_sender_get_written(sender);
+    gchar *s_written = g_format_size(written);
+    gchar *s_size = g_format_size(size);
+    gchar *s_rate = g_format_size((guint64)file_sender_get_rate(sender));
+    gchar *text;
+
+    text = g_strdup_printf("%s of %s, %s/s", s_written, s_size, s_rate);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(session->progress_bar), text);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(session->progress_bar),
+                                  size > 0 ? (gdouble)written / size : 1.0);
+    g_free(text);
+    g_free(s_rate);
+    g_free(s_size);
+    g_free(s_written);
+
+    if (file_sender_is_done(sender))
+    {
+        g_message("File sent, %" G_GUINT64_FORMAT " bytes", size);
+        stop_send(session);
+    }
+}
+
+static void cancel_send_button_cb(GtkButton *btn, Session *session)
+{
+    if (session->sender != NULL)
+    {
+        /* what is still queued belongs to the file, don't let it trickle out */
+        tx_queue_clear(serial_reader_get_tx_queue(receiver_get_reader(session->receiver)));
+        stop_send(session);
+    }
+}
+
+/**
+ *  Creates pacing settings shown in send file dialog.
+ **/
+static GtkWidget *create_pacing_widgets(Session *session, GtkWidget **cbox,
+                                        GtkWidget **spin)
+{
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    guint i;
+
+    *cbox = gtk_combo_box_text_new();
+    for (i = 0; i < n_pacing_labels; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(*cbox), pacing_labels[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(*cbox), session->send_pacing);
+
+    *spin = gtk_spin_button_new_with_range(0, G_MAXINT, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(*spin), session->send_pacing_value);
+
+    gtk_box_pack_start(GTK_BOX(hbox), gtk_label_new("Pacing:"), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), *cbox, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), *spin, FALSE, FALSE, 0);
+    gtk_widget_show_all(hbox);
+
+    return hbox;
+}
+
+static void send_file_button_cb(GtkButton *btn, Session *session)
+{
+    GtkWidget *dialog, *cbox, *spin;
+    gchar *filename = NULL;
+    TxQueue *tx;
+
+    if (session->serial_channel == NULL || session->sender != NULL)
+        return;
+
+    dialog = gtk_file_chooser_dialog_new("Send file", session->window,
+                                         GTK_FILE_CHOOSER_ACTION_OPEN,
+                                         GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                         GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+                                         NULL);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog),
+                                      create_pacing_widgets(session, &cbox, &spin));
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
+    {
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        session->send_pacing = gtk_combo_box_get_active(GTK_COMBO_BOX(cbox));
+        session->send_pacing_value = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(spin));
+    }
+    gtk_widget_destroy(dialog);
+
+    /* port could have gone away while dialog was shown */
+    if (filename == NULL || session->serial_channel == NULL)
+    {
+        g_free(filename);
+        return;
+    }
+
+    tx = serial_reader_get_tx_queue(receiver_get_reader(session->receiver));
+    session->sender = file_sender_new(filename, tx, session->send_pacing,
+                                      session->send_pacing_value,
+                                      session->cfg->terminator,
+                                      session->cfg->n_terminator_chars,
+                                      send_progress_cb, session);
+    g_free(filename);
+
+    if (session->sender != NULL)
+    {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(session->progress_bar), 0);
+        gtk_widget_show(session->hbox_progress);
+        file_sender_poll(session->sender);
+    }
+}
+
+static void capture_button_cb(GtkToggleButton *btn, Session *session)
+{
+    if (gtk_toggle_button_get_active(btn))
+    {
+        GtkWidget *dialog;
+        gchar *filename = NULL;
+
+        if (session->capture != NULL)
+            return;
+
+        dialog = gtk_file_chooser_dialog_new("Save capture", session->window,
+                                             GTK_FILE_CHOOSER_ACTION_SAVE,
+                                             GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                             GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                             NULL);
+        gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+        gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "capture.guart");
+
+        if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
+            filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        gtk_widget_destroy(dialog);
+
+        if (filename == NULL ||
+            !start_capture(session, filename, g_get_monotonic_time()))
+        {
+            g_free(filename);
+            /* emits "toggled" again, which is no-op as there is no capture */
+            gtk_toggle_button_set_active(btn, FALSE);
+            return;
+        }
+        g_free(filename);
+
+        gtk_button_set_label(GTK_BUTTON(btn), "Stop capture");
+    }
+    else
+    {
+        stop_capture(session);
+        gtk_button_set_label(GTK_BUTTON(btn), "Capture");
+    }
+}
+
+/**
+ *  Shows trigger that fired in reader. Control line changes were already
+ *  made by the I/O thread, which also kept data since a capture start
+ *  and stopped appending at a capture stop; the file is opened and closed
+ *  here, along with the capture button.
+ **/
+static void trigger_cb(Receiver *rx, const TriggerEvent *event, gpointer data)
+{
+    Session *session = (Session*)data;
+    GtkToggleButton *btn = GTK_TOGGLE_BUTTON(session->btn_capture);
+    gchar *argument = NULL;
+
+    if (!trigger_view_fired(session->triggerview, event, &argument))
+        return;
+
+    switch (event->action)
+    {
+        case TRIGGER_RTS_HIGH:
+        case TRIGGER_RTS_LOW:
+        case TRIGGER_DTR_HIGH:
+        case TRIGGER_DTR_LOW:
+            if (session->lines != NULL)
+                line_monitor_refresh(session->lines);
+            break;
+        case TRIGGER_CAPTURE_START:
+            if (session->capture != NULL)
+                break;
+
+            if (start_capture(session, argument, event->arrival))
+            {
+                /* "toggled" is a no-op as capture is already running */
+                gtk_toggle_button_set_active(btn, TRUE);
+                gtk_button_set_label(GTK_BUTTON(btn), "Stop capture");
+            }
+            else if (receiver_get_reader(session->receiver) != NULL)
+            {
+                serial_reader_cancel_capture(receiver_get_reader(session->receiver));
+            }
+            break;
+        case TRIGGER_CAPTURE_STOP:
+            gtk_toggle_button_set_active(btn, FALSE);
+            break;
+        default:
+            break;
+    }
+    g_free(argument);
+}
+
+static void triggers_changed_cb(TriggerView *tv, gpointer data)
+{
+    Session *session = (Session*)data;
+
+    if (receiver_get_reader(session->receiver) != NULL)
+        serial_reader_set_triggers(receiver_get_reader(session->receiver),
+                                   trigger_view_get_set(tv));
+}
+
+static void
+entry_cb(GtkEntry *entry, Session *session)
+{
+    send_button_cb(NULL, session);
+}
+
+static gboolean
+show_menu_cb(GtkWidget *widget, GdkEvent *event)
+{
+    GtkMenu *menu;
+    Session *session;
+
+    g_return_val_if_fail(widget != NULL, FALSE);
+    g_return_val_if_fail(GTK_IS_MENU(widget), FALSE);
+    g_return_val_if_fail(event != NULL, FALSE);
+
+    session = g_object_get_data(G_OBJECT(widget), "session");
+    if (session->serial_channel == NULL)
+    {
+        /* there's no point in showing menu if we're not connected to any tty */
+        return FALSE;
+    }
+
+    menu = GTK_MENU (widget);
+    if (event->type == GDK_BUTTON_PRESS)
+    {
+        GdkEventButton *event_button = (GdkEventButton *) event;
+        if (event_button->button == 3)
+        {
+            gtk_menu_popup(GTK_MENU(menu), NULL, NULL, NULL, NULL,
+                           event_button->button, event_button->time);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void status_line_menu_item_cb(GtkMenuItem *item, gpointer data)
+{
+    gint state = GPOINTER_TO_INT(data);
+    void (*callback)(int fd, gchar state) = g_object_get_data(G_OBJECT(item), "callback");
+    Session *session = g_object_get_data(G_OBJECT(item), "session");
+
+    if (session->serial_channel == NULL)
+    {
+        /* not connected to any tty */
+        return;
+    }
+    if (callback != NULL)
+    {
+        callback(session->serial_fd, (gchar)state);
+        if (session->lines != NULL)
+            line_monitor_refresh(session->lines);
+    }
+}
+
+static void create_control_line_widget(Session *session, GtkWidget *box, gchar *lbl,
+                                       GtkWidget **widget, gchar *menu_lbl,
+                                       void (*callback)(int fd, gchar state))
+{
+    GtkWidget *label;
+
+    if (callback != NULL)
+    {
+        /* pack label inside GtkEventBox, so we can get button press event */
+        label = gtk_event_box_new();
+        GtkWidget *text = gtk_label_new(lbl);
+        gtk_container_add(GTK_CONTAINER(label), text);
+    }
+    else
+    {
+        label = gtk_label_new(lbl);
+    }
+    *widget = gtk_label_new(NULL);
+
+    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), *widget, FALSE, FALSE, 0);
+
+    if (callback != NULL && menu_lbl != NULL)
+    {
+        /* prepare right click menu */
+        GtkWidget *menu = gtk_menu_new();
+        gchar *high = g_strdup_printf("Set %s high", menu_lbl);
+        gchar *low = g_strdup_printf("Set %s low", menu_lbl);
+
+        GtkWidget *i_high = gtk_menu_item_new_with_label(high);
+        GtkWidget *i_low = gtk_menu_item_new_with_label(low);
+
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), i_high);
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), i_low);
+        g_object_set_data(G_OBJECT(menu), "session", session);
+
+        g_object_set_data(G_OBJECT(i_high), "callback", callback);
+        g_object_set_data(G_OBJECT(i_high), "session", session);
+        g_signal_connect(i_high, "activate",
+                         G_CALLBACK(status_line_menu_item_cb),
+                         GINT_TO_POINTER(1));
+
+        g_object_set_data(G_OBJECT(i_low), "callback", callback);
+        g_object_set_data(G_OBJECT(i_low), "session", session);
+        g_signal_connect(i_low, "activate",
+                         G_CALLBACK(status_line_menu_item_cb),
+                         GINT_TO_POINTER(0));
+
+        g_signal_connect_swapped(label, "button-press-event",
+                                 G_CALLBACK(show_menu_cb), menu);
+
+        g_free(high);
+        g_free(low);
+
+        /*
+           show menu widgets now, so later just gtk_menu_popup() will suffice
+        */
+        gtk_widget_show_all(menu);
+    }
+}
+
+static void timestamps_changed_cb(GtkComboBox *combo, Session *session)
+{
+    /* entries are in order of DisplayTimestamps */
+    display_set_timestamps(session->display, gtk_combo_box_get_active(combo));
+}
+
+static void goto_line_cb(GtkWidget *widget, Session *session)
+{
+    /* lines are shown numbered from 1 */
+    guint64 line = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(session->spin_line));
+
+    if (!display_scroll_to_line(session->display, line - 1))
+        g_message("Line %" G_GUINT64_FORMAT " is not in scrollback", line);
+}
+
+/* matches around current one highlighted in text view */
+#define SEARCH_TEXT_HIGHLIGHTS 100
+
+/**
+ *  Highlights and scrolls to current match in both views.
+ **/
+static void show_search_match(Session *session)
+{
+    const SearchMatch *matches;
+    SearchStats stats;
+    guint n, i, first, last;
+    gchar *text;
+
+    matches = search_get_matches(session->search, &n);
+    search_get_stats(session->search, &stats);
+
+    hex_view_set_highlights(session->hexview, matches, n, session->search_current);
+    hex_view_scroll_to(session->hexview, matches[session->search_current].offset);
+
+    /* text view is highlighted with tags, keep their number bounded */
+    display_clear_highlights(session->display);
+    first = session->search_current - MIN(session->search_current, SEARCH_TEXT_HIGHLIGHTS);
+    last = MIN(session->search_current + SEARCH_TEXT_HIGHLIGHTS, n - 1);
+    for (i = first; i <= last; i++)
+    {
+        display_highlight(session->display, session->rx_store, matches[i].offset,
+                          matches[i].len, i == session->search_current);
+    }
+
+    text = g_strdup_printf("Match %u of %u%s (%" G_GINT64_FORMAT " ms)",
+                           session->search_current + 1, n, stats.truncated ? "+" : "",
+                           stats.time / 1000);
+    gtk_label_set_text(GTK_LABEL(session->lbl_search), text);
+    g_free(text);
+}
+
+static void search_done_cb(Search *search, gpointer data)
+{
+    Session *session = (Session*)data;
+    guint n;
+
+    search_get_matches(search, &n);
+    if (n == 0)
+    {
+        gtk_label_set_text(GTK_LABEL(session->lbl_search), "No matches");
+        return;
+    }
+
+    session->search_current = 0;
+    show_search_match(session);
+}
+
+static void find_cb(GtkWidget *widget, Session *session)
+{
+    gboolean regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(session->chk_regex));
+    gboolean match_case = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(session->chk_match_case));
+
+    stop_search(session);
+    session->search = search_new(receiver_get_search_index(session->receiver),
+                                 gtk_entry_get_text(GTK_ENTRY(session->search_entry)),
+                                 regex ? SEARCH_REGEX : SEARCH_LITERAL, !match_case,
+                                 search_done_cb, session);
+
+    gtk_label_set_text(GTK_LABEL(session->lbl_search),
+                       session->search != NULL ? "Searching..." : "");
+}
+
+static void find_step(Session *session, gint step)
+{
+    guint n;
+
+    if (session->search == NULL || !search_is_done(session->search))
+        return;
+
+    search_get_matches(session->search, &n);
+    if (n == 0)
+        return;
+
+    session->search_current = (session->search_current + n + step) % n;
+    show_search_match(session);
+}
+
+static void find_next_cb(GtkButton *btn, Session *session)
+{
+    find_step(session, 1);
+}
+
+static void find_prev_cb(GtkButton *btn, Session *session)
+{
+    find_step(session, -1);
+}
+
+static GtkWidget *create_search_widgets(Session *session)
+{
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *btn_find = gtk_button_new_with_label("Find");
+    GtkWidget *btn_prev = gtk_button_new_with_label("Previous");
+    GtkWidget *btn_next = gtk_button_new_with_label("Next");
+
+    session->search_entry = gtk_entry_new();
+    session->chk_regex = gtk_check_button_new_with_label("Regex");
+    session->chk_match_case = gtk_check_button_new_with_label("Match case");
+    session->lbl_search = gtk_label_new(NULL);
+
+    g_signal_connect(G_OBJECT(session->search_entry), "activate",
+                     G_CALLBACK(find_cb), session);
+    g_signal_connect(G_OBJECT(btn_find), "clicked",
+                     G_CALLBACK(find_cb), session);
+    g_signal_connect(G_OBJECT(btn_prev), "clicked",
+                     G_CALLBACK(find_prev_cb), session);
+    g_signal_connect(G_OBJECT(btn_next), "clicked",
+                     G_CALLBACK(find_next_cb), session);
+
+    gtk_box_pack_start(GTK_BOX(hbox), session->search_entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), session->chk_regex, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), session->chk_match_case, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_find, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_prev, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_next, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), session->lbl_search, FALSE, FALSE, 0);
+
+    return hbox;
+}
+
+static GtkWidget *create_view_widgets(Session *session)
+{
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *cbox_timestamps = gtk_combo_box_text_new();
+    GtkWidget *btn_goto = gtk_button_new_with_label("Go to line");
+
+    session->spin_line = gtk_spin_button_new_with_range(1, G_MAXINT, 1);
+    session->lbl_lines = gtk_label_new("Lines: 0");
+
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cbox_timestamps), "No timestamps");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cbox_timestamps), "Arrival time");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cbox_timestamps), "Gap to previous line");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cbox_timestamps), DISPLAY_TIMESTAMPS_NONE);
+    g_signal_connect(G_OBJECT(cbox_timestamps), "changed",
+                     G_CALLBACK(timestamps_changed_cb), session);
+    g_signal_connect(G_OBJECT(btn_goto), "clicked",
+                     G_CALLBACK(goto_line_cb), session);
+    g_signal_connect(G_OBJECT(session->spin_line), "activate",
+                     G_CALLBACK(goto_line_cb), session);
+
+    gtk_box_pack_start(GTK_BOX(hbox), cbox_timestamps, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), session->lbl_lines, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), session->spin_line, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_goto, FALSE, FALSE, 0);
+
+    return hbox;
+}
+
+static GtkWidget *create_control_line_widgets(Session *session)
+{
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox), TRUE);
+
+    create_control_line_widget(session, hbox, "DTR:", &session->txt_dtr, "DTR", set_dtr);
+    create_control_line_widget(session, hbox, "DSR:", &session->txt_dsr, NULL, NULL);
+    create_control_line_widget(session, hbox, "RTS:", &session->txt_rts, "RTS", set_rts);
+    create_control_line_widget(session, hbox, "CTS:", &session->txt_cts, NULL, NULL);
+    create_control_line_widget(session, hbox, "DCD:", &session->txt_dcd, NULL, NULL);
+    create_control_line_widget(session, hbox, "RI:", &session->txt_ri, NULL, NULL);
+
+    session->lbl_round_trip = gtk_label_new("Round trip: -");
+    gtk_box_pack_start(GTK_BOX(hbox), session->lbl_round_trip, TRUE, TRUE, 0);
+
+    session->lbl_tx = gtk_label_new("TX queue: -");
+    gtk_box_pack_start(GTK_BOX(hbox), session->lbl_tx, TRUE, TRUE, 0);
+
+    return hbox;
+}
+
+/**
+ *  Creates session for port described by cfg, which session takes over.
+ *  window is used as parent of dialogs.
+ **/
+Session *session_new(GtkWindow *window, Configuration *cfg)
+{
+    Session *session = g_slice_new0(Session);
+    GtkWidget *hbox_conf;
+    GtkWidget *scrolled_window;
+    GtkWidget *notebook;
+    GtkWidget *hbox_input;
+    GtkWidget *btn_send;
+    GtkWidget *btn_send_file;
+    GtkWidget *btn_cancel_send;
+    GtkWidget *control_lines;
+    GtkWidget *view_widgets;
+    GtkWidget *search_widgets;
+    GtkWidget *expander_stats;
+    GtkWidget *expander_triggers;
+    GtkWidget *view;
+    GtkWidget *btn_close;
+    PangoFontDescription *font_desc;
+
+    session->window = window;
+    session->cfg = cfg;
+
+    session->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_set_homogeneous(GTK_BOX(session->box), FALSE);
+
+    session->tab = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+    session->tab_label = gtk_label_new(cfg->port);
+    btn_close = gtk_button_new_with_label("\u00D7");
+    gtk_button_set_relief(GTK_BUTTON(btn_close), GTK_RELIEF_NONE);
+    gtk_widget_set_tooltip_text(btn_close, "Close session");
+    gtk_box_pack_start(GTK_BOX(session->tab), session->tab_label, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(session->tab), btn_close, FALSE, FALSE, 0);
+    gtk_widget_show_all(session->tab);
+    g_signal_connect_swapped(G_OBJECT(btn_close), "clicked",
+                             G_CALLBACK(gtk_widget_destroy), session->box);
+
+    hbox_conf = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_conf), FALSE);
+
+    session->lbl_cfg = gtk_label_new(NULL);
+    session->btn_cfg = gtk_button_new_with_label("Configure");
+    session->btn_connect = gtk_button_new_with_label("Connect");
+    session->btn_capture = gtk_toggle_button_new_with_label("Capture");
+
+    g_signal_connect(G_OBJECT(session->btn_cfg), "clicked",
+                     G_CALLBACK(cfg_button_cb), session);
+    g_signal_connect(G_OBJECT(session->btn_connect), "clicked",
+                     G_CALLBACK(connect_button_cb), session);
+    g_signal_connect(G_OBJECT(session->btn_capture), "toggled",
+                     G_CALLBACK(capture_button_cb), session);
+
+    gtk_box_pack_start(GTK_BOX(hbox_conf), session->lbl_cfg, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_conf), session->btn_cfg, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_conf), session->btn_connect, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_conf), session->btn_capture, FALSE, FALSE, 0);
+
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(view), FALSE);
+    gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(view), FALSE);
+    font_desc = display_font_new();
+    gtk_widget_modify_font(GTK_WIDGET(view), font_desc);
+    pango_font_description_free(font_desc);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), view);
+    session->display = display_new(GTK_TEXT_VIEW(view));
+    display_set_latency(session->display, cfg->display_latency);
+    display_set_scrollback(session->display, cfg->scrollback_limit, cfg->scrollback_unit);
+
+    notebook = gtk_notebook_new();
+    session->rx_store = byte_store_new();
+    session->hexview = hex_view_new_for_store(session->rx_store);
+    session->frameview = frame_view_new(session->rx_store);
+    frame_view_set_baudrate(session->frameview, cfg->rate);
+    session->receiver = receiver_new(session->display, session->rx_store, session->hexview,
+                                     session->frameview, cfg->terminator,
+                                     cfg->n_terminator_chars);
+    receiver_set_round_trip_func(session->receiver, round_trip_cb, session);
+    receiver_set_trigger_func(session->receiver, trigger_cb, session);
+    receiver_set_hangup_func(session->receiver, hangup_cb, session);
+
+    hbox_input = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(hbox_input), FALSE);
+
+    session->entry = gtk_entry_new();
+    btn_send = gtk_button_new_with_label("Send");
+    gtk_box_pack_start(GTK_BOX(hbox_input), session->entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox_input), btn_send, FALSE, FALSE, 0);
+    btn_send_file = gtk_button_new_with_label("Send file");
+    gtk_box_pack_start(GTK_BOX(hbox_input), btn_send_file, FALSE, FALSE, 0);
+
+    session->hbox_progress = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    session->progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(session->progress_bar), TRUE);
+    btn_cancel_send = gtk_button_new_with_label("Cancel");
+    gtk_box_pack_start(GTK_BOX(session->hbox_progress), session->progress_bar, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(session->hbox_progress), btn_cancel_send, FALSE, FALSE, 0);
+    gtk_widget_show(session->progress_bar);
+    gtk_widget_show(btn_cancel_send);
+    gtk_widget_set_no_show_all(session->hbox_progress, TRUE);
+
+    g_signal_connect(G_OBJECT(btn_send), "clicked",
+                     G_CALLBACK(send_button_cb), session);
+    g_signal_connect(G_OBJECT(btn_send_file), "clicked",
+                     G_CALLBACK(send_file_button_cb), session);
+    g_signal_connect(G_OBJECT(btn_cancel_send), "clicked",
+                     G_CALLBACK(cancel_send_button_cb), session);
+    g_signal_connect(G_OBJECT(session->entry), "activate",
+                     G_CALLBACK(entry_cb), session);
+
+    control_lines = create_control_line_widgets(session);
+    view_widgets = create_view_widgets(session);
+    search_widgets = create_search_widgets(session);
+
+    session->triggerview = trigger_view_new();
+    trigger_view_set_changed_func(session->triggerview, triggers_changed_cb, session);
+    expander_triggers = gtk_expander_new("Triggers");
+    gtk_container_add(GTK_CONTAINER(expander_triggers),
+                      trigger_view_get_widget(session->triggerview));
+
+    expander_stats = gtk_expander_new("Statistics");
+    session->lbl_stats = gtk_label_new("Not connected");
+    gtk_label_set_selectable(GTK_LABEL(session->lbl_stats), TRUE);
+    gtk_misc_set_alignment(GTK_MISC(session->lbl_stats), 0, 0);
+    font_desc = pango_font_description_from_string("Monospace 9");
+    gtk_widget_modify_font(session->lbl_stats, font_desc);
+    pango_font_description_free(font_desc);
+    gtk_container_add(GTK_CONTAINER(expander_stats), session->lbl_stats);
+
+    gtk_box_pack_start(GTK_BOX(session->box), hbox_conf, FALSE, FALSE, 0);
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), scrolled_window,
+                             gtk_label_new("Text View"));
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), hex_view_get_widget(session->hexview),
+                             gtk_label_new("Hex View"));
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), frame_view_get_widget(session->frameview),
+                             gtk_label_new("Frames"));
+    gtk_box_pack_start(GTK_BOX(session->box), notebook, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), view_widgets, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), search_widgets, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), hbox_input, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), session->hbox_progress, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), control_lines, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), expander_triggers, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(session->box), expander_stats, FALSE, FALSE, 0);
+
+    update_config_label(session, 0);
+
+    g_signal_connect(G_OBJECT(session->box), "destroy",
+                     G_CALLBACK(session_destroy_cb), session);
+
+    return session;
+}
+
+GtkWidget *session_get_widget(Session *session)
+{
+    return session->box;
+}
+
+/**
+ *  \return widget to be used as notebook tab label, shows port name and
+ *  a button closing the session
+ **/
+GtkWidget *session_get_tab_label(Session *session)
+{
+    return session->tab;
+}
+
+Configuration *session_get_configuration(Session *session)
+{
+    return session->cfg;
+}
+
+/**
+ *  Makes session write its statistics to dump every STATS_INTERVAL while
+ *  connected. dump may be NULL, it must outlive session otherwise.
+ **/
+void session_set_stats_dump(Session *session, IoStatsDump *dump)
+{
+    session->stats_dump = dump;
+}
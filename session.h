@@ -0,0 +1,38 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <gtk/gtk.h>
+#include "conf.h"
+#include "iostats.h"
+
+/**
+ *  One serial port with its own configuration, connection, views and
+ *  capture. Any number of sessions can be open at once, all ports are
+ *  read by the shared I/O thread (see reader.h).
+ *  Session is freed, and disconnected, when its widget is destroyed.
+ **/
+typedef struct _Session Session;
+
+Session *session_new(GtkWindow *window, Configuration *cfg);
+GtkWidget *session_get_widget(Session *session);
+GtkWidget *session_get_tab_label(Session *session);
+Configuration *session_get_configuration(Session *session);
+void session_set_stats_dump(Session *session, IoStatsDump *dump);
+
+#endif /* SESSION_H */
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+/* for CLOCK_MONOTONIC_RAW */
+#define _GNU_SOURCE
+#include <glib.h>
+#include <time.h>
+#include "timeindex.h"
+
+/* absolute values of first chunk of every block */
+typedef struct {
+    guint64 offset;
+    gint64 time;
+    gint64 prev_time;  /* of last chunk of previous block, -1 if none */
+    gint64 clock_diff; /* monotonic minus raw clock, in ns */
+    gsize pos;         /* of block in encoded deltas */
+} TimeBlock;
+
+struct _TimeIndex {
+    GArray *blocks;  /* of TimeBlock */
+    GByteArray *deltas;
+
+    guint64 n_chunks;
+    guint64 end;
+    gint64 last_time;
+};
+
+/**
+ *  \return CLOCK_MONOTONIC_RAW time in ns, clock received chunks are
+ *  stamped with
+ **/
+gint64 time_index_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TimeIndex *time_index_new(void)
+{
+    TimeIndex *index = g_slice_new0(TimeIndex);
+
+    index->blocks = g_array_new(FALSE, FALSE, sizeof(TimeBlock));
+    index->deltas = g_byte_array_new();
+    index->last_time = -1;
+
+    return index;
+}
+
+void time_index_free(TimeIndex *index)
+{
+    g_array_free(index->blocks, TRUE);
+    g_byte_array_free(index->deltas, TRUE);
+    g_slice_free(TimeIndex, index);
+}
+
+static void put_varint(GByteArray *out, guint64 value)
+{
+    guint8 buf[10];
+    guint n = 0;
+
+    while (value >= 0x80)
+    {
+        buf[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    g_byte_array_append(out, buf, n);
+}
+
+static guint64 get_varint(const guint8 *data, gsize *pos)
+{
+    guint64 value = 0;
+    guint shift = 0;
+    guint8 c;
+
+    do
+    {
+        c = data[(*pos)++];
+        value |= (guint64)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return value;
+}
+
+/**
+ *  Adds chunk of len bytes following previous one. time is from
+ *  time_index_now(), monotonic is the same moment on g_get_monotonic_time()
+ *  clock; only their difference at block start is kept.
+ **/
+void time_index_append(TimeIndex *index, gsize len, gint64 time, gint64 monotonic)
+{
+    if (len == 0)
+        return;
+
+    /* time never goes back, but a bogus stamp must not break the encoding */
+    if (time < index->last_time)
+        time = index->last_time;
+
+    if (index->n_chunks % TIME_INDEX_BLOCK == 0)
+    {
+        TimeBlock block;
+
+        block.offset = index->end;
+        block.time = time;
+        block.prev_time = index->last_time;
+        block.clock_diff = monotonic * 1000 - time;
+        block.pos = index->deltas->len;
+        g_array_append_val(index->blocks, block);
+        put_varint(index->deltas, len);
+    }
+    else
+    {
+        put_varint(index->deltas, len);
+        put_varint(index->deltas, time - index->last_time);
+    }
+
+    index->n_chunks++;
+    index->end += len;
+    index->last_time = time;
+}
+
+/**
+ *  Looks up chunk that byte at offset arrived in.
+ *
+ *  \return FALSE if offset was not appended yet
+ **/
+gboolean time_index_find(TimeIndex *index, guint64 offset, TimeChunk *chunk)
+{
+    guint lo = 0, hi = index->blocks->len;
+    TimeBlock *block;
+    gsize pos;
+    guint i;
+
+    if (offset >= index->end)
+        return FALSE;
+
+    /* last block starting at or before offset */
+    while (hi - lo > 1)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (g_array_index(index->blocks, TimeBlock, mid).offset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    block = &g_array_index(index->blocks, TimeBlock, lo);
+
+    pos = block->pos;
+    chunk->offset = block->offset;
+    chunk->len = get_varint(index->deltas->data, &pos);
+    chunk->time = block->time;
+    chunk->gap = block->prev_time < 0 ? -1 : block->time - block->prev_time;
+
+    for (i = 1; chunk->offset + chunk->len <= offset && i < TIME_INDEX_BLOCK; i++)
+    {
+        chunk->offset += chunk->len;
+        chunk->len = get_varint(index->deltas->data, &pos);
+        chunk->gap = get_varint(index->deltas->data, &pos);
+        chunk->time += chunk->gap;
+    }
+    chunk->monotonic = (chunk->time + block->clock_diff) / 1000;
+
+    return TRUE;
+}
+
+/**
+ *  \return number of chunks appended
+ **/
+guint64 time_index_get_count(TimeIndex *index)
+{
+    return index->n_chunks;
+}
+
+/**
+ *  \return bytes used to store chunks
+ **/
+gsize time_index_get_size(TimeIndex *index)
+{
+    return index->deltas->len + index->blocks->len * sizeof(TimeBlock);
+}
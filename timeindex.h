@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <glib.h>
+
+/**
+ *  Arrival time of every received chunk (data returned by one read()),
+ *  taken from CLOCK_MONOTONIC_RAW, which unlike the clock of
+ *  g_get_monotonic_time() is not slewed by NTP, so gaps between chunks
+ *  are exact. Chunks are stored as variable length deltas of length and
+ *  time, typically 3 to 5 bytes each, with an absolute checkpoint every
+ *  TIME_INDEX_BLOCK chunks for lookup by offset.
+ *  Offsets count appended bytes from 0, like those of ByteStore.
+ **/
+typedef struct _TimeIndex TimeIndex;
+
+#define TIME_INDEX_BLOCK 64
+
+typedef struct {
+    guint64 offset; /* of first byte */
+    gsize len;
+    gint64 time;      /* CLOCK_MONOTONIC_RAW, in ns */
+    gint64 gap;       /* ns since previous chunk arrived, -1 for first one */
+    gint64 monotonic; /* same moment on g_get_monotonic_time() clock, in us */
+} TimeChunk;
+
+gint64 time_index_now(void);
+
+TimeIndex *time_index_new(void);
+void time_index_free(TimeIndex *index);
+
+void time_index_append(TimeIndex *index, gsize len, gint64 time, gint64 monotonic);
+gboolean time_index_find(TimeIndex *index, guint64 offset, TimeChunk *chunk);
+guint64 time_index_get_count(TimeIndex *index);
+gsize time_index_get_size(TimeIndex *index);
+
+#endif /* TIMEINDEX_H */
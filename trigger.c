@@ -0,0 +1,341 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <glib.h>
+#include <string.h>
+#include "trigger.h"
+
+/* see TriggerAction */
+gchar *trigger_action_labels[] = {"Send", "RTS high", "RTS low", "DTR high", "DTR low",
+                                  "Start capture", "Stop capture"};
+const guint n_trigger_action_labels = G_N_ELEMENTS(trigger_action_labels);
+
+#define NO_STATE G_MAXUINT32
+
+typedef struct {
+    guint id;
+    TriggerAction action;
+    guint8 *arg;
+    gsize n_arg;
+} Trigger;
+
+struct _TriggerSet {
+    gint ref_count;
+    gboolean compiled;
+
+    GArray *triggers;  /* of Trigger */
+    GPtrArray *patterns; /* of GByteArray, until compiled */
+
+    guint8 class_of[256];
+    guint n_classes;
+    guint32 *next;     /* n_states * n_classes transitions */
+    guint n_states;
+    guint32 *out_start; /* outputs of state s are out[out_start[s]..out_start[s + 1]) */
+    guint32 *out;       /* indexes into triggers */
+};
+
+TriggerSet *trigger_set_new(void)
+{
+    TriggerSet *set = g_slice_new0(TriggerSet);
+
+    set->ref_count = 1;
+    set->triggers = g_array_new(FALSE, FALSE, sizeof(Trigger));
+    set->patterns = g_ptr_array_new();
+
+    return set;
+}
+
+TriggerSet *trigger_set_ref(TriggerSet *set)
+{
+    g_atomic_int_inc(&set->ref_count);
+    return set;
+}
+
+void trigger_set_unref(TriggerSet *set)
+{
+    guint i;
+
+    if (!g_atomic_int_dec_and_test(&set->ref_count))
+        return;
+
+    for (i = 0; i < set->triggers->len; i++)
+        g_free(g_array_index(set->triggers, Trigger, i).arg);
+    g_array_free(set->triggers, TRUE);
+    for (i = 0; i < set->patterns->len; i++)
+        g_byte_array_free(g_ptr_array_index(set->patterns, i), TRUE);
+    g_ptr_array_free(set->patterns, TRUE);
+    g_free(set->next);
+    g_free(set->out_start);
+    g_free(set->out);
+    g_slice_free(TriggerSet, set);
+}
+
+/**
+ *  Adds pattern firing action with given argument. Must be called before
+ *  trigger_set_compile().
+ *
+ *  \return FALSE if pattern is empty
+ **/
+gboolean trigger_set_add(TriggerSet *set, guint id, const guint8 *pattern, gsize len,
+                         TriggerAction action, const guint8 *arg, gsize n_arg)
+{
+    Trigger trigger;
+    GByteArray *copy;
+
+    g_return_val_if_fail(!set->compiled, FALSE);
+
+    if (len == 0)
+        return FALSE;
+
+    trigger.id = id;
+    trigger.action = action;
+    trigger.arg = g_malloc(n_arg + 1);
+    memcpy(trigger.arg, arg, n_arg);
+    trigger.arg[n_arg] = '\0'; /* file name argument can be used as string */
+    trigger.n_arg = n_arg;
+    g_array_append_val(set->triggers, trigger);
+
+    copy = g_byte_array_sized_new(len);
+    g_byte_array_append(copy, pattern, len);
+    g_ptr_array_add(set->patterns, copy);
+
+    return TRUE;
+}
+
+/**
+ *  Builds the automaton: a trie of all patterns whose missing transitions
+ *  are filled in from failure links in breadth first order, so that
+ *  scanning never follows a failure link.
+ **/
+void trigger_set_compile(TriggerSet *set)
+{
+    GArray *next = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GPtrArray *outputs = g_ptr_array_new(); /* of GArray of guint32, per state */
+    GArray *fail = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GQueue queue = G_QUEUE_INIT;
+    guint32 no_state = NO_STATE;
+    guint i, c, total;
+
+    g_return_if_fail(!set->compiled);
+
+    /* input classes: 0 for bytes in no pattern */
+    memset(set->class_of, 0, sizeof(set->class_of));
+    set->n_classes = 1;
+    for (i = 0; i < set->patterns->len; i++)
+    {
+        GByteArray *pattern = g_ptr_array_index(set->patterns, i);
+        guint j;
+
+        for (j = 0; j < pattern->len; j++)
+        {
+            if (set->class_of[pattern->data[j]] == 0)
+                set->class_of[pattern->data[j]] = set->n_classes++;
+        }
+    }
+
+    /* trie, state 0 is root */
+    for (c = 0; c < set->n_classes; c++)
+        g_array_append_val(next, no_state);
+    g_ptr_array_add(outputs, g_array_new(FALSE, FALSE, sizeof(guint32)));
+    set->n_states = 1;
+
+    for (i = 0; i < set->patterns->len; i++)
+    {
+        GByteArray *pattern = g_ptr_array_index(set->patterns, i);
+        guint32 s = 0;
+        guint j;
+
+        for (j = 0; j < pattern->len; j++)
+        {
+            guint32 *t = &g_array_index(next, guint32, s * set->n_classes +
+                                        set->class_of[pattern->data[j]]);
+
+            if (*t == NO_STATE)
+            {
+                *t = set->n_states++;
+                for (c = 0; c < set->n_classes; c++)
+                    g_array_append_val(next, no_state);
+                g_ptr_array_add(outputs, g_array_new(FALSE, FALSE, sizeof(guint32)));
+            }
+            /* next may have been reallocated */
+            s = g_array_index(next, guint32, s * set->n_classes +
+                              set->class_of[pattern->data[j]]);
+        }
+        g_array_append_val(g_ptr_array_index(outputs, s), i);
+    }
+
+    /* failure links and full transition table, breadth first */
+    g_array_set_size(fail, set->n_states);
+    g_array_index(fail, guint32, 0) = 0;
+    g_queue_push_tail(&queue, GUINT_TO_POINTER(0));
+    while (!g_queue_is_empty(&queue))
+    {
+        guint32 s = GPOINTER_TO_UINT(g_queue_pop_head(&queue));
+        guint32 *row = &g_array_index(next, guint32, s * set->n_classes);
+        guint32 f = g_array_index(fail, guint32, s);
+
+        for (c = 0; c < set->n_classes; c++)
+        {
+            guint32 t = row[c];
+            /* row of shallower state f is already complete */
+            guint32 via_fail = (s == 0) ? 0 : g_array_index(next, guint32,
+                                                            f * set->n_classes + c);
+
+            if (t == NO_STATE)
+            {
+                row[c] = via_fail;
+                continue;
+            }
+
+            g_array_index(fail, guint32, t) = via_fail;
+            /* state also ends every pattern its failure state ends */
+            if (via_fail != t)
+            {
+                GArray *out = g_ptr_array_index(outputs, via_fail);
+
+                g_array_append_vals(g_ptr_array_index(outputs, t), out->data, out->len);
+            }
+            g_queue_push_tail(&queue, GUINT_TO_POINTER(t));
+        }
+    }
+    g_array_index(fail, guint32, 0) = 0;
+
+    /* flatten outputs */
+    set->out_start = g_new(guint32, set->n_states + 1);
+    for (i = 0, total = 0; i < set->n_states; i++)
+    {
+        set->out_start[i] = total;
+        total += ((GArray*)g_ptr_array_index(outputs, i))->len;
+    }
+    set->out_start[set->n_states] = total;
+    set->out = g_new(guint32, MAX(total, 1));
+    for (i = 0; i < set->n_states; i++)
+    {
+        GArray *out = g_ptr_array_index(outputs, i);
+
+        memcpy(set->out + set->out_start[i], out->data, out->len * sizeof(guint32));
+        g_array_free(out, TRUE);
+    }
+    g_ptr_array_free(outputs, TRUE);
+    g_array_free(fail, TRUE);
+
+    set->next = (guint32*)g_array_free(next, FALSE);
+    set->compiled = TRUE;
+}
+
+/**
+ *  \return number of patterns in set
+ **/
+guint trigger_set_get_count(TriggerSet *set)
+{
+    return set->triggers->len;
+}
+
+/**
+ *  Matches data, continuing from state returned by previous scan (0 to
+ *  start), and calls func for every pattern ending in data, in order.
+ *
+ *  \return state to pass to next scan
+ **/
+guint32 trigger_set_scan(TriggerSet *set, guint32 state, const guint8 *data,
+                         gsize len, TriggerFunc func, gpointer user_data)
+{
+    const guint32 *next = set->next;
+    const guint8 *class_of = set->class_of;
+    guint n_classes = set->n_classes;
+    gsize i;
+
+    if (state >= set->n_states)
+        state = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        guint32 k;
+
+        state = next[state * n_classes + class_of[data[i]]];
+        for (k = set->out_start[state]; k < set->out_start[state + 1]; k++)
+        {
+            Trigger *trigger = &g_array_index(set->triggers, Trigger, set->out[k]);
+
+            func(user_data, trigger->id, trigger->action, trigger->arg, trigger->n_arg);
+        }
+    }
+
+    return state;
+}
+
+/**
+ *  Parses text with C style escapes (\n, \r, \t, \\, \xNN, \NNN octal)
+ *  into bytes.
+ *
+ *  \return newly allocated bytes, NULL if an escape is invalid
+ **/
+guint8 *trigger_parse_bytes(const gchar *text, gsize *len)
+{
+    GByteArray *out = g_byte_array_new();
+    const gchar *p = text;
+
+    while (*p != '\0')
+    {
+        guint8 c = *p++;
+
+        if (c == '\\')
+        {
+            gint digits = 0;
+            guint value = 0;
+
+            switch (*p)
+            {
+                case 'n': c = '\n'; p++; break;
+                case 'r': c = '\r'; p++; break;
+                case 't': c = '\t'; p++; break;
+                case '\\': c = '\\'; p++; break;
+                case 'x':
+                    p++;
+                    while (digits < 2 && g_ascii_isxdigit(*p))
+                    {
+                        value = value * 16 + g_ascii_xdigit_value(*p++);
+                        digits++;
+                    }
+                    if (digits == 0)
+                    {
+                        g_byte_array_free(out, TRUE);
+                        return NULL;
+                    }
+                    c = value;
+                    break;
+                default:
+                    while (digits < 3 && *p >= '0' && *p <= '7')
+                    {
+                        value = value * 8 + (*p++ - '0');
+                        digits++;
+                    }
+                    if (digits == 0 || value > 0xFF)
+                    {
+                        g_byte_array_free(out, TRUE);
+                        return NULL;
+                    }
+                    c = value;
+                    break;
+            }
+        }
+        g_byte_array_append(out, &c, 1);
+    }
+
+    *len = out->len;
+    return g_byte_array_free(out, FALSE);
+}
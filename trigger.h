@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <glib.h>
+
+/**
+ *  Set of byte patterns with actions, matched against received data in
+ *  one pass with an Aho-Corasick automaton. Bytes that occur in no
+ *  pattern share one input class, so transition table has a row of
+ *  (distinct pattern bytes + 1) entries per state.
+ *
+ *  Set is built with trigger_set_add() and trigger_set_compile() on one
+ *  thread and is read-only afterwards, so compiled set can be shared
+ *  (reference counted) with the I/O thread. Matching state is kept by
+ *  the caller, which lets a set be swapped between reads.
+ **/
+typedef struct _TriggerSet TriggerSet;
+
+typedef enum {
+    TRIGGER_SEND = 0,
+    TRIGGER_RTS_HIGH,
+    TRIGGER_RTS_LOW,
+    TRIGGER_DTR_HIGH,
+    TRIGGER_DTR_LOW,
+    TRIGGER_CAPTURE_START, /* argument is file name */
+    TRIGGER_CAPTURE_STOP,
+} TriggerAction;
+
+/* labels, in order of TriggerAction */
+extern gchar *trigger_action_labels[];
+extern const guint n_trigger_action_labels;
+
+/* match reported to main loop */
+typedef struct {
+    guint id;
+    TriggerAction action;
+    gint64 arrival; /* when read() returned data ending with the match */
+    gint64 done;    /* when action was carried out by the I/O thread */
+} TriggerEvent;
+
+/* called for every match, id is the one passed to trigger_set_add() */
+typedef void (*TriggerFunc)(gpointer data, guint id, TriggerAction action,
+                            const guint8 *arg, gsize n_arg);
+
+TriggerSet *trigger_set_new(void);
+TriggerSet *trigger_set_ref(TriggerSet *set);
+void trigger_set_unref(TriggerSet *set);
+
+gboolean trigger_set_add(TriggerSet *set, guint id, const guint8 *pattern, gsize len,
+                         TriggerAction action, const guint8 *arg, gsize n_arg);
+void trigger_set_compile(TriggerSet *set);
+guint trigger_set_get_count(TriggerSet *set);
+
+guint32 trigger_set_scan(TriggerSet *set, guint32 state, const guint8 *data,
+                         gsize len, TriggerFunc func, gpointer user_data);
+
+guint8 *trigger_parse_bytes(const gchar *text, gsize *len);
+
+#endif /* TRIGGER_H */
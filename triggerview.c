@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <gtk/gtk.h>
+#include "triggerview.h"
+
+enum {
+    COL_ENABLED,
+    COL_PATTERN,
+    COL_ACTION,    /* label */
+    COL_ACTION_ID, /* TriggerAction */
+    COL_ARGUMENT,
+    COL_FIRED,
+    COL_LATENCY,
+    N_COLUMNS
+};
+
+struct _TriggerView {
+    GtkWidget *box;
+    GtkWidget *tree;
+    GtkListStore *list;
+    GtkListStore *actions; /* model of action combo */
+
+    TriggerSet *set; /* NULL if no trigger is enabled */
+
+    TriggerViewChangedFunc changed_func;
+    gpointer changed_data;
+};
+
+/**
+ *  Compiles enabled rows into a new set. Trigger id is the row number,
+ *  which lets fired events be matched to rows.
+ **/
+static void trigger_view_rebuild(TriggerView *tv)
+{
+    GtkTreeModel *model = GTK_TREE_MODEL(tv->list);
+    TriggerSet *set = trigger_set_new();
+    GtkTreeIter iter;
+    gboolean valid;
+    guint id = 0;
+
+    for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+         valid = gtk_tree_model_iter_next(model, &iter), id++)
+    {
+        gboolean enabled;
+        gchar *pattern_text, *arg_text;
+        gint action;
+        guint8 *pattern, *arg;
+        gsize len, n_arg;
+
+        gtk_tree_model_get(model, &iter, COL_ENABLED, &enabled,
+                           COL_PATTERN, &pattern_text, COL_ACTION_ID, &action,
+                           COL_ARGUMENT, &arg_text, -1);
+
+        pattern = trigger_parse_bytes(pattern_text, &len);
+        arg = trigger_parse_bytes(arg_text, &n_arg);
+        if (pattern == NULL || arg == NULL)
+            g_message("Trigger %u: invalid escape, trigger disabled", id + 1);
+        else if (enabled)
+            trigger_set_add(set, id, pattern, len, action, arg, n_arg);
+
+        g_free(pattern);
+        g_free(arg);
+        g_free(pattern_text);
+        g_free(arg_text);
+    }
+
+    if (tv->set != NULL)
+        trigger_set_unref(tv->set);
+    tv->set = NULL;
+    if (trigger_set_get_count(set) > 0)
+    {
+        trigger_set_compile(set);
+        tv->set = set;
+    }
+    else
+    {
+        trigger_set_unref(set);
+    }
+
+    if (tv->changed_func != NULL)
+        tv->changed_func(tv, tv->changed_data);
+}
+
+static void enabled_toggled_cb(GtkCellRendererToggle *renderer, gchar *path,
+                               TriggerView *tv)
+{
+    GtkTreeIter iter;
+    gboolean enabled;
+
+    if (!gtk_tree_model_get_iter_from_string(GTK_TREE_MODEL(tv->list), &iter, path))
+        return;
+
+    gtk_tree_model_get(GTK_TREE_MODEL(tv->list), &iter, COL_ENABLED, &enabled, -1);
+    gtk_list_store_set(tv->list, &iter, COL_ENABLED, !enabled, -1);
+    trigger_view_rebuild(tv);
+}
+
+static void text_edited_cb(GtkCellRendererText *renderer, gchar *path,
+                           gchar *text, TriggerView *tv)
+{
+    gint column = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(renderer), "column"));
+    GtkTreeIter iter;
+
+    if (!gtk_tree_model_get_iter_from_string(GTK_TREE_MODEL(tv->list), &iter, path))
+        return;
+
+    if (column == COL_ACTION)
+    {
+        guint i;
+
+        for (i = 0; i < n_trigger_action_labels; i++)
+        {
+            if (g_strcmp0(text, trigger_action_labels[i]) == 0)
+                gtk_list_store_set(tv->list, &iter, COL_ACTION, text, COL_ACTION_ID, i, -1);
+        }
+    }
+    else
+    {
+        gtk_list_store_set(tv->list, &iter, column, text, -1);
+    }
+    trigger_view_rebuild(tv);
+}
+
+static void add_button_cb(GtkButton *btn, TriggerView *tv)
+{
+    GtkTreeIter iter;
+    GtkTreePath *path;
+
+    gtk_list_store_append(tv->list, &iter);
+    gtk_list_store_set(tv->list, &iter, COL_ENABLED, TRUE, COL_PATTERN, "",
+                       COL_ACTION, trigger_action_labels[TRIGGER_SEND],
+                       COL_ACTION_ID, TRIGGER_SEND, COL_ARGUMENT, "",
+                       COL_FIRED, (guint64)0, COL_LATENCY, "-", -1);
+
+    /* empty pattern matches nothing, no need to rebuild until it is edited */
+    path = gtk_tree_model_get_path(GTK_TREE_MODEL(tv->list), &iter);
+    gtk_tree_view_set_cursor(GTK_TREE_VIEW(tv->tree), path,
+                             gtk_tree_view_get_column(GTK_TREE_VIEW(tv->tree), 1), TRUE);
+    gtk_tree_path_free(path);
+}
+
+static void remove_button_cb(GtkButton *btn, TriggerView *tv)
+{
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(tv->tree));
+    GtkTreeIter iter;
+
+    if (gtk_tree_selection_get_selected(selection, NULL, &iter))
+    {
+        gtk_list_store_remove(tv->list, &iter);
+        trigger_view_rebuild(tv);
+    }
+}
+
+static void trigger_view_destroy_cb(GtkWidget *widget, TriggerView *tv)
+{
+    if (tv->set != NULL)
+        trigger_set_unref(tv->set);
+    g_object_unref(tv->list);
+    g_object_unref(tv->actions);
+    g_slice_free(TriggerView, tv);
+}
+
+static void add_text_column(TriggerView *tv, const gchar *title, gint column,
+                            gboolean editable)
+{
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+
+    if (editable)
+    {
+        g_object_set(G_OBJECT(renderer), "editable", TRUE, NULL);
+        g_object_set_data(G_OBJECT(renderer), "column", GINT_TO_POINTER(column));
+        g_signal_connect(G_OBJECT(renderer), "edited",
+                         G_CALLBACK(text_edited_cb), tv);
+    }
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tv->tree), -1, title,
+                                                renderer, "text", column, NULL);
+}
+
+/**
+ *  Creates empty trigger table.
+ **/
+TriggerView *trigger_view_new(void)
+{
+    TriggerView *tv = g_slice_new0(TriggerView);
+    GtkCellRenderer *renderer;
+    GtkWidget *scrolled_window;
+    GtkWidget *hbox;
+    GtkWidget *btn_add;
+    GtkWidget *btn_remove;
+    GtkTreeIter iter;
+    guint i;
+
+    tv->list = gtk_list_store_new(N_COLUMNS, G_TYPE_BOOLEAN, G_TYPE_STRING, G_TYPE_STRING,
+                                  G_TYPE_INT, G_TYPE_STRING, G_TYPE_UINT64, G_TYPE_STRING);
+    tv->actions = gtk_list_store_new(1, G_TYPE_STRING);
+    for (i = 0; i < n_trigger_action_labels; i++)
+    {
+        gtk_list_store_append(tv->actions, &iter);
+        gtk_list_store_set(tv->actions, &iter, 0, trigger_action_labels[i], -1);
+    }
+
+    tv->tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(tv->list));
+
+    renderer = gtk_cell_renderer_toggle_new();
+    g_signal_connect(G_OBJECT(renderer), "toggled",
+                     G_CALLBACK(enabled_toggled_cb), tv);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tv->tree), -1, "On",
+                                                renderer, "active", COL_ENABLED, NULL);
+
+    add_text_column(tv, "Pattern", COL_PATTERN, TRUE);
+
+    renderer = gtk_cell_renderer_combo_new();
+    g_object_set(G_OBJECT(renderer), "model", tv->actions, "text-column", 0,
+                 "has-entry", FALSE, "editable", TRUE, NULL);
+    g_object_set_data(G_OBJECT(renderer), "column", GINT_TO_POINTER(COL_ACTION));
+    g_signal_connect(G_OBJECT(renderer), "edited",
+                     G_CALLBACK(text_edited_cb), tv);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tv->tree), -1, "Action",
+                                                renderer, "text", COL_ACTION, NULL);
+
+    add_text_column(tv, "Argument", COL_ARGUMENT, TRUE);
+    add_text_column(tv, "Fired", COL_FIRED, FALSE);
+    add_text_column(tv, "Latency", COL_LATENCY, FALSE);
+    gtk_widget_set_tooltip_text(tv->tree,
+                                "Pattern and data to send take \\r \\n \\t \\\\ \\xNN "
+                                "and \\NNN escapes, start capture takes a file name. "
+                                "Latency is from read() returning the match to "
+                                "the action.");
+
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scrolled_window, -1, 120);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tv->tree);
+
+    btn_add = gtk_button_new_with_label("Add");
+    btn_remove = gtk_button_new_with_label("Remove");
+    g_signal_connect(G_OBJECT(btn_add), "clicked",
+                     G_CALLBACK(add_button_cb), tv);
+    g_signal_connect(G_OBJECT(btn_remove), "clicked",
+                     G_CALLBACK(remove_button_cb), tv);
+    hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_add, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), btn_remove, FALSE, FALSE, 0);
+
+    tv->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(tv->box), scrolled_window, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(tv->box), hbox, FALSE, FALSE, 0);
+
+    g_signal_connect(G_OBJECT(tv->box), "destroy",
+                     G_CALLBACK(trigger_view_destroy_cb), tv);
+
+    return tv;
+}
+
+GtkWidget *trigger_view_get_widget(TriggerView *tv)
+{
+    return tv->box;
+}
+
+/**
+ *  \return compiled set of enabled triggers, NULL if there are none
+ **/
+TriggerSet *trigger_view_get_set(TriggerView *tv)
+{
+    return tv->set;
+}
+
+void trigger_view_set_changed_func(TriggerView *tv, TriggerViewChangedFunc func,
+                                   gpointer data)
+{
+    tv->changed_func = func;
+    tv->changed_data = data;
+}
+
+/**
+ *  Counts event of reader against its row and shows its latency. argument,
+ *  if not NULL, is set to newly allocated argument text of the trigger.
+ *
+ *  \return FALSE if event came from a set that was since replaced and no
+ *  longer matches table
+ **/
+gboolean trigger_view_fired(TriggerView *tv, const TriggerEvent *event, gchar **argument)
+{
+    GtkTreeIter iter;
+    guint64 fired;
+    gint action;
+    gchar *latency;
+
+    if (!gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tv->list), &iter, NULL, event->id))
+        return FALSE;
+
+    gtk_tree_model_get(GTK_TREE_MODEL(tv->list), &iter, COL_FIRED, &fired,
+                       COL_ACTION_ID, &action, -1);
+    if (action != (gint)event->action)
+        return FALSE;
+
+    latency = g_strdup_printf("%" G_GINT64_FORMAT " us", event->done - event->arrival);
+    gtk_list_store_set(tv->list, &iter, COL_FIRED, fired + 1, COL_LATENCY, latency, -1);
+    g_free(latency);
+
+    if (argument != NULL)
+        gtk_tree_model_get(GTK_TREE_MODEL(tv->list), &iter, COL_ARGUMENT, argument, -1);
+
+    return TRUE;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#ifndef TRIGGERVIEW_H
+#define TRIGGERVIEW_H
+
+#include <gtk/gtk.h>
+#include "trigger.h"
+
+/**
+ *  Editable table of triggers: byte pattern, action and its argument,
+ *  each of which can be disabled. Patterns and arguments take escapes
+ *  (see trigger_parse_bytes()). Every edit compiles a new trigger set
+ *  and calls changed function. Freed when its widget is destroyed.
+ **/
+typedef struct _TriggerView TriggerView;
+
+typedef void (*TriggerViewChangedFunc)(TriggerView *tv, gpointer data);
+
+TriggerView *trigger_view_new(void);
+GtkWidget *trigger_view_get_widget(TriggerView *tv);
+TriggerSet *trigger_view_get_set(TriggerView *tv);
+void trigger_view_set_changed_func(TriggerView *tv, TriggerViewChangedFunc func,
+                                   gpointer data);
+gboolean trigger_view_fired(TriggerView *tv, const TriggerEvent *event, gchar **argument);
+
+#endif /* TRIGGERVIEW_H */
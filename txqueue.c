@@ -0,0 +1,399 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "txqueue.h"
+
+#define TX_BUFFER_SIZE 4096
+#define TX_POOL_SIZE 16 /* free buffers kept for reuse */
+#define TX_IOV_MAX 16   /* buffers handed to one writev() */
+
+typedef struct _TxBuffer TxBuffer;
+
+struct _TxBuffer {
+    TxBuffer *next;
+    gsize start; /* first byte not yet written */
+    gsize end;   /* first free byte */
+    guint8 data[TX_BUFFER_SIZE];
+};
+
+struct _TxQueue {
+    GMutex lock;
+    gsize limit;
+    gsize depth;
+
+    TxBuffer *head; /* written from here */
+    TxBuffer *tail; /* pushed to here */
+    TxBuffer *pool;
+    guint n_pool;
+
+    TxQueueKickFunc kick;
+    gpointer kick_data;
+
+    GSourceFunc callback;
+    gpointer data;
+    gint wakeup_pending;
+    guint wakeup_source;
+
+    TxQueueStats stats;
+};
+
+static TxBuffer *tx_queue_buffer_get(TxQueue *queue)
+{
+    TxBuffer *buf = queue->pool;
+
+    if (buf != NULL)
+    {
+        queue->pool = buf->next;
+        queue->n_pool--;
+    }
+    else
+    {
+        buf = g_slice_new(TxBuffer);
+    }
+
+    buf->next = NULL;
+    buf->start = 0;
+    buf->end = 0;
+
+    return buf;
+}
+
+static void tx_queue_buffer_put(TxQueue *queue, TxBuffer *buf)
+{
+    if (queue->n_pool < TX_POOL_SIZE)
+    {
+        buf->next = queue->pool;
+        queue->pool = buf;
+        queue->n_pool++;
+    }
+    else
+    {
+        g_slice_free(TxBuffer, buf);
+    }
+}
+
+static void tx_queue_free_list(TxBuffer *buf)
+{
+    while (buf != NULL)
+    {
+        TxBuffer *next = buf->next;
+
+        g_slice_free(TxBuffer, buf);
+        buf = next;
+    }
+}
+
+static gboolean tx_queue_dispatch(gpointer data)
+{
+    TxQueue *queue = (TxQueue*)data;
+
+    g_atomic_int_set(&queue->wakeup_pending, 0);
+    if (queue->callback != NULL)
+        queue->callback(queue->data);
+
+    return FALSE;
+}
+
+static void tx_queue_wakeup(TxQueue *queue)
+{
+    if (queue->callback != NULL &&
+        g_atomic_int_compare_and_exchange(&queue->wakeup_pending, 0, 1))
+    {
+        queue->wakeup_source = g_idle_add(tx_queue_dispatch, queue);
+    }
+}
+
+/**
+ *  Drops everything queued, called with lock held.
+ **/
+static void tx_queue_drop(TxQueue *queue)
+{
+    while (queue->head != NULL)
+    {
+        TxBuffer *buf = queue->head;
+
+        queue->head = buf->next;
+        tx_queue_buffer_put(queue, buf);
+    }
+    queue->tail = NULL;
+
+    if (queue->depth > 0)
+    {
+        queue->stats.dropped += queue->depth;
+        queue->depth = 0;
+        if (queue->kick != NULL)
+            queue->kick(queue->kick_data, FALSE);
+    }
+}
+
+/**
+ *  Creates empty queue accepting up to limit bytes.
+ **/
+TxQueue *tx_queue_new(gsize limit)
+{
+    TxQueue *queue = g_slice_new0(TxQueue);
+
+    g_mutex_init(&queue->lock);
+    queue->limit = limit;
+
+    return queue;
+}
+
+/**
+ *  Frees queue with any unwritten data. Must be called from main thread,
+ *  after the fd owner stopped calling tx_queue_write().
+ **/
+void tx_queue_free(TxQueue *queue)
+{
+    if (g_atomic_int_get(&queue->wakeup_pending))
+    {
+        g_source_remove(queue->wakeup_source);
+    }
+
+    tx_queue_free_list(queue->head);
+    tx_queue_free_list(queue->pool);
+    g_mutex_clear(&queue->lock);
+    g_slice_free(TxQueue, queue);
+}
+
+/**
+ *  Sets function the fd owner uses to learn when it has to watch fd for
+ *  writability (pending is TRUE) and when it can stop (pending is FALSE).
+ **/
+void tx_queue_set_kick(TxQueue *queue, TxQueueKickFunc kick, gpointer data)
+{
+    g_mutex_lock(&queue->lock);
+    queue->kick = kick;
+    queue->kick_data = data;
+    g_mutex_unlock(&queue->lock);
+}
+
+/**
+ *  Sets function called from default main context after queued data was
+ *  written. Calls are coalesced, so check tx_queue_get_depth().
+ *  Must be called from main thread.
+ **/
+void tx_queue_set_callback(TxQueue *queue, GSourceFunc callback, gpointer data)
+{
+    g_mutex_lock(&queue->lock);
+    queue->callback = callback;
+    queue->data = data;
+    g_mutex_unlock(&queue->lock);
+}
+
+/**
+ *  Copies data to the end of queue. Only as much as fits below the limit
+ *  is accepted, rest is counted as dropped.
+ *
+ *  \return number of bytes queued
+ **/
+gsize tx_queue_push(TxQueue *queue, const guint8 *data, gsize len)
+{
+    gsize accepted, left;
+    gboolean was_empty;
+
+    g_mutex_lock(&queue->lock);
+
+    accepted = MIN(len, queue->limit - MIN(queue->depth, queue->limit));
+    queue->stats.queued += accepted;
+    queue->stats.dropped += len - accepted;
+    was_empty = (queue->depth == 0);
+
+    for (left = accepted; left > 0; )
+    {
+        gsize n;
+
+        if (queue->tail == NULL || queue->tail->end == TX_BUFFER_SIZE)
+        {
+            TxBuffer *buf = tx_queue_buffer_get(queue);
+
+            if (queue->tail != NULL)
+                queue->tail->next = buf;
+            else
+                queue->head = buf;
+            queue->tail = buf;
+        }
+
+        n = MIN(left, TX_BUFFER_SIZE - queue->tail->end);
+        memcpy(queue->tail->data + queue->tail->end, data, n);
+        queue->tail->end += n;
+        data += n;
+        left -= n;
+    }
+    queue->depth += accepted;
+
+    if (was_empty && accepted > 0 && queue->kick != NULL)
+        queue->kick(queue->kick_data, TRUE);
+
+    g_mutex_unlock(&queue->lock);
+
+    return accepted;
+}
+
+/**
+ *  Drops everything that was not written yet.
+ **/
+void tx_queue_clear(TxQueue *queue)
+{
+    g_mutex_lock(&queue->lock);
+    tx_queue_drop(queue);
+    g_mutex_unlock(&queue->lock);
+}
+
+/**
+ *  Writes as much of queued data as fd takes, with one writev() call per
+ *  TX_IOV_MAX buffers. Stops at EAGAIN or when queue is empty. Written
+ *  data is passed to written function (if not NULL) before its buffer
+ *  is reused.
+ *
+ *  \return FALSE on write error, queue is dropped in that case
+ **/
+gboolean tx_queue_write(TxQueue *queue, int fd,
+                        TxQueueWrittenFunc written, gpointer data)
+{
+    gboolean progress = FALSE;
+    gboolean ok = TRUE;
+
+    g_mutex_lock(&queue->lock);
+
+    while (queue->head != NULL)
+    {
+        struct iovec iov[TX_IOV_MAX];
+        TxBuffer *buf;
+        gsize offered = 0;
+        gsize left;
+        ssize_t ret;
+        int n = 0;
+
+        for (buf = queue->head; buf != NULL && n < TX_IOV_MAX; buf = buf->next)
+        {
+            iov[n].iov_base = buf->data + buf->start;
+            iov[n].iov_len = buf->end - buf->start;
+            offered += iov[n].iov_len;
+            n++;
+        }
+
+        ret = writev(fd, iov, n);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+            {
+                g_message("Serial port write failed: %s(%d)", strerror(errno), errno);
+                tx_queue_drop(queue);
+                ok = FALSE;
+            }
+            break;
+        }
+
+        queue->stats.writes++;
+        queue->stats.written += ret;
+        queue->depth -= ret;
+        progress = TRUE;
+
+        if ((gsize)ret < offered)
+            queue->stats.partial++;
+
+        /* release fully written buffers, partially written one stays at head */
+        left = ret;
+        while (left > 0)
+        {
+            gsize n_written;
+
+            buf = queue->head;
+            n_written = MIN(left, buf->end - buf->start);
+            if (written != NULL)
+                written(data, buf->data + buf->start, n_written);
+            buf->start += n_written;
+            left -= n_written;
+
+            if (buf->start == buf->end)
+            {
+                queue->head = buf->next;
+                if (queue->head == NULL)
+                    queue->tail = NULL;
+                tx_queue_buffer_put(queue, buf);
+            }
+        }
+
+        if (queue->depth == 0)
+        {
+            if (queue->kick != NULL)
+                queue->kick(queue->kick_data, FALSE);
+        }
+        else if ((gsize)ret < offered)
+        {
+            /* driver buffer is full, wait until fd is writable again */
+            break;
+        }
+    }
+
+    if (progress)
+        tx_queue_wakeup(queue);
+
+    g_mutex_unlock(&queue->lock);
+
+    return ok;
+}
+
+/**
+ *  \return number of bytes waiting to be written
+ **/
+gsize tx_queue_get_depth(TxQueue *queue)
+{
+    gsize depth;
+
+    g_mutex_lock(&queue->lock);
+    depth = queue->depth;
+    g_mutex_unlock(&queue->lock);
+
+    return depth;
+}
+
+/**
+ *  \return number of bytes tx_queue_push() would accept now
+ **/
+gsize tx_queue_get_space(TxQueue *queue)
+{
+    gsize space;
+
+    g_mutex_lock(&queue->lock);
+    space = queue->limit - MIN(queue->depth, queue->limit);
+    g_mutex_unlock(&queue->lock);
+
+    return space;
+}
+
+/**
+ *  \return TRUE if queue reached its limit and producers should wait
+ **/
+gboolean tx_queue_is_full(TxQueue *queue)
+{
+    return tx_queue_get_space(queue) == 0;
+}
+
+void tx_queue_get_stats(TxQueue *queue, TxQueueStats *stats)
+{
+    g_mutex_lock(&queue->lock);
+    *stats = queue->stats;
+    g_mutex_unlock(&queue->lock);
+}
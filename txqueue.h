@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2011-2012 Tomasz Moń <desowin@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <glib.h>
+
+/**
+ *  Transmit queue. Any thread may push data, it is copied into pooled
+ *  fixed size buffers and written with writev() by whoever owns the fd
+ *  (the I/O thread, see reader.h) when fd is writable. Partial writes
+ *  leave the rest queued, so nothing is lost under flow control.
+ *
+ *  Queue holds at most limit bytes; tx_queue_is_full() is the backpressure
+ *  state, producers should stop and wait for the callback, which is called
+ *  from main loop after queued data was written.
+ **/
+typedef struct _TxQueue TxQueue;
+
+/* called with queue locked when queue becomes non-empty or empty */
+typedef void (*TxQueueKickFunc)(gpointer data, gboolean pending);
+/* called with queue locked for every piece of data that was written */
+typedef void (*TxQueueWrittenFunc)(gpointer data, const guint8 *buf, gsize len);
+
+typedef struct {
+    gsize queued;  /* accepted by tx_queue_push() */
+    gsize written;
+    gsize writes;  /* writev() calls */
+    gsize partial; /* writev() calls that did not take everything offered */
+    gsize dropped; /* refused because queue was full, or lost on error */
+} TxQueueStats;
+
+TxQueue *tx_queue_new(gsize limit);
+void tx_queue_free(TxQueue *queue);
+
+void tx_queue_set_kick(TxQueue *queue, TxQueueKickFunc kick, gpointer data);
+void tx_queue_set_callback(TxQueue *queue, GSourceFunc callback, gpointer data);
+
+gsize tx_queue_push(TxQueue *queue, const guint8 *data, gsize len);
+void tx_queue_clear(TxQueue *queue);
+
+gsize tx_queue_get_depth(TxQueue *queue);
+gsize tx_queue_get_space(TxQueue *queue);
+gboolean tx_queue_is_full(TxQueue *queue);
+void tx_queue_get_stats(TxQueue *queue, TxQueueStats *stats);
+
+/* fd owner side */
+gboolean tx_queue_write(TxQueue *queue, int fd,
+                        TxQueueWrittenFunc written, gpointer data);
+
+#endif /* TXQUEUE_H */